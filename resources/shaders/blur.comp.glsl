@@ -1,7 +1,15 @@
 layout (local_size_x = 32, local_size_y = 32) in;
 
-layout (rgba32f, binding = 0) readonly restrict uniform image2D input_image;
-layout (rgba32f, binding = 1) writeonly restrict uniform image2D output_image;
+layout (HDR_IMAGE_FORMAT, binding = 0) readonly restrict uniform image2D input_image;
+layout (HDR_IMAGE_FORMAT, binding = 1) writeonly restrict uniform image2D output_image;
+
+// Used part of the input, the image may be larger. Outside of it counts as black
+uniform vec2 inputSize;
+
+vec3 LoadInput(ivec2 texel)
+{
+    return all(lessThan(texel, ivec2(inputSize))) ? imageLoad(input_image, texel).rgb : vec3(0.0);
+}
 
 const int width = 9;
 const int offsets[width] = int[](-4, -3, -2, -1, 0, 1, 2, 3, 4);
@@ -19,15 +27,15 @@ void main()
 #if defined(HORIZONTAL_BLUR)
         // We need to downsample
         ivec2 inTexel = (texel + ivec2(offsets[i], 0)) * 2;
-        vec3 row0 = mix(imageLoad(input_image, inTexel + ivec2(0, 0)).rgb, imageLoad(input_image, inTexel + ivec2(1, 0)).rgb, 0.5);
-        vec3 row1 = mix(imageLoad(input_image, inTexel + ivec2(0, 1)).rgb, imageLoad(input_image, inTexel + ivec2(1, 1)).rgb, 0.5);
+        vec3 row0 = mix(LoadInput(inTexel + ivec2(0, 0)), LoadInput(inTexel + ivec2(1, 0)), 0.5);
+        vec3 row1 = mix(LoadInput(inTexel + ivec2(0, 1)), LoadInput(inTexel + ivec2(1, 1)), 0.5);
         vec3 down = mix(row0, row1, 0.5);
 
         // Then blur
         color += down * weights[i];
 #elif defined(VERTICAL_BLUR)
         // We only need to blur
-        color += imageLoad(input_image, texel + ivec2(0, offsets[i])).rgb * weights[i];
+        color += LoadInput(texel + ivec2(0, offsets[i])) * weights[i];
 #endif
     }
 
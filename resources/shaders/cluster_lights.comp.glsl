@@ -0,0 +1,83 @@
+layout (local_size_x = 128) in;
+
+#include "frame_data.glsl"
+
+#define CLUSTER_ACCESS writeonly
+#include "clustered_lighting.glsl"
+
+uniform mat4 inverseProj;
+uniform float nearPlane;
+uniform float farPlane;
+
+// View space position and range of the lights of the current batch
+shared vec4 s_lights[128];
+
+// Point at viewDepth along the ray through ndc
+vec3 ScreenToView(vec2 ndc, float viewDepth)
+{
+    vec4 p = inverseProj * vec4(ndc, -1.0, 1.0);
+    p.xyz /= p.w;
+    return p.xyz * (viewDepth / -p.z);
+}
+
+void main()
+{
+    uint clusterIndex = gl_GlobalInvocationID.x;
+    bool active       = clusterIndex < u_clusterGrid.x * u_clusterGrid.y * u_clusterGrid.z;
+    uint lightCount   = u_clusterGrid.w;
+
+    uvec3 cluster = uvec3(clusterIndex % u_clusterGrid.x, (clusterIndex / u_clusterGrid.x) % u_clusterGrid.y, clusterIndex / (u_clusterGrid.x * u_clusterGrid.y));
+
+    // View space bounds of the froxel, slices are exponential in depth
+    vec2  ndcMin    = vec2(cluster.xy) / vec2(u_clusterGrid.xy) * 2.0 - 1.0;
+    vec2  ndcMax    = vec2(cluster.xy + 1u) / vec2(u_clusterGrid.xy) * 2.0 - 1.0;
+    float sliceNear = nearPlane * pow(farPlane / nearPlane, float(cluster.z) / float(u_clusterGrid.z));
+    float sliceFar  = nearPlane * pow(farPlane / nearPlane, float(cluster.z + 1u) / float(u_clusterGrid.z));
+
+    vec3 boundsMin = vec3(1e30);
+    vec3 boundsMax = vec3(-1e30);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        vec2  ndc    = vec2((i & 1) != 0 ? ndcMax.x : ndcMin.x, (i & 2) != 0 ? ndcMax.y : ndcMin.y);
+        vec3  corner = ScreenToView(ndc, (i & 4) != 0 ? sliceFar : sliceNear);
+        boundsMin    = min(boundsMin, corner);
+        boundsMax    = max(boundsMax, corner);
+    }
+
+    uint count = 0u;
+
+    for (uint base = 0u; base < lightCount; base += 128u)
+    {
+        uint lightIndex = base + gl_LocalInvocationIndex;
+        if (lightIndex < lightCount)
+        {
+            LightData light = u_lights[lightIndex];
+            s_lights[gl_LocalInvocationIndex] = vec4((u_view * vec4(light.position, 1.0)).xyz, light.range);
+        }
+
+        barrier();
+
+        uint batchCount = min(128u, lightCount - base);
+        for (uint i = 0u; active && i < batchCount; ++i)
+        {
+            // Sphere against box, spot lights are tested as spheres
+            vec4  light    = s_lights[i];
+            vec3  closest  = clamp(light.xyz, boundsMin, boundsMax);
+            vec3  offset   = closest - light.xyz;
+
+            if (dot(offset, offset) <= light.w * light.w && count < MAX_LIGHTS_PER_CLUSTER)
+            {
+                u_clusterLightIndices[clusterIndex * MAX_LIGHTS_PER_CLUSTER + count] = base + i;
+                ++count;
+            }
+        }
+
+        barrier();
+    }
+
+    if (active)
+    {
+        u_clusterLightCounts[clusterIndex] = count;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef CLUSTERED_LIGHTING_GLSL
+#define CLUSTERED_LIGHTING_GLSL
+
+// Mirrors ClusteredLighting in renderer/clustered_lighting.h, expects frame_data.glsl
+
+#define MAX_LIGHTS_PER_CLUSTER 64u
+
+// Only the pass building the clusters writes them
+#ifndef CLUSTER_ACCESS
+#define CLUSTER_ACCESS readonly
+#endif
+
+struct LightData
+{
+    vec3 position;
+    float range;
+    vec3 color; // Premultiplied by the intensity
+    float spotScale; // 0 for point lights
+    vec3 direction;
+    float spotOffset; // 1 for point lights
+};
+
+layout (std430, binding = 8) readonly buffer LightDataBlock
+{
+    LightData u_lights[];
+};
+
+layout (std430, binding = 9) CLUSTER_ACCESS buffer ClusterLightCountBlock
+{
+    uint u_clusterLightCounts[];
+};
+
+// MAX_LIGHTS_PER_CLUSTER slots per cluster
+layout (std430, binding = 10) CLUSTER_ACCESS buffer ClusterLightIndexBlock
+{
+    uint u_clusterLightIndices[];
+};
+
+uint GetClusterIndex(vec2 fragCoord, float viewDepth)
+{
+    uvec3 cluster;
+    cluster.xy = min(uvec2(fragCoord * u_clusterScaleBias.xy), u_clusterGrid.xy - 1u);
+    cluster.z  = uint(clamp(log(viewDepth) * u_clusterScaleBias.z + u_clusterScaleBias.w, 0.0, float(u_clusterGrid.z - 1u)));
+
+    return (cluster.z * u_clusterGrid.y + cluster.y) * u_clusterGrid.x + cluster.x;
+}
+
+#endif // CLUSTERED_LIGHTING_GLSL
@@ -1,13 +1,13 @@
 layout (local_size_x = 32, local_size_y = 32) in;
 
-uniform vec2 viewportSize;
+uniform vec2 viewportSize; // Used part of the targets, they may be larger
 uniform float bloomAmount;
+uniform bool bloomEnabled; // bloomTexture0 is not bound otherwise
 
 layout (rgba8, binding = 0) writeonly restrict uniform image2D output_image;
 
 layout (binding = 1) uniform sampler2D colorTexture;
 layout (binding = 2) uniform sampler2D bloomTexture0;
-layout (binding = 3) uniform sampler2D bloomTexture1;
 
 
 vec3 Tonemap_Uchimura(vec3 x, float P, float a, float m, float l, float c, float b) {
@@ -61,13 +61,20 @@ vec3 gamma_correct(vec3 v) {
 
 void main() {
     ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, ivec2(viewportSize))))
+    {
+        return;
+    }
 
     const int windowSize = 15;
 
-    vec3 color = texture(colorTexture, (texel + 0.5) / viewportSize).rgb;
+    // The bloom is at half the resolution
+    vec3 color = texelFetch(colorTexture, texel, 0).rgb;
     vec3 bloom = vec3(0.0);
-    bloom = texture(bloomTexture0, (texel + 0.5) / viewportSize).rgb;
-    // bloom = textureLod(bloomTexture1, texel / viewportSize, 2).rgb;
+    if (bloomEnabled)
+    {
+        bloom = texture(bloomTexture0, (texel + 0.5) * 0.5 / vec2(textureSize(bloomTexture0, 0))).rgb;
+    }
 
     vec3 finalColor = color + bloom * 0.2;
 
@@ -0,0 +1,213 @@
+layout (local_size_x = 64) in;
+
+#include "frame_data.glsl"
+
+// Mirrors GPUScene::InstanceData in renderer/gpu_scene.h
+struct InstanceData
+{
+    vec3 center;
+    uint firstIndex;
+    vec3 extent;
+    uint indexCount;
+    int baseVertex;
+    uint group;
+    uint commandOffset;
+    uint padding;
+};
+
+// DrawElementsIndirectCommand
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 3) readonly buffer InstanceDataBlock
+{
+    InstanceData u_instances[];
+};
+
+layout (std430, binding = 4) writeonly buffer DrawCommandBlock
+{
+    DrawCommand u_commands[];
+};
+
+layout (std430, binding = 5) buffer DrawCountBlock
+{
+    uint u_counts[];
+};
+
+// Whether each instance passed the last occlusion test
+layout (std430, binding = 6) buffer VisibilityBlock
+{
+    uint u_visibility[];
+};
+
+// Mirrors CullStatistics in renderer/gpu_scene.h
+layout (std430, binding = 7) buffer CullStatisticsBlock
+{
+    uint u_frustumCulled;
+    uint u_occlusionCulled;
+    uint u_earlyDraws;
+    uint u_lateDraws;
+};
+
+// Mirrors CullPhase in renderer/gpu_scene.h
+#define PHASE_ALL 0u
+#define PHASE_EARLY 1u
+#define PHASE_LATE 2u
+
+uniform uint instanceCount;
+uniform uint phase;
+uniform uint commandBase; // Commands and counts of the phase
+uniform uint countBase;
+
+layout (binding = 0) uniform sampler2D depthPyramid;
+uniform uint depthPyramidLevels;
+uniform vec2 depthPyramidSize; // Used part of level 0, the texture may be larger
+
+ivec2 GetPyramidLevelSize(int level)
+{
+    return max(ivec2(depthPyramidSize) >> level, ivec2(1));
+}
+
+bool IsInsideFrustum(vec3 center, vec3 extent)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        vec4 plane = u_frustumPlanes[i];
+        if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0.0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Compares the nearest depth of the box with the farthest depth of the pyramid texels its
+// screen rectangle covers, at the level where the rectangle spans at most 2x2 texels
+bool IsOccluded(vec3 center, vec3 extent)
+{
+    mat4 viewProj = u_proj * u_view;
+
+    vec2  rectMin  = vec2(1.0);
+    vec2  rectMax  = vec2(0.0);
+    float minDepth = 1.0;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + extent * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip   = viewProj * vec4(corner, 1.0);
+
+        // Crosses the camera plane
+        if (clip.w <= 0.0)
+        {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        rectMin  = min(rectMin, ndc.xy * 0.5 + 0.5);
+        rectMax  = max(rectMax, ndc.xy * 0.5 + 0.5);
+        minDepth = min(minDepth, ndc.z * 0.5 + 0.5);
+    }
+
+    rectMin = clamp(rectMin, vec2(0.0), vec2(1.0));
+    rectMax = clamp(rectMax, vec2(0.0), vec2(1.0));
+
+    vec2 rectSize = (rectMax - rectMin) * depthPyramidSize;
+    int  maxLevel = int(depthPyramidLevels) - 1;
+    int  level    = min(int(ceil(log2(max(max(rectSize.x, rectSize.y), 1.0)))), maxLevel);
+
+    ivec2 levelSize = GetPyramidLevelSize(level);
+    ivec2 texelMin  = min(ivec2(rectMin * vec2(levelSize)), levelSize - 1);
+    ivec2 texelMax  = min(ivec2(rectMax * vec2(levelSize)), levelSize - 1);
+
+    // Rounding of odd level sizes may still spread the rectangle over 3 texels
+    while (any(greaterThan(texelMax - texelMin, ivec2(1))) && level < maxLevel)
+    {
+        ++level;
+        levelSize = GetPyramidLevelSize(level);
+        texelMin  = min(ivec2(rectMin * vec2(levelSize)), levelSize - 1);
+        texelMax  = min(ivec2(rectMax * vec2(levelSize)), levelSize - 1);
+    }
+
+    float maxDepth = 0.0;
+    for (int y = texelMin.y; y <= texelMax.y; ++y)
+    {
+        for (int x = texelMin.x; x <= texelMax.x; ++x)
+        {
+            maxDepth = max(maxDepth, texelFetch(depthPyramid, ivec2(x, y), level).r);
+        }
+    }
+
+    return minDepth > maxDepth;
+}
+
+void EmitDraw(InstanceData instance, uint index)
+{
+    // The base instance is the instance index, so the vertex shader finds its draw data
+    uint slot = atomicAdd(u_counts[countBase + instance.group], 1u);
+    u_commands[commandBase + instance.commandOffset + slot] = DrawCommand(instance.indexCount, 1u, instance.firstIndex, instance.baseVertex, index);
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instanceCount)
+    {
+        return;
+    }
+
+    InstanceData instance = u_instances[index];
+
+    bool inFrustum = IsInsideFrustum(instance.center, instance.extent);
+
+    if (phase != PHASE_LATE && !inFrustum)
+    {
+        atomicAdd(u_frustumCulled, 1u);
+    }
+
+    if (phase == PHASE_ALL)
+    {
+        if (inFrustum)
+        {
+            EmitDraw(instance, index);
+            atomicAdd(u_earlyDraws, 1u);
+        }
+
+        u_visibility[index] = inFrustum ? 1u : 0u;
+    }
+    else if (phase == PHASE_EARLY)
+    {
+        // Last frame's visible set, its depth builds the pyramid the late phase tests against
+        if (inFrustum && u_visibility[index] != 0u)
+        {
+            EmitDraw(instance, index);
+            atomicAdd(u_earlyDraws, 1u);
+        }
+    }
+    else
+    {
+        bool wasVisible = u_visibility[index] != 0u;
+        bool visible    = inFrustum && !IsOccluded(instance.center, instance.extent);
+
+        u_visibility[index] = visible ? 1u : 0u;
+
+        // Those drawn by the early phase are only hidden from the next frame
+        if (inFrustum && !visible && !wasVisible)
+        {
+            atomicAdd(u_occlusionCulled, 1u);
+        }
+
+        // Not drawn by the early phase
+        if (visible && !wasVisible)
+        {
+            EmitDraw(instance, index);
+            atomicAdd(u_lateDraws, 1u);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#if defined(ALPHA_TESTED) && defined(BINDLESS_MATERIALS)
+#extension GL_ARB_bindless_texture : require
+#endif
+
+#ifdef ALPHA_TESTED
+layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) flat in uint in_drawIndex;
+
+#include "frame_data.glsl"
+
+#ifdef BINDLESS_MATERIALS
+#define s_albedo sampler2D(u_materials[u_draws[in_drawIndex].materialIndex].textures[0])
+#else
+// Matches TextureUnit_Albedo in material.h
+layout (binding = 0) uniform sampler2D s_albedo;
+#endif
+#endif
+
+void main()
+{
+#ifdef ALPHA_TESTED
+    // Same test as GetAlpha() in pbr.frag.glsl
+    if (texture(s_albedo, in_texcoord).a < 0.1) discard;
+#endif
+}
@@ -0,0 +1,40 @@
+#extension GL_ARB_shader_draw_parameters : require
+
+// Locations match BindingPoint in renderer/renderer.h
+layout (location = 0) in vec3 in_position;
+
+#ifdef ALPHA_TESTED
+layout (location = 3) in vec2 in_texcoord;
+
+layout (location = 2) out vec2 out_texcoord;
+layout (location = 3) flat out uint out_drawIndex;
+#endif
+
+#include "frame_data.glsl"
+
+#ifdef SHADOW_CASTER
+// Cascade being rendered, see ShadowMaps
+uniform mat4 viewProj;
+#else
+// Computed exactly like in pbr.vert.glsl, so that the shading pass passes the GL_EQUAL depth test
+invariant gl_Position;
+#endif
+
+void main()
+{
+    uint drawIndex = uint(gl_BaseInstanceARB);
+    DrawData draw = u_draws[drawIndex];
+
+    vec4 position = draw.model * vec4(in_position, 1.0);
+
+#ifdef ALPHA_TESTED
+    out_texcoord = in_texcoord;
+    out_drawIndex = drawIndex;
+#endif
+
+#ifdef SHADOW_CASTER
+    gl_Position = viewProj * position;
+#else
+    gl_Position = u_proj * u_view * position;
+#endif
+}
@@ -0,0 +1,87 @@
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (r32f, binding = 1) writeonly restrict uniform image2D output_image;
+
+// Used parts of the levels, the images may be larger
+uniform vec2 outputSize;
+
+#ifdef RESOLVE_MSAA_DEPTH
+
+#ifdef SINGLE_SAMPLE
+layout (binding = 0) uniform sampler2D depth_texture;
+#else
+layout (binding = 0) uniform sampler2DMS depth_texture;
+#endif
+
+void main()
+{
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(coord, ivec2(outputSize))))
+    {
+        return;
+    }
+
+#ifdef SINGLE_SAMPLE
+    float depth = texelFetch(depth_texture, coord, 0).r;
+#else
+    // Farthest sample, so that a partially covered pixel does not occlude
+    float depth = 0.0;
+    for (int i = 0; i < textureSamples(depth_texture); ++i)
+    {
+        depth = max(depth, texelFetch(depth_texture, coord, i).r);
+    }
+#endif
+
+    imageStore(output_image, coord, vec4(depth));
+}
+
+#else
+
+layout (r32f, binding = 0) readonly restrict uniform image2D input_image;
+
+uniform vec2 inputSize;
+
+// The texels past the used part of the input hold stale depths, clamping repeats the last ones
+float LoadDepth(ivec2 texel)
+{
+    return imageLoad(input_image, min(texel, ivec2(inputSize) - 1)).r;
+}
+
+void main()
+{
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size  = ivec2(outputSize);
+    if (any(greaterThanEqual(coord, size)))
+    {
+        return;
+    }
+
+    ivec2 source = coord * 2;
+
+    float depth = max(max(LoadDepth(source), LoadDepth(source + ivec2(1, 0))),
+                      max(LoadDepth(source + ivec2(0, 1)), LoadDepth(source + ivec2(1, 1))));
+
+    // Odd sizes: the last row and column also cover the texels left over by the division
+    ivec2 sourceSize = ivec2(inputSize);
+    bool  extraX     = (sourceSize.x & 1) != 0 && coord.x == size.x - 1;
+    bool  extraY     = (sourceSize.y & 1) != 0 && coord.y == size.y - 1;
+
+    if (extraX)
+    {
+        depth = max(depth, max(LoadDepth(source + ivec2(2, 0)), LoadDepth(source + ivec2(2, 1))));
+    }
+
+    if (extraY)
+    {
+        depth = max(depth, max(LoadDepth(source + ivec2(0, 2)), LoadDepth(source + ivec2(1, 2))));
+    }
+
+    if (extraX && extraY)
+    {
+        depth = max(depth, LoadDepth(source + ivec2(2, 2)));
+    }
+
+    imageStore(output_image, coord, vec4(depth));
+}
+
+#endif
@@ -2,6 +2,8 @@ layout (local_size_x = 8, local_size_y = 8, local_size_z = 6) in;
 layout (binding = 0) uniform sampler2D equirectangularMap;
 layout (binding = 1, rgba32f) writeonly uniform imageCube envmap;
 
+uniform vec2 cubemapSize;
+
 #include "base_math.glsl"
 #include "cubemap_helpers.glsl"
 
@@ -16,7 +18,7 @@ vec2 SampleSphericalMap(vec3 v)
 void main()
 {
     ivec3 cubeCoord = ivec3(gl_GlobalInvocationID);
-    vec3 worldPos = CubeCoordToWorld(cubeCoord, vec2(1024, 1024));
+    vec3 worldPos = CubeCoordToWorld(cubeCoord, cubemapSize);
     vec3 normal = normalize(worldPos);
 
     vec2 uv = SampleSphericalMap(normal);
@@ -0,0 +1,57 @@
+#ifndef FRAME_DATA_GLSL
+#define FRAME_DATA_GLSL
+
+// Mirrors FrameData, DrawData and MaterialData in renderer/frame_data.h
+
+#define SHADOW_CASCADE_COUNT 4
+
+layout (std140, binding = 0) uniform FrameDataBlock
+{
+    mat4 u_view;
+    mat4 u_proj;
+    vec3 u_eye;
+    float u_padding0;
+    vec3 u_lightDirection;
+    float u_padding1;
+    vec4 u_lightColor;
+    vec4 u_frustumPlanes[6];
+    vec4 u_clusterScaleBias;
+    uvec4 u_clusterGrid;
+    mat4 u_shadowMatrices[SHADOW_CASCADE_COUNT];
+    vec4 u_shadowSplits;
+    vec4 u_shadowTexelSize;
+};
+
+struct DrawData
+{
+    mat4 model;
+    mat4 normalMatrix;
+    uint materialIndex;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+struct MaterialData
+{
+    vec4 albedo;
+    vec4 emissive; // rgb: emissive, a: emissive factor
+    float roughness;
+    float metallic;
+    uint mask;
+    uint padding0;
+    uvec2 textures[7]; // Bindless handles indexed by TextureUnit
+    uvec2 padding1;
+};
+
+layout (std430, binding = 1) readonly buffer DrawDataBlock
+{
+    DrawData u_draws[];
+};
+
+layout (std430, binding = 2) readonly buffer MaterialDataBlock
+{
+    MaterialData u_materials[];
+};
+
+#endif // FRAME_DATA_GLSL
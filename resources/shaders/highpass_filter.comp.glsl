@@ -1,7 +1,7 @@
 layout (local_size_x = 32, local_size_y = 32) in;
 
-layout (rgba32f, binding = 0) readonly restrict uniform image2D input_image;
-layout (rgba32f, binding = 1) writeonly restrict uniform image2D output_image;
+layout (HDR_IMAGE_FORMAT, binding = 0) readonly restrict uniform image2D input_image;
+layout (HDR_IMAGE_FORMAT, binding = 1) writeonly restrict uniform image2D output_image;
 
 uniform float threshold;
 
@@ -0,0 +1,91 @@
+#ifndef MATERIAL_FEATURES_GLSL
+#define MATERIAL_FEATURES_GLSL
+
+// Material features as boolean expressions, see Material::GetMask().
+// Variants fold them at compile time, the uber shader branches on MATERIAL_MASK (defined by the includer)
+// until its variant is ready.
+
+#ifdef UBER_SHADER
+
+#define HAS_ALBEDO_B                     ((MATERIAL_MASK & (1u << 0u)) != 0u)
+#define HAS_ALBEDO_TEXTURE_B             ((MATERIAL_MASK & (1u << 1u)) != 0u)
+#define HAS_ROUGHNESS_B                  ((MATERIAL_MASK & (1u << 2u)) != 0u)
+#define HAS_ROUGHNESS_TEXTURE_B          ((MATERIAL_MASK & (1u << 3u)) != 0u)
+#define HAS_METALLIC_B                   ((MATERIAL_MASK & (1u << 4u)) != 0u)
+#define HAS_METALLIC_TEXTURE_B           ((MATERIAL_MASK & (1u << 5u)) != 0u)
+#define HAS_METALLIC_ROUGHNESS_TEXTURE_B ((MATERIAL_MASK & (1u << 6u)) != 0u)
+#define HAS_EMISSIVE_B                   ((MATERIAL_MASK & (1u << 7u)) != 0u)
+#define HAS_EMISSIVE_TEXTURE_B           ((MATERIAL_MASK & (1u << 8u)) != 0u)
+#define HAS_NORMAL_MAP_B                 ((MATERIAL_MASK & (1u << 9u)) != 0u)
+#define HAS_AMBIENT_OCCLUSION_MAP_B      ((MATERIAL_MASK & (1u << 10u)) != 0u)
+#else
+
+#ifdef HAS_ALBEDO
+#define HAS_ALBEDO_B true
+#else
+#define HAS_ALBEDO_B false
+#endif
+
+#ifdef HAS_ALBEDO_TEXTURE
+#define HAS_ALBEDO_TEXTURE_B true
+#else
+#define HAS_ALBEDO_TEXTURE_B false
+#endif
+
+#ifdef HAS_ROUGHNESS
+#define HAS_ROUGHNESS_B true
+#else
+#define HAS_ROUGHNESS_B false
+#endif
+
+#ifdef HAS_ROUGHNESS_TEXTURE
+#define HAS_ROUGHNESS_TEXTURE_B true
+#else
+#define HAS_ROUGHNESS_TEXTURE_B false
+#endif
+
+#ifdef HAS_METALLIC
+#define HAS_METALLIC_B true
+#else
+#define HAS_METALLIC_B false
+#endif
+
+#ifdef HAS_METALLIC_TEXTURE
+#define HAS_METALLIC_TEXTURE_B true
+#else
+#define HAS_METALLIC_TEXTURE_B false
+#endif
+
+#ifdef HAS_METALLIC_ROUGHNESS_TEXTURE
+#define HAS_METALLIC_ROUGHNESS_TEXTURE_B true
+#else
+#define HAS_METALLIC_ROUGHNESS_TEXTURE_B false
+#endif
+
+#ifdef HAS_EMISSIVE
+#define HAS_EMISSIVE_B true
+#else
+#define HAS_EMISSIVE_B false
+#endif
+
+#ifdef HAS_EMISSIVE_TEXTURE
+#define HAS_EMISSIVE_TEXTURE_B true
+#else
+#define HAS_EMISSIVE_TEXTURE_B false
+#endif
+
+#ifdef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP_B true
+#else
+#define HAS_NORMAL_MAP_B false
+#endif
+
+#ifdef HAS_AMBIENT_OCCLUSION_MAP
+#define HAS_AMBIENT_OCCLUSION_MAP_B true
+#else
+#define HAS_AMBIENT_OCCLUSION_MAP_B false
+#endif
+
+#endif
+
+#endif // MATERIAL_FEATURES_GLSL
@@ -1,90 +1,81 @@
+#ifdef BINDLESS_MATERIALS
+#extension GL_ARB_bindless_texture : require
+#endif
+
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) flat in uint in_drawIndex;
 
 #ifdef HAS_NORMAL_MAP
 #endif
 
 layout (location = 0) out vec4 out_color;
 
-uniform mat4 u_view;
-
-uniform vec3 u_eye;
-
-uniform vec3 u_albedo;
-
-#ifdef HAS_ROUGHNESS
-uniform float u_roughness;
-#endif
-
-#ifdef HAS_METALLIC
-uniform float u_metallic;
-#endif
-
-#ifdef HAS_EMISSIVE
-uniform vec3 u_emissive;
-#endif
-
-#ifdef HAS_ALBEDO_TEXTURE
-uniform sampler2D s_albedo;
-#endif
-
-#ifdef HAS_ROUGHNESS_TEXTURE
-uniform sampler2D s_roughness;
-#endif
-
-#ifdef HAS_METALLIC_TEXTURE
-uniform sampler2D s_metallic;
-#endif
-
-#ifdef HAS_METALLIC_ROUGHNESS_TEXTURE
-uniform sampler2D s_metallicRoughness;
-#endif
-
-#ifdef HAS_EMISSIVE_TEXTURE
-uniform sampler2D s_emissive;
-#endif
-
-#if defined(HAS_EMISSIVE) || defined(HAS_EMISSIVE_TEXTURE)
-uniform float u_emissiveFactor;
-#endif
-
-#ifdef HAS_NORMAL_MAP
-uniform sampler2D s_normal;
-#endif
-
-#ifdef HAS_AMBIENT_OCCLUSION_MAP
-uniform sampler2D s_ambientOcclusion;
+#include "frame_data.glsl"
+#include "clustered_lighting.glsl"
+
+#define DRAW u_draws[in_drawIndex]
+#define MATERIAL u_materials[DRAW.materialIndex]
+
+#ifdef BINDLESS_MATERIALS
+// Handles come with the material data, so that draws with different textures can share a multi-draw
+#define s_albedo            sampler2D(MATERIAL.textures[0])
+#define s_roughness         sampler2D(MATERIAL.textures[1])
+#define s_metallic          sampler2D(MATERIAL.textures[2])
+#define s_metallicRoughness sampler2D(MATERIAL.textures[3])
+#define s_emissive          sampler2D(MATERIAL.textures[4])
+#define s_normal            sampler2D(MATERIAL.textures[5])
+#define s_ambientOcclusion  sampler2D(MATERIAL.textures[6])
+#else
+// Declared unconditionally, unused samplers are optimized out of the variants.
+// Units match TextureUnit in material.h
+layout (binding = 0) uniform sampler2D s_albedo;
+layout (binding = 1) uniform sampler2D s_roughness;
+layout (binding = 2) uniform sampler2D s_metallic;
+layout (binding = 3) uniform sampler2D s_metallicRoughness;
+layout (binding = 4) uniform sampler2D s_emissive;
+layout (binding = 5) uniform sampler2D s_normal;
+layout (binding = 6) uniform sampler2D s_ambientOcclusion;
 #endif
 
-uniform samplerCube s_irradianceMap;
-uniform samplerCube s_radianceMap;
-uniform sampler2D s_iblDFG;
+layout (binding = 7) uniform samplerCube s_irradianceMap;
+layout (binding = 8) uniform samplerCube s_radianceMap;
+layout (binding = 9) uniform sampler2D s_iblDFG;
+layout (binding = 10) uniform sampler2DArrayShadow s_shadowMap;
 
 #define MIN_PERCEPTUAL_ROUGHNESS 0.045
 
-#include "math_utils.glsl"
+#define MATERIAL_MASK MATERIAL.mask
+#include "material_features.glsl"
 #include "pbr_utils.glsl"
 
 vec3 GetAlbedo() {
     vec3 result = vec3(0.0);
 
-#if defined(HAS_ALBEDO_TEXTURE) && defined(HAS_ALBEDO)
-    result = u_albedo * pow(texture(s_albedo, in_texcoord).rgb, vec3(2.2));
-#elif defined(HAS_ALBEDO_TEXTURE)
-    result = pow(texture(s_albedo, in_texcoord).rgb, vec3(2.2));
-#elif defined(HAS_ALBEDO)
-    result = u_albedo;
-#endif
+    if (HAS_ALBEDO_TEXTURE_B)
+    {
+        result = pow(texture(s_albedo, in_texcoord).rgb, vec3(2.2));
+
+        if (HAS_ALBEDO_B)
+        {
+            result *= MATERIAL.albedo.rgb;
+        }
+    }
+    else if (HAS_ALBEDO_B)
+    {
+        result = MATERIAL.albedo.rgb;
+    }
 
     return result;
 }
 
 float GetAlpha()
 {
-#ifdef HAS_ALBEDO_TEXTURE
-    return texture(s_albedo, in_texcoord).a;
-#endif
+    if (HAS_ALBEDO_TEXTURE_B)
+    {
+        return texture(s_albedo, in_texcoord).a;
+    }
     return 1.0f;
 }
 
@@ -92,25 +83,30 @@ vec2 GetMetallicRoughness()
 {
     vec2 result = vec2(1, 1);
 
-#ifdef HAS_METALLIC
-    result.x *= u_metallic;
-#endif
+    if (HAS_METALLIC_B)
+    {
+        result.x *= MATERIAL.metallic;
+    }
 
-#ifdef HAS_ROUGHNESS
-    result.y *= u_roughness;
-#endif
+    if (HAS_ROUGHNESS_B)
+    {
+        result.y *= MATERIAL.roughness;
+    }
 
-#ifdef HAS_METALLIC_TEXTURE
-    result.x *= texture(s_metallic, in_texcoord).r;
-#endif
+    if (HAS_METALLIC_TEXTURE_B)
+    {
+        result.x *= texture(s_metallic, in_texcoord).r;
+    }
 
-#ifdef HAS_ROUGHNESS_TEXTURE
-    result.y *= texture(s_roughness, in_texcoord).r;
-#endif
+    if (HAS_ROUGHNESS_TEXTURE_B)
+    {
+        result.y *= texture(s_roughness, in_texcoord).r;
+    }
 
-#ifdef HAS_METALLIC_ROUGHNESS_TEXTURE
-    result *= texture(s_metallicRoughness, in_texcoord).bg;
-#endif
+    if (HAS_METALLIC_ROUGHNESS_TEXTURE_B)
+    {
+        result *= texture(s_metallicRoughness, in_texcoord).bg;
+    }
 
     return result;
 }
@@ -118,26 +114,28 @@ vec2 GetMetallicRoughness()
 vec3 GetEmissive() {
     vec3 result = vec3(0.0);
 
-#ifdef HAS_EMISSIVE_TEXTURE
-#   ifdef HAS_EMISSIVE
-    result = u_emissive * texture(s_emissive, in_texcoord).rgb;
-#   else
-    result = texture(s_emissive, in_texcoord).rgb;
-#   endif
-#else
-#   ifdef HAS_EMISSIVE
-    result = u_emissive;
-#   endif
-#endif
+    if (HAS_EMISSIVE_TEXTURE_B)
+    {
+        result = texture(s_emissive, in_texcoord).rgb;
 
-#if defined(HAS_EMISSIVE_TEXTURE) || defined(HAS_EMISSIVE)
-    result *= u_emissiveFactor;
-#endif
+        if (HAS_EMISSIVE_B)
+        {
+            result *= MATERIAL.emissive.rgb;
+        }
+    }
+    else if (HAS_EMISSIVE_B)
+    {
+        result = MATERIAL.emissive.rgb;
+    }
+
+    if (HAS_EMISSIVE_TEXTURE_B || HAS_EMISSIVE_B)
+    {
+        result *= MATERIAL.emissive.a;
+    }
 
     return result;
 }
 
-#ifdef HAS_NORMAL_MAP
 // http://www.thetenthplanet.de/archives/1180
 mat3 CotangentFrame(vec3 N, vec3 p, vec2 uv)
 {
@@ -157,67 +155,35 @@ mat3 CotangentFrame(vec3 N, vec3 p, vec2 uv)
     float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
     return mat3(T * invmax, B * invmax, N);
 }
-#endif
 
 vec3 GetNormal()
 {
     return normalize(in_normal);
-#ifdef HAS_NORMAL_MAP
-    vec3 normal = normalize(in_normal);
-    vec3 normalTex = texture(s_normal, in_texcoord).rgb * 2.0 - vec3(1.0);
 
-    vec3 p = u_eye - in_position;
-    vec3 N = normal;
-    vec2 uv = in_texcoord;
+    if (HAS_NORMAL_MAP_B)
+    {
+        vec3 normal = normalize(in_normal);
+        vec3 normalTex = texture(s_normal, in_texcoord).rgb * 2.0 - vec3(1.0);
+
+        vec3 p = u_eye - in_position;
+        vec3 N = normal;
+        vec2 uv = in_texcoord;
+
+        mat3 TBN = CotangentFrame(N, p, uv);
+        return normalize(TBN * normalTex);
+    }
 
-    mat3 TBN = CotangentFrame(N, p, uv);
-    return normalize(TBN * normalTex);
-#else
     return normalize(in_normal);
-#endif
 }
 
 float GetAmbientOcclusion()
 {
-#ifdef HAS_AMBIENT_OCCLUSION_MAP
-    return texture(s_ambientOcclusion, in_texcoord).r;
-#else
-    return 1.0f;
-#endif
-}
-
-vec3 GetLightPos(int index)
-{
-    if (index == 0) {
-        return vec3(-10, 10, 10);
-    }
-    if (index == 1) {
-        return vec3(10, 10, 10);
-    }
-    if (index == 2) {
-        return vec3(-10, -10, 10);
-    }
-    if (index == 3) {
-        return vec3(10, -10, 10);
-    }
-}
-
-vec3 GetLightColor(int index) {
-
-    if (index == 0) {
-        return vec3(225,186,49);
-    }
-    if (index == 1) {
-        return vec3(9,184,20);
-    }
-    if (index == 2) {
-        return vec3(239,49,56);
-    }
-    if (index == 3) {
-        return vec3(123,198,168);
+    if (HAS_AMBIENT_OCCLUSION_MAP_B)
+    {
+        return texture(s_ambientOcclusion, in_texcoord).r;
     }
 
-    return vec3(150, 150, 150);
+    return 1.0f;
 }
 
 vec3 GetViewPos()
@@ -311,22 +277,86 @@ vec3 BRDF(in vec3 n, in vec3 v, in vec3 l, in PixelParams params)
     return Fr + Fd;
 }
 
-vec3 EvaluateDirectLighting(in vec3 n, in vec3 v, in PixelParams params)
+// 1 when lit, 0 in the shadow, filtered over 3x3 bilinear taps of the cascade covering the fragment
+float EvaluateShadow(in vec3 n)
+{
+    float viewDepth = -(u_view * vec4(GetFragPos(), 1.0)).z;
+
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADE_COUNT && viewDepth >= u_shadowSplits[cascade])
+    {
+        ++cascade;
+    }
+
+    // Beyond the last cascade, or no shadows at all
+    if (cascade == SHADOW_CASCADE_COUNT)
+    {
+        return 1.0;
+    }
+
+    // Normal offset, scaled with the texels of the cascade to keep the acne away
+    vec3 position = GetFragPos() + n * (1.5 * u_shadowTexelSize[cascade]);
+    vec3 coord    = (u_shadowMatrices[cascade] * vec4(position, 1.0)).xyz;
+
+    vec2  texelSize = 1.0 / vec2(textureSize(s_shadowMap, 0).xy);
+    float shadow    = 0.0;
+
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            shadow += texture(s_shadowMap, vec4(coord.xy + vec2(x, y) * texelSize, float(cascade), coord.z));
+        }
+    }
+
+    return shadow / 9.0;
+}
+
+vec3 EvaluateDirectionalLight(in vec3 n, in vec3 v, in PixelParams params)
+{
+    vec3  l   = -u_lightDirection;
+    float NoL = saturate(dot(n, l));
+
+    if (NoL == 0.0 || u_lightColor.rgb == vec3(0.0))
+    {
+        return vec3(0.0);
+    }
+
+    return BRDF(n, v, l, params) * u_lightColor.rgb * NoL * EvaluateShadow(n);
+}
+
+// Only the lights binned into the cluster of the fragment
+vec3 EvaluatePunctualLights(in vec3 n, in vec3 v, in PixelParams params)
 {
     vec3 Lo = vec3(0.0);
 
-    for (int i = 0; i < 0; ++i)
+    if (u_clusterGrid.w == 0u)
+    {
+        return Lo;
+    }
+
+    float viewDepth = -(u_view * vec4(GetFragPos(), 1.0)).z;
+    uint  cluster   = GetClusterIndex(gl_FragCoord.xy, viewDepth);
+    uint  count     = u_clusterLightCounts[cluster];
+
+    for (uint i = 0u; i < count; ++i)
     {
-        vec3 lightVec = GetLightPos(i) - GetFragPos();
+        LightData light = u_lights[u_clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
 
-        vec3 l = normalize(lightVec);
+        vec3  lightVec        = light.position - GetFragPos();
+        float distanceSquared = dot(lightVec, lightVec);
+        vec3  l               = lightVec * inversesqrt(max(distanceSquared, 1e-8));
 
-        float attenuation = 1.0 / dot(lightVec, lightVec);
+        // Inverse square falloff, windowed to reach 0 at the range
+        float factor      = distanceSquared / (light.range * light.range);
+        float window      = saturate(1.0 - factor * factor);
+        float attenuation = window * window / max(distanceSquared, 1e-4);
 
-        vec3 illuminance = GetLightColor(i) * 0.01 * saturate(dot(n, l)) * attenuation;
-        vec3 luminance = BRDF(n, v, l, params) * illuminance;
+        float cone = saturate(dot(-l, light.direction) * light.spotScale + light.spotOffset);
+        attenuation *= cone * cone;
 
-        Lo += luminance;
+        vec3 illuminance = light.color * saturate(dot(n, l)) * attenuation;
+        Lo += BRDF(n, v, l, params) * illuminance;
     }
 
     return Lo;
@@ -389,7 +419,7 @@ void main()
     PixelParams params;
     GetPixelParams(params, max(dot(n, v), 1e-4));
 
-    vec3 color = EvaluateIBL(n, v, params) + EvaluateDirectLighting(n, v, params) + GetEmissive();
+    vec3 color = EvaluateIBL(n, v, params) + EvaluateDirectionalLight(n, v, params) + EvaluatePunctualLights(n, v, params) + GetEmissive();
     color *= GetAmbientOcclusion();
 
     out_color = vec4(color, 1.0);
@@ -1,3 +1,5 @@
+#extension GL_ARB_shader_draw_parameters : require
+
 #define POSITION_LOCATION  0
 #define NORMAL_LOCATION    1
 #define TANGENT_LOCATION   2
@@ -22,20 +24,25 @@ layout (location = TEXCOORD0_LOCATION) in vec2 in_texcoord;
 layout (location = 0) out vec3 out_position;
 layout (location = 1) out vec3 out_normal;
 layout (location = 2) out vec2 out_texcoord;
+layout (location = 3) flat out uint out_drawIndex;
 
 #ifdef HAS_NORMAL_MAP
 #endif
 
-uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_proj;
+#include "frame_data.glsl"
+
+// Must match depth.vert.glsl for the GL_EQUAL test after the depth pre-pass
+invariant gl_Position;
 
 void main()
 {
-    vec4 position = u_model * vec4(in_position, 1.0);
+    // One draw per model, the base instance indexes its draw data
+    out_drawIndex = uint(gl_BaseInstanceARB);
+    DrawData draw = u_draws[out_drawIndex];
+
+    vec4 position = draw.model * vec4(in_position, 1.0);
     out_position = position.xyz;
-    // TODO: Input normal matrix
-    out_normal = vec3(transpose(inverse(u_model)) * vec4(in_normal, 0.0));
+    out_normal = mat3(draw.normalMatrix) * in_normal;
     // out_texcoord = vec2(in_texcoord.x, 1 - in_texcoord.y);
     out_texcoord = in_texcoord;
 
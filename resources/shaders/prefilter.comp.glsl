@@ -2,16 +2,20 @@ layout (local_size_x = 8, local_size_y = 8, local_size_z = 6) in;
 layout (binding = 0) uniform samplerCube envMap;
 layout (binding = 1, rgba32f) writeonly uniform imageCube radianceMap;
 
-uniform float roughness;
+// Tangent space sample directions (xyz) and source mip level (w), built once on the CPU.
+// V = N is assumed, so the directions are the same for every texel of a given roughness.
+layout (std430, binding = 0) readonly buffer PrefilterSamples
+{
+	vec4 samples[];
+};
+
 uniform vec2 mipSize;
+uniform uint sampleOffset;
+uniform uint sampleCount;
+uniform float invTotalWeight;
 
 #include "base_math.glsl"
 #include "cubemap_helpers.glsl"
-#include "pbr_utils.glsl"
-
-const vec2 cubemapSize = vec2(1024, 1024);
-const float originalSamples = cubemapSize.x * cubemapSize.y;
-const uint sampleCount = 1024u;
 
 void main()
 {
@@ -19,40 +23,23 @@ void main()
 	vec3 worldPos = CubeCoordToWorld(cubeCoord, mipSize);
 	vec3 N = normalize(worldPos);
 
-	// Assume view direction always equal to outgoing direction
-	vec3 R = N;
-	vec3 V = R;
-
-	vec3 color = vec3(1.0);
-	float totalWeight = 0.0;
+	// Tangent space to world space
+	vec3 U = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+	vec3 T = normalize(cross(U, N));
+	vec3 B = cross(N, T);
 
-	float invSampleCount = 1.0f / sampleCount;
+	vec3 color = vec3(0.0);
 
-	for (uint i = 0; i < sampleCount; ++i)
+	for (uint i = sampleOffset; i < sampleOffset + sampleCount; ++i)
 	{
-		vec2 Xi = Hammersley(i, invSampleCount);
-		vec3 H = HemisphereImportanceSampleDGGX(Xi, roughness * roughness, N);
-		vec3 L = normalize(2.0f * dot(V, H) * H - V);
-
-		float NoL = saturate(dot(N, L));
-
-		if (NoL > 0)
-		{
-			float NoH = saturate(dot(N, H));
-			float VoH = saturate(dot(V, H));
-
-			float pdf = D_GGX(NoH, roughness) * NoH / (4 * VoH) + 1e-4;
-
-			float omegaS = 1.0 / (sampleCount * pdf + 1e-4);
-			float omegaP = 4.0 * PI / (6.0 * originalSamples);
-			float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(omegaS / omegaP);
+		vec4 s = samples[i];
+		vec3 L = T * s.x + B * s.y + N * s.z;
 
-			color += textureLod(envMap, L, mipLevel).rgb * NoL;
-			totalWeight += NoL;
-		}
+		// s.z is NoL, samples under the horizon have already been discarded
+		color += textureLod(envMap, L, s.w).rgb * s.z;
 	}
 
-	color /= totalWeight;
+	color *= invTotalWeight;
 
 	imageStore(radianceMap, cubeCoord, vec4(color, 1.0));
-}
\ No newline at end of file
+}
@@ -0,0 +1,114 @@
+layout (local_size_x = 16, local_size_y = 16) in;
+
+// Used part of the targets, they may be larger
+uniform vec2 viewportSize;
+
+#ifdef VELOCITY
+
+layout (rg16f, binding = 0) writeonly restrict uniform image2D velocity_image;
+
+layout (binding = 1) uniform sampler2D depthTexture;
+
+uniform mat4 inverseViewProj;  // Jittered, matches the depth
+uniform mat4 viewProj;         // Without jitter
+uniform mat4 previousViewProj; // Without jitter
+
+// Only the camera moves the pixels, models are static between two frames
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, ivec2(viewportSize))))
+    {
+        return;
+    }
+
+    vec2  uv    = (texel + 0.5) / viewportSize;
+    float depth = texelFetch(depthTexture, texel, 0).r;
+
+    vec4 world = inverseViewProj * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    world /= world.w;
+
+    vec4 current  = viewProj * world;
+    vec4 previous = previousViewProj * world;
+
+    // In UV units, from the previous frame to this one
+    vec2 velocity = (current.xy / current.w - previous.xy / previous.w) * 0.5;
+
+    imageStore(velocity_image, texel, vec4(velocity, 0.0, 0.0));
+}
+
+#else
+
+layout (HDR_IMAGE_FORMAT, binding = 0) writeonly restrict uniform image2D output_image;
+
+layout (binding = 1) uniform sampler2D colorTexture;
+layout (binding = 2) uniform sampler2D historyTexture;
+layout (binding = 3) uniform sampler2D velocityTexture;
+
+uniform vec2  targetSize;
+uniform float historyWeight; // 0 when the history is not valid
+
+float Luminance(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, ivec2(viewportSize))))
+    {
+        return;
+    }
+
+    vec3 current = texelFetch(colorTexture, texel, 0).rgb;
+
+    // Variance clipping on the 3x3 neighborhood, history outside of it is a disocclusion or ghosting
+    vec3 minColor = current;
+    vec3 maxColor = current;
+    vec3 moment1  = vec3(0.0);
+    vec3 moment2  = vec3(0.0);
+
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec2 neighbor = clamp(texel + ivec2(x, y), ivec2(0), ivec2(viewportSize) - 1);
+            vec3  color    = texelFetch(colorTexture, neighbor, 0).rgb;
+
+            minColor = min(minColor, color);
+            maxColor = max(maxColor, color);
+            moment1 += color;
+            moment2 += color * color;
+        }
+    }
+
+    vec3 mean  = moment1 / 9.0;
+    vec3 sigma = sqrt(max(moment2 / 9.0 - mean * mean, vec3(0.0)));
+
+    minColor = max(minColor, mean - sigma);
+    maxColor = min(maxColor, mean + sigma);
+
+    vec2 velocity   = texelFetch(velocityTexture, texel, 0).xy;
+    vec2 previousUV = (texel + 0.5) / viewportSize - velocity;
+
+    float weight = historyWeight;
+    if (any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0))))
+    {
+        weight = 0.0;
+    }
+
+    // Bilinear, kept away from the stale texels past the used part of the history
+    vec2 historyCoord = clamp(previousUV * viewportSize, vec2(0.5), viewportSize - 0.5) / targetSize;
+    vec3 history      = clamp(texture(historyTexture, historyCoord).rgb, minColor, maxColor);
+
+    // Weighted by inverse luminance, so that a single bright sample does not flicker
+    float currentWeight = (1.0 - weight) / (1.0 + Luminance(current));
+    float historyBlend  = weight / (1.0 + Luminance(history));
+
+    vec3 color = (current * currentWeight + history * historyBlend) / max(currentWeight + historyBlend, 1e-5);
+
+    imageStore(output_image, texel, vec4(color, 1.0));
+}
+
+#endif
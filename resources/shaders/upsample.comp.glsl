@@ -1,8 +1,16 @@
 layout (local_size_x = 32, local_size_y = 32) in;
 
-layout (rgba32f, binding = 0) readonly restrict uniform image2D lowResImage;
-layout (rgba32f, binding = 1) readonly restrict uniform image2D highResImage;
-layout (rgba32f, binding = 2) writeonly restrict uniform image2D outImage;
+layout (HDR_IMAGE_FORMAT, binding = 0) readonly restrict uniform image2D lowResImage;
+layout (HDR_IMAGE_FORMAT, binding = 1) readonly restrict uniform image2D highResImage;
+layout (HDR_IMAGE_FORMAT, binding = 2) writeonly restrict uniform image2D outImage;
+
+// Used part of the low resolution level, the image may be larger. Outside of it counts as black
+uniform vec2 lowResSize;
+
+vec3 LoadLowRes(ivec2 texel)
+{
+    return all(lessThan(texel, ivec2(lowResSize))) ? imageLoad(lowResImage, texel).rgb : vec3(0.0);
+}
 
 const float boxFilter[3][3] = float[][](
     float[](1 / 16.0, 2 / 16.0, 1 / 16.0),
@@ -15,10 +23,10 @@ void main()
     ivec2 inTexel = ivec2(gl_GlobalInvocationID);
     ivec2 outTexel = inTexel * 2;
 
-    vec3 c0 = imageLoad(lowResImage, inTexel + ivec2(0, 0)).rgb;
-    vec3 c1 = imageLoad(lowResImage, inTexel + ivec2(1, 0)).rgb;
-    vec3 c2 = imageLoad(lowResImage, inTexel + ivec2(0, 1)).rgb;
-    vec3 c3 = imageLoad(lowResImage, inTexel + ivec2(1, 1)).rgb;
+    vec3 c0 = LoadLowRes(inTexel + ivec2(0, 0));
+    vec3 c1 = LoadLowRes(inTexel + ivec2(1, 0));
+    vec3 c2 = LoadLowRes(inTexel + ivec2(0, 1));
+    vec3 c3 = LoadLowRes(inTexel + ivec2(1, 1));
 
     vec3 newColor0 = mix(c0, c1, 0.5);
     vec3 newColor1 = mix(c0, c2, 0.5);
@@ -12,6 +12,9 @@
 #include <assimp/postprocess.h>
 #include <assimp/pbrmaterial.h>
 
+#include <algorithm>
+#include <float.h>
+#include <math.h>
 #include <string>
 #include <filesystem>
 
@@ -102,9 +105,15 @@ inline Material* ProcessMaterial(aiMaterial* inputMaterial, const aiScene* scene
 		material->ambientOcclusionMap    = LoadTexture(TexturePath(occlusionTexture.C_Str(), path));
 	}
 
+	// Compiles in the background while the rest of the scene loads
+	material->PrepareProgram();
+
 	return material;
 }
 
+// Denser meshes cost more to rasterize on the CPU than the draws they may save
+constexpr u32 OccluderMaxTriangles = 2048;
+
 Mesh* ProcessMesh(aiMesh* inputMesh, const aiScene* scene)
 {
 	std::vector<Vertex> vertices;
@@ -117,6 +126,9 @@ Mesh* ProcessMesh(aiMesh* inputMesh, const aiScene* scene)
 	const aiVector3D* inNormals   = inputMesh->mNormals;
 	const aiVector3D* inTexcoords = inputMesh->mTextureCoords[0];
 
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+
 	for (u32 index = 0; index < inputMesh->mNumVertices; ++index)
 	{
 		const aiVector3D v = *inVertices++;
@@ -126,6 +138,9 @@ Mesh* ProcessMesh(aiMesh* inputMesh, const aiScene* scene)
 		vertex.position = {v.x, v.y, v.z};
 		vertex.normal   = {n.x, n.y, n.z};
 
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+
 		if (inTexcoords)
 		{
 			const aiVector3D t = *inTexcoords++;
@@ -147,6 +162,34 @@ Mesh* ProcessMesh(aiMesh* inputMesh, const aiScene* scene)
 
 	Mesh* mesh = new Mesh(vertices, indices);
 
+	if (!vertices.empty())
+	{
+		mesh->boundsMin    = boundsMin;
+		mesh->boundsMax    = boundsMax;
+		mesh->sphereCenter = 0.5f * (boundsMin + boundsMax);
+
+		f32 radiusSquared = 0.0f;
+		for (const Vertex& vertex : vertices)
+		{
+			const glm::vec3 offset = vertex.position - mesh->sphereCenter;
+			radiusSquared          = Max(radiusSquared, glm::dot(offset, offset));
+		}
+
+		mesh->sphereRadius = sqrtf(radiusSquared);
+	}
+
+	// Whether it is large enough to be worth it is decided by the renderer, relative to the scene
+	if (!vertices.empty() && indices.size() / 3 <= OccluderMaxTriangles)
+	{
+		mesh->occluderPositions.reserve(vertices.size());
+		for (const Vertex& vertex : vertices)
+		{
+			mesh->occluderPositions.push_back(vertex.position);
+		}
+
+		mesh->occluderIndices = indices;
+	}
+
 	return mesh;
 }
 
@@ -154,6 +197,7 @@ inline void ProcessNode(aiNode*                      node,
                         const aiScene*               scene,
                         const glm::mat4&             parentTransform,
                         const std::filesystem::path& path,
+                        std::vector<Material*>*      materials,
                         std::vector<Model>*          loadedModels)
 {
 	const auto& mat = node->mTransformation;
@@ -174,15 +218,22 @@ inline void ProcessNode(aiNode*                      node,
 		aiMesh*     inputMesh     = scene->mMeshes[node->mMeshes[index]];
 		aiMaterial* inputMaterial = scene->mMaterials[inputMesh->mMaterialIndex];
 
+		// One material per scene material, so that the render queue can batch the meshes sharing it
+		Material*& material = (*materials)[inputMesh->mMaterialIndex];
+		if (material == nullptr)
+		{
+			material = ProcessMaterial(inputMaterial, scene, path);
+		}
+
 		model.mesh           = ProcessMesh(scene->mMeshes[node->mMeshes[index]], scene);
-		model.material       = ProcessMaterial(inputMaterial, scene, path);
+		model.material       = material;
 		model.worldTransform = transform;
 		loadedModels->push_back(std::move(model));
 	}
 
 	for (u32 index = 0; index < node->mNumChildren; ++index)
 	{
-		ProcessNode(node->mChildren[index], scene, transform, path, loadedModels);
+		ProcessNode(node->mChildren[index], scene, transform, path, materials, loadedModels);
 	}
 }
 
@@ -205,9 +256,28 @@ std::vector<Model> LoadScene(const char* filename)
 	std::filesystem::path p;
 	p = filename;
 	p.remove_filename();
-	ProcessNode(scene->mRootNode, scene, glm::mat4(1.0f), p, &models);
+	std::vector<Material*> materials(scene->mNumMaterials, nullptr);
+	ProcessNode(scene->mRootNode, scene, glm::mat4(1.0f), p, &materials, &models);
+
+	FrameStats* stats = FrameStats::Get();
+
+	std::vector<u32> masks;
+	for (const Model& model : models)
+	{
+		const u32 mask = model.material->GetMask();
+		if (std::find(masks.begin(), masks.end(), mask) == masks.end())
+		{
+			masks.push_back(mask);
+		}
+	}
+
+	// Finish the variants before the first frame so that it does not fall back to the uber shader
+	Timer warmupTimer;
+	Program::FinishPendingBuilds();
 
-	FrameStats::Get()->loadScene = timer.Tick();
+	stats->programs.warmupVariants = (u32)masks.size();
+	stats->programs.warmupWait     = warmupTimer.Tick();
+	stats->loadScene               = timer.Tick();
 
 	return models;
 }
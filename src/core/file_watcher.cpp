@@ -0,0 +1,249 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <poll.h>
+#	include <sys/eventfd.h>
+#	include <sys/inotify.h>
+#	include <unistd.h>
+#endif
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+}
+
+bool FileWatcher::Start(const char* directory)
+{
+	Stop();
+
+	m_directory = directory;
+	if (!m_directory.empty() && m_directory.back() != '/')
+	{
+		m_directory += '/';
+	}
+
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(directory,
+	                            FILE_LIST_DIRECTORY,
+	                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                            nullptr,
+	                            OPEN_EXISTING,
+	                            FILE_FLAG_BACKUP_SEMANTICS,
+	                            nullptr);
+
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Could not watch directory %s\n", directory);
+		return false;
+	}
+
+	m_handle = (i64)handle;
+#elif defined(__linux__)
+	i32 fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+	{
+		fprintf(stderr, "Could not watch directory %s\n", directory);
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return false;
+	}
+
+	m_handle     = fd;
+	m_wakeHandle = eventfd(0, EFD_CLOEXEC);
+#endif
+
+	m_running = true;
+	m_thread  = std::thread([this] { Run(); });
+
+	return true;
+}
+
+void FileWatcher::Stop()
+{
+	if (!m_running.exchange(false))
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	CancelIoEx((HANDLE)m_handle, nullptr);
+#elif defined(__linux__)
+	const u64 one = 1;
+	(void)!write((i32)m_wakeHandle, &one, sizeof(one));
+#endif
+
+	m_thread.join();
+
+#if defined(_WIN32)
+	CloseHandle((HANDLE)m_handle);
+#elif defined(__linux__)
+	close((i32)m_handle);
+	close((i32)m_wakeHandle);
+#endif
+
+	m_handle     = -1;
+	m_wakeHandle = -1;
+}
+
+bool FileWatcher::Poll(std::vector<std::string>* changedFiles)
+{
+	if (!m_hasChanges.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	std::lock_guard lock(m_mutex);
+
+	for (auto& filename : m_changedFiles)
+	{
+		if (std::find(changedFiles->begin(), changedFiles->end(), filename) == changedFiles->end())
+		{
+			changedFiles->push_back(std::move(filename));
+		}
+	}
+
+	m_changedFiles.clear();
+	m_hasChanges.store(false, std::memory_order_release);
+
+	return true;
+}
+
+bool FileWatcher::IsRunning() const
+{
+	return m_running;
+}
+
+void FileWatcher::Post(const std::string& filename)
+{
+	std::lock_guard lock(m_mutex);
+
+	m_changedFiles.push_back(m_directory + filename);
+	m_hasChanges.store(true, std::memory_order_release);
+}
+
+#if defined(_WIN32)
+
+void FileWatcher::Run()
+{
+	alignas(DWORD) u8 buffer[16 * 1024];
+
+	while (m_running)
+	{
+		DWORD bytes = 0;
+		if (!ReadDirectoryChangesW((HANDLE)m_handle,
+		                           buffer,
+		                           sizeof(buffer),
+		                           FALSE,
+		                           FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+		                           &bytes,
+		                           nullptr,
+		                           nullptr))
+		{
+			// Cancelled by Stop()
+			break;
+		}
+
+		for (u8* ptr = buffer; bytes != 0;)
+		{
+			const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)ptr;
+
+			if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				char      filename[MAX_PATH];
+				const i32 length = WideCharToMultiByte(
+				    CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), filename, sizeof(filename) - 1, nullptr, nullptr);
+				filename[length] = '\0';
+
+				Post(filename);
+			}
+
+			if (info->NextEntryOffset == 0)
+			{
+				break;
+			}
+
+			ptr += info->NextEntryOffset;
+		}
+	}
+}
+
+#elif defined(__linux__)
+
+void FileWatcher::Run()
+{
+	alignas(inotify_event) char buffer[16 * 1024];
+
+	pollfd fds[2] = {
+	    {.fd = (i32)m_handle, .events = POLLIN},
+	    {.fd = (i32)m_wakeHandle, .events = POLLIN},
+	};
+
+	while (m_running)
+	{
+		if (poll(fds, 2, -1) <= 0 || (fds[1].revents & POLLIN))
+		{
+			continue;
+		}
+
+		ssize_t length;
+		while ((length = read((i32)m_handle, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* ptr = buffer; ptr < buffer + length;)
+			{
+				const inotify_event* event = (const inotify_event*)ptr;
+
+				if (event->len > 0)
+				{
+					Post(event->name);
+				}
+
+				ptr += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+}
+
+#else
+
+// No native notifications, fall back to polling the modification times from the watcher thread
+void FileWatcher::Run()
+{
+	std::unordered_map<std::string, std::filesystem::file_time_type> times;
+
+	bool firstScan = true;
+
+	while (m_running)
+	{
+		std::error_code error;
+		for (const auto& file : std::filesystem::directory_iterator(m_directory, error))
+		{
+			const std::string filename = file.path().filename().string();
+			const auto        time     = file.last_write_time(error);
+
+			auto it = times.find(filename);
+			if (it == times.end() || it->second != time)
+			{
+				times[filename] = time;
+
+				if (!firstScan)
+				{
+					Post(filename);
+				}
+			}
+		}
+
+		firstScan = false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+}
+
+#endif
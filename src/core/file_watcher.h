@@ -0,0 +1,44 @@
+#pragma once
+
+#include "defines.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches a directory (non recursively) from a background thread.
+// Changed files are queued and drained by the owner thread with Poll(), which does not touch the
+// file system and only reads an atomic flag when nothing changed.
+class FileWatcher
+{
+public:
+	~FileWatcher();
+
+	bool Start(const char* directory);
+	void Stop();
+
+	// Appends the paths (directory + filename) changed since the last call
+	bool Poll(std::vector<std::string>* changedFiles);
+
+	bool IsRunning() const;
+
+private:
+	void Run();
+	void Post(const std::string& filename);
+
+private:
+	std::string m_directory;
+	std::thread m_thread;
+
+	std::atomic<bool> m_running    = false;
+	std::atomic<bool> m_hasChanges = false;
+
+	std::mutex               m_mutex;
+	std::vector<std::string> m_changedFiles;
+
+	// Platform handles, -1 / nullptr when unused
+	i64 m_handle     = -1;
+	i64 m_wakeHandle = -1;
+};
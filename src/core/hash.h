@@ -0,0 +1,36 @@
+#pragma once
+
+#include "defines.h"
+
+#include <string_view>
+
+// 64 bits FNV-1a, usable at compile time
+constexpr u64 HashOffsetBasis = 0xcbf29ce484222325ull;
+constexpr u64 HashPrime       = 0x100000001b3ull;
+
+constexpr u64 HashBytes(const char* data, u64 size, u64 hash = HashOffsetBasis)
+{
+	for (u64 i = 0; i < size; ++i)
+	{
+		hash ^= (u8)data[i];
+		hash *= HashPrime;
+	}
+
+	return hash;
+}
+
+constexpr u64 HashString(std::string_view str, u64 hash = HashOffsetBasis)
+{
+	return HashBytes(str.data(), str.size(), hash);
+}
+
+constexpr u64 HashCombine(u64 hash, u64 value)
+{
+	for (u32 i = 0; i < 8; ++i, value >>= 8)
+	{
+		hash ^= value & 0xff;
+		hash *= HashPrime;
+	}
+
+	return hash;
+}
@@ -0,0 +1,172 @@
+#include "core/jobs.h"
+
+#include "core/utils.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Jobs
+{
+struct WorkerPool
+{
+	WorkerPool()
+	{
+		const u32 hardwareThreads = Max(std::thread::hardware_concurrency(), 1u);
+
+		for (u32 i = 1; i < hardwareThreads; ++i)
+		{
+			threads.emplace_back([this] { WorkerLoop(); });
+		}
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard lock(mutex);
+			quit = true;
+		}
+
+		condition.notify_all();
+
+		for (auto&& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	void Push(std::function<void()> task)
+	{
+		{
+			std::lock_guard lock(mutex);
+			tasks.push_back(std::move(task));
+		}
+
+		condition.notify_one();
+	}
+
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+
+			{
+				std::unique_lock lock(mutex);
+				condition.wait(lock, [this] { return quit || !tasks.empty(); });
+
+				if (quit && tasks.empty())
+				{
+					return;
+				}
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+	std::vector<std::thread>          threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex                        mutex;
+	std::condition_variable           condition;
+	bool                              quit = false;
+};
+
+static WorkerPool* GetPool()
+{
+	static WorkerPool pool;
+	return &pool;
+}
+
+u32 ThreadCount()
+{
+	return (u32)GetPool()->threads.size() + 1;
+}
+
+// Shared with the helper tasks, which may only get to run after ParallelFor returned
+struct ParallelForState
+{
+	const RangeFunc* func;
+	u32              count;
+	u32              batchSize;
+	u32              batchCount;
+
+	std::atomic<u32> nextBatch = 0;
+	std::atomic<u32> doneBatch = 0;
+
+	std::mutex              mutex;
+	std::condition_variable done;
+
+	// Returns false once there is nothing left to grab
+	bool RunBatch()
+	{
+		const u32 batch = nextBatch.fetch_add(1);
+		if (batch >= batchCount)
+		{
+			return false;
+		}
+
+		const u32 begin = batch * batchSize;
+		const u32 end   = Min(begin + batchSize, count);
+		(*func)(begin, end);
+
+		if (doneBatch.fetch_add(1) + 1 == batchCount)
+		{
+			std::lock_guard lock(mutex);
+			done.notify_all();
+		}
+
+		return true;
+	}
+};
+
+void ParallelFor(u32 count, u32 batchSize, const RangeFunc& func)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	batchSize = Max(batchSize, 1u);
+
+	const u32 batchCount = (count + batchSize - 1) / batchSize;
+
+	if (batchCount == 1)
+	{
+		func(0, count);
+		return;
+	}
+
+	auto state        = std::make_shared<ParallelForState>();
+	state->func       = &func;
+	state->count      = count;
+	state->batchSize  = batchSize;
+	state->batchCount = batchCount;
+
+	WorkerPool* pool        = GetPool();
+	const u32   helperCount = Min((u32)pool->threads.size(), batchCount - 1);
+
+	for (u32 i = 0; i < helperCount; ++i)
+	{
+		pool->Push([state] {
+			while (state->RunBatch())
+			{
+			}
+		});
+	}
+
+	while (state->RunBatch())
+	{
+	}
+
+	std::unique_lock lock(state->mutex);
+	state->done.wait(lock, [&] { return state->doneBatch.load() == batchCount; });
+}
+}
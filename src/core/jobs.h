@@ -0,0 +1,17 @@
+#pragma once
+
+#include "defines.h"
+
+#include <functional>
+
+namespace Jobs
+{
+using RangeFunc = std::function<void(u32 begin, u32 end)>;
+
+// Number of threads taking part in a ParallelFor, calling thread included
+u32 ThreadCount();
+
+// Splits [0, count) in batches of batchSize and runs them on the worker threads.
+// The calling thread helps and only returns once every batch is done.
+void ParallelFor(u32 count, u32 batchSize, const RangeFunc& func);
+}
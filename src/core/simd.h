@@ -0,0 +1,216 @@
+#pragma once
+
+#include "defines.h"
+
+// Thin wrappers over the widest float/int vectors available at compile time.
+// AVX2 works on 8 lanes, NEON on 4, and the scalar fallback on a single lane so that
+// every kernel can be written once against F32x/U32x/M32x.
+
+#if defined(__AVX2__)
+#	define SIMD_AVX2 1
+#	include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define SIMD_NEON 1
+#	include <arm_neon.h>
+#else
+#	define SIMD_SCALAR 1
+#endif
+
+#include <math.h>
+
+#if SIMD_AVX2
+
+constexpr u32 SimdWidth = 8;
+
+struct F32x
+{
+	__m256 v;
+};
+
+struct U32x
+{
+	__m256i v;
+};
+
+struct M32x
+{
+	__m256 v;
+};
+
+// clang-format off
+inline F32x SimdSet(f32 x)                  { return {_mm256_set1_ps(x)}; }
+inline F32x SimdLoad(const f32* p)          { return {_mm256_loadu_ps(p)}; }
+inline void SimdStore(f32* p, F32x x)       { _mm256_storeu_ps(p, x.v); }
+inline U32x SimdSetU(u32 x)                 { return {_mm256_set1_epi32((i32)x)}; }
+inline U32x SimdIota(u32 base)              { return {_mm256_add_epi32(_mm256_set1_epi32((i32)base), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))}; }
+inline U32x SimdLoadU(const u32* p)         { return {_mm256_loadu_si256((const __m256i*)p)}; }
+inline void SimdStoreU(u32* p, U32x x)      { _mm256_storeu_si256((__m256i*)p, x.v); }
+
+inline F32x operator+(F32x a, F32x b)       { return {_mm256_add_ps(a.v, b.v)}; }
+inline F32x operator-(F32x a, F32x b)       { return {_mm256_sub_ps(a.v, b.v)}; }
+inline F32x operator*(F32x a, F32x b)       { return {_mm256_mul_ps(a.v, b.v)}; }
+inline F32x operator/(F32x a, F32x b)       { return {_mm256_div_ps(a.v, b.v)}; }
+inline F32x SimdMin(F32x a, F32x b)         { return {_mm256_min_ps(a.v, b.v)}; }
+inline F32x SimdMax(F32x a, F32x b)         { return {_mm256_max_ps(a.v, b.v)}; }
+inline F32x SimdSqrt(F32x a)                { return {_mm256_sqrt_ps(a.v)}; }
+inline F32x SimdAbs(F32x a)                 { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+inline F32x SimdFloor(F32x a)               { return {_mm256_floor_ps(a.v)}; }
+
+inline M32x operator>(F32x a, F32x b)       { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+inline M32x operator>=(F32x a, F32x b)      { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline M32x operator<(F32x a, F32x b)       { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline M32x operator<=(F32x a, F32x b)      { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline M32x operator&(M32x a, M32x b)       { return {_mm256_and_ps(a.v, b.v)}; }
+inline M32x operator|(M32x a, M32x b)       { return {_mm256_or_ps(a.v, b.v)}; }
+inline F32x SimdSelect(M32x m, F32x a, F32x b) { return {_mm256_blendv_ps(b.v, a.v, m.v)}; }
+inline u32  SimdMoveMask(M32x m)            { return (u32)_mm256_movemask_ps(m.v); }
+
+inline U32x operator+(U32x a, U32x b)       { return {_mm256_add_epi32(a.v, b.v)}; }
+inline U32x operator&(U32x a, U32x b)       { return {_mm256_and_si256(a.v, b.v)}; }
+inline U32x operator|(U32x a, U32x b)       { return {_mm256_or_si256(a.v, b.v)}; }
+inline U32x operator<<(U32x a, i32 n)       { return {_mm256_slli_epi32(a.v, n)}; }
+inline U32x operator>>(U32x a, i32 n)       { return {_mm256_srli_epi32(a.v, n)}; }
+
+// Only valid for values < 2^31
+inline F32x SimdToF32(U32x a)               { return {_mm256_cvtepi32_ps(a.v)}; }
+// clang-format on
+
+#elif SIMD_NEON
+
+constexpr u32 SimdWidth = 4;
+
+struct F32x
+{
+	float32x4_t v;
+};
+
+struct U32x
+{
+	uint32x4_t v;
+};
+
+struct M32x
+{
+	uint32x4_t v;
+};
+
+// clang-format off
+inline F32x SimdSet(f32 x)                  { return {vdupq_n_f32(x)}; }
+inline F32x SimdLoad(const f32* p)          { return {vld1q_f32(p)}; }
+inline void SimdStore(f32* p, F32x x)       { vst1q_f32(p, x.v); }
+inline U32x SimdSetU(u32 x)                 { return {vdupq_n_u32(x)}; }
+inline U32x SimdIota(u32 base)              { const u32 iota[4] = {0, 1, 2, 3}; return {vaddq_u32(vdupq_n_u32(base), vld1q_u32(iota))}; }
+inline U32x SimdLoadU(const u32* p)         { return {vld1q_u32(p)}; }
+inline void SimdStoreU(u32* p, U32x x)      { vst1q_u32(p, x.v); }
+
+inline F32x operator+(F32x a, F32x b)       { return {vaddq_f32(a.v, b.v)}; }
+inline F32x operator-(F32x a, F32x b)       { return {vsubq_f32(a.v, b.v)}; }
+inline F32x operator*(F32x a, F32x b)       { return {vmulq_f32(a.v, b.v)}; }
+inline F32x operator/(F32x a, F32x b)       { return {vdivq_f32(a.v, b.v)}; }
+inline F32x SimdMin(F32x a, F32x b)         { return {vminq_f32(a.v, b.v)}; }
+inline F32x SimdMax(F32x a, F32x b)         { return {vmaxq_f32(a.v, b.v)}; }
+inline F32x SimdSqrt(F32x a)                { return {vsqrtq_f32(a.v)}; }
+inline F32x SimdAbs(F32x a)                 { return {vabsq_f32(a.v)}; }
+inline F32x SimdFloor(F32x a)               { return {vrndmq_f32(a.v)}; }
+
+inline M32x operator>(F32x a, F32x b)       { return {vcgtq_f32(a.v, b.v)}; }
+inline M32x operator>=(F32x a, F32x b)      { return {vcgeq_f32(a.v, b.v)}; }
+inline M32x operator<(F32x a, F32x b)       { return {vcltq_f32(a.v, b.v)}; }
+inline M32x operator<=(F32x a, F32x b)      { return {vcleq_f32(a.v, b.v)}; }
+inline M32x operator&(M32x a, M32x b)       { return {vandq_u32(a.v, b.v)}; }
+inline M32x operator|(M32x a, M32x b)       { return {vorrq_u32(a.v, b.v)}; }
+inline F32x SimdSelect(M32x m, F32x a, F32x b) { return {vbslq_f32(m.v, a.v, b.v)}; }
+inline u32  SimdMoveMask(M32x m)
+{
+	const u32 weights[4] = {1, 2, 4, 8};
+	return vaddvq_u32(vandq_u32(m.v, vld1q_u32(weights)));
+}
+
+inline U32x operator+(U32x a, U32x b)       { return {vaddq_u32(a.v, b.v)}; }
+inline U32x operator&(U32x a, U32x b)       { return {vandq_u32(a.v, b.v)}; }
+inline U32x operator|(U32x a, U32x b)       { return {vorrq_u32(a.v, b.v)}; }
+inline U32x operator<<(U32x a, i32 n)       { return {vshlq_u32(a.v, vdupq_n_s32(n))}; }
+inline U32x operator>>(U32x a, i32 n)       { return {vshlq_u32(a.v, vdupq_n_s32(-n))}; }
+
+inline F32x SimdToF32(U32x a)               { return {vcvtq_f32_u32(a.v)}; }
+// clang-format on
+
+#else
+
+constexpr u32 SimdWidth = 1;
+
+struct F32x
+{
+	f32 v;
+};
+
+struct U32x
+{
+	u32 v;
+};
+
+struct M32x
+{
+	bool v;
+};
+
+// clang-format off
+inline F32x SimdSet(f32 x)                  { return {x}; }
+inline F32x SimdLoad(const f32* p)          { return {*p}; }
+inline void SimdStore(f32* p, F32x x)       { *p = x.v; }
+inline U32x SimdSetU(u32 x)                 { return {x}; }
+inline U32x SimdIota(u32 base)              { return {base}; }
+inline U32x SimdLoadU(const u32* p)         { return {*p}; }
+inline void SimdStoreU(u32* p, U32x x)      { *p = x.v; }
+
+inline F32x operator+(F32x a, F32x b)       { return {a.v + b.v}; }
+inline F32x operator-(F32x a, F32x b)       { return {a.v - b.v}; }
+inline F32x operator*(F32x a, F32x b)       { return {a.v * b.v}; }
+inline F32x operator/(F32x a, F32x b)       { return {a.v / b.v}; }
+inline F32x SimdMin(F32x a, F32x b)         { return {a.v < b.v ? a.v : b.v}; }
+inline F32x SimdMax(F32x a, F32x b)         { return {a.v > b.v ? a.v : b.v}; }
+inline F32x SimdSqrt(F32x a)                { return {sqrtf(a.v)}; }
+inline F32x SimdAbs(F32x a)                 { return {fabsf(a.v)}; }
+inline F32x SimdFloor(F32x a)               { return {floorf(a.v)}; }
+
+inline M32x operator>(F32x a, F32x b)       { return {a.v > b.v}; }
+inline M32x operator>=(F32x a, F32x b)      { return {a.v >= b.v}; }
+inline M32x operator<(F32x a, F32x b)       { return {a.v < b.v}; }
+inline M32x operator<=(F32x a, F32x b)      { return {a.v <= b.v}; }
+inline M32x operator&(M32x a, M32x b)       { return {a.v && b.v}; }
+inline M32x operator|(M32x a, M32x b)       { return {a.v || b.v}; }
+inline F32x SimdSelect(M32x m, F32x a, F32x b) { return {m.v ? a.v : b.v}; }
+inline u32  SimdMoveMask(M32x m)            { return m.v ? 1u : 0u; }
+
+inline U32x operator+(U32x a, U32x b)       { return {a.v + b.v}; }
+inline U32x operator&(U32x a, U32x b)       { return {a.v & b.v}; }
+inline U32x operator|(U32x a, U32x b)       { return {a.v | b.v}; }
+inline U32x operator<<(U32x a, i32 n)       { return {a.v << n}; }
+inline U32x operator>>(U32x a, i32 n)       { return {a.v >> n}; }
+
+inline F32x SimdToF32(U32x a)               { return {(f32)a.v}; }
+// clang-format on
+
+#endif
+
+inline F32x SimdSaturate(F32x x)
+{
+	return SimdMin(SimdMax(x, SimdSet(0.0f)), SimdSet(1.0f));
+}
+
+// SimdWidth Hammersley points starting at index base, see Hammersley() in core/utils.h
+inline void SimdHammersley(u32 base, f32 invN, F32x* x, F32x* y)
+{
+	U32x bits = SimdIota(base);
+
+	*x = SimdToF32(bits) * SimdSet(invN);
+
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & SimdSetU(0x55555555u)) << 1) | ((bits >> 1) & SimdSetU(0x55555555u));
+	bits = ((bits & SimdSetU(0x33333333u)) << 2) | ((bits >> 2) & SimdSetU(0x33333333u));
+	bits = ((bits & SimdSetU(0x0F0F0F0Fu)) << 4) | ((bits >> 4) & SimdSetU(0x0F0F0F0Fu));
+	bits = ((bits & SimdSetU(0x00FF00FFu)) << 8) | ((bits >> 8) & SimdSetU(0x00FF00FFu));
+
+	// Drop the lowest bit so that the integer to float conversion stays in the signed range
+	*y = SimdToF32(bits >> 1) * SimdSet(1.0f / 0x80000000U);
+}
@@ -32,6 +32,7 @@
 #include <filesystem>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 static void MouseButtonCallback(GLFWwindow* window, i32 button, i32 action, i32 mods);
 static void MouseMoveCallback(GLFWwindow* window, f64 x, f64 y);
@@ -42,6 +43,9 @@ static void FramebufferSizeCallback(GLFWwindow* window, i32 width, i32 height);
 
 static void DropCallback(GLFWwindow* window, i32 count, const char** paths);
 
+static void OpenScene(const char* filename);
+static void PickEntity(f64 x, f64 y, const glm::mat4& proj);
+
 void DebugOutput(GLenum source, GLenum type, u32 id, GLenum severity, GLsizei length, const char* message, const void* userParam);
 
 static i32 g_width, g_height;
@@ -92,7 +96,12 @@ void RenderUI(const std::vector<Model>& models);
 [[clang::no_destroy]] global_variable f32 g_viewportX = 0.0f, g_viewportY = 0.0f;
 [[clang::no_destroy]] global_variable f32 g_viewportW = 0.0f, g_viewportH = 0.0f;
 [[clang::no_destroy]] global_variable std::vector<Model> g_models = {};
-[[clang::no_destroy]] global_variable Environment* g_env;
+[[clang::no_destroy]] global_variable EnvironmentLibrary* g_environments;
+[[clang::no_destroy]] global_variable Renderer*           g_renderer;
+
+global_variable i32  g_selectedEntity = -1;
+global_variable bool g_pickRequested  = false;
+global_variable f64  g_pickX = 0.0, g_pickY = 0.0;
 
 i32 main()
 {
@@ -138,11 +147,16 @@ i32 main()
 
 	Renderer renderer;
 	renderer.Initialize(glm::vec2(g_width, g_height));
-	g_env = renderer.GetEnvironment();
+	g_environments = renderer.GetEnvironmentLibrary();
+
+	g_environments->AddDirectory("resources/env");
 
-	LoadEnvironment("resources/env/Frozen_Waterfall_Ref.hdr", g_env);
+	const i32 defaultEnvironment = g_environments->Find("Frozen_Waterfall_Ref");
+	g_environments->Select(defaultEnvironment >= 0 ? defaultEnvironment : 0);
 
-	g_models = LoadScene(R"(external\glTF-Sample-Models\2.0\DamagedHelmet\glTF\DamagedHelmet.gltf)");
+	g_renderer = &renderer;
+
+	OpenScene(R"(external\glTF-Sample-Models\2.0\DamagedHelmet\glTF\DamagedHelmet.gltf)");
 	// LoadScene(R"(external\glTF-Sample-Models\2.0\MetalRoughSpheres\glTF\MetalRoughSpheres.gltf)");
 
 	ImGui::FileBrowser textureDialog;
@@ -163,6 +177,12 @@ i32 main()
 			    .position = g_camera.position,
 			};
 			renderer.Render(cameraInfos, g_models);
+
+			if (g_pickRequested)
+			{
+				PickEntity(g_pickX, g_pickY, cameraProj);
+				g_pickRequested = false;
+			}
 		}
 
 		ImGuiIO& io = ImGui::GetIO();
@@ -260,23 +280,23 @@ i32 main()
 				{
 					default:
 						id = (void*)(intptr_t)renderer.outputTexture;
-						ImGui::Image(id, ImVec2(size.x, size.y), ImVec2(0, 1), ImVec2(1, 0));
+						// Only the bottom left corner of the output holds the image
+						const glm::vec2 uvScale = renderer.GetOutputUVScale();
+						ImGui::Image(id, ImVec2(size.x, size.y), ImVec2(0, uvScale.y), ImVec2(uvScale.x, 0));
 				}
 				// ImTextureID
 			}
 			ImGui::End();
 
-			static i32 selectedEntity = -1;
-
 			ImGui::Begin("Entities");
 			{
 				for (i32 i = 0; i < g_models.size(); ++i)
 				{
 					char buf[32];
 					sprintf(buf, "Entity #%d", i);
-					if (ImGui::Selectable(buf, selectedEntity == i))
+					if (ImGui::Selectable(buf, g_selectedEntity == i))
 					{
-						selectedEntity = i;
+						g_selectedEntity = i;
 					}
 				}
 			}
@@ -284,6 +304,25 @@ i32 main()
 
 			ImGui::Begin("Light");
 			{
+				const i32 currentEnvironment = g_environments->GetCurrentIndex();
+				if (ImGui::BeginCombo("Environment", currentEnvironment >= 0 ? g_environments->GetName(currentEnvironment) : "None"))
+				{
+					for (i32 i = 0; i < g_environments->GetCount(); ++i)
+					{
+						char buf[256];
+						sprintf(buf, "%s%s", g_environments->GetName(i), g_environments->IsBaked(i) ? " *" : "");
+						if (ImGui::Selectable(buf, currentEnvironment == i))
+						{
+							g_environments->Select(i);
+						}
+					}
+					ImGui::EndCombo();
+				}
+
+				ImGui::Text("Baked environments: %.0lf / %.0lf MB",
+				            g_environments->GetMemoryUsage() / (1024.0 * 1024.0),
+				            g_environments->memoryBudget / (1024.0 * 1024.0));
+
 				ImGui::Text("Background");
 				ImGui::RadioButton("None", &renderer.backgroundType, BackgroundType_None);
 				ImGui::RadioButton("Cubemap", &renderer.backgroundType, BackgroundType_Cubemap);
@@ -294,16 +333,117 @@ i32 main()
 				{
 					ImGui::SliderInt("Mip level", &renderer.backgroundMipLevel, 0, 8);
 				}
+
+				ImGui::Separator();
+
+				ImGui::Text("Directional light");
+				ImGui::DragFloat3("Direction", &renderer.lightDirection.x, 0.01f, -1.0f, 1.0f);
+				ImGui::ColorEdit3("Color", &renderer.lightColor.x);
+				ImGui::DragFloat("Intensity", &renderer.lightIntensity, 0.1f, 0.0f, 100.0f);
+				ImGui::Checkbox("Shadows", &renderer.shadows);
+
+				ImGui::Separator();
+
+				ImGui::Text("Punctual lights: %d", (i32)renderer.lights.size());
+				if (ImGui::Button("Add point light"))
+				{
+					renderer.lights.push_back(Light());
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Add spot light"))
+				{
+					Light light;
+					light.isSpot = true;
+					renderer.lights.push_back(light);
+				}
+
+				// Scatters lights over the scene bounds, handy to stress the light clustering
+				if (ImGui::Button("Scatter 256 lights"))
+				{
+					glm::vec3 sceneMin, sceneMax;
+					renderer.GetSceneBounds(&sceneMin, &sceneMax);
+
+					const f32 range = 0.1f * glm::length(sceneMax - sceneMin);
+
+					for (i32 i = 0; i < 256; ++i)
+					{
+						const glm::vec3 t(rand() / (f32)RAND_MAX, rand() / (f32)RAND_MAX, rand() / (f32)RAND_MAX);
+						const glm::vec3 c(rand() / (f32)RAND_MAX, rand() / (f32)RAND_MAX, rand() / (f32)RAND_MAX);
+
+						Light light;
+						light.position = sceneMin + t * (sceneMax - sceneMin);
+						light.color    = glm::normalize(c + glm::vec3(0.1f));
+						light.range    = range > 0.0f ? range : 10.0f;
+						renderer.lights.push_back(light);
+					}
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Clear lights"))
+				{
+					renderer.lights.clear();
+				}
+
+				for (i32 i = 0; i < (i32)renderer.lights.size(); ++i)
+				{
+					Light& light = renderer.lights[i];
+
+					ImGui::PushID(i);
+					char label[64];
+					sprintf(label, "%s light %d", light.isSpot ? "Spot" : "Point", i);
+					if (ImGui::TreeNode(label))
+					{
+						ImGui::DragFloat3("Position", &light.position.x, 0.1f);
+						ImGui::ColorEdit3("Color", &light.color.x);
+						ImGui::DragFloat("Intensity", &light.intensity, 1.0f, 0.0f, 10000.0f);
+						ImGui::DragFloat("Range", &light.range, 0.1f, 0.01f, 1000.0f);
+						if (light.isSpot)
+						{
+							ImGui::DragFloat3("Direction", &light.direction.x, 0.01f, -1.0f, 1.0f);
+							ImGui::SliderAngle("Inner angle", &light.innerAngle, 0.0f, 89.0f);
+							ImGui::SliderAngle("Outer angle", &light.outerAngle, 0.0f, 89.0f);
+						}
+						const bool remove = ImGui::Button("Remove");
+						ImGui::TreePop();
+
+						if (remove)
+						{
+							renderer.lights.erase(renderer.lights.begin() + i);
+							--i;
+						}
+					}
+					ImGui::PopID();
+				}
 			}
 			ImGui::End();
 
 			ImGui::Begin("Post-Process");
 			{
-				ImGui::Text("A post-process effect");
+				ImGui::Text("Scene color");
+				ImGui::RadioButton("R11G11B10F", &renderer.hdrFormat, HDRFormat_R11G11B10F);
+				ImGui::SameLine();
+				ImGui::RadioButton("RGBA16F", &renderer.hdrFormat, HDRFormat_RGBA16F);
+				ImGui::SameLine();
+				ImGui::RadioButton("RGBA32F", &renderer.hdrFormat, HDRFormat_RGBA32F);
+
+				ImGui::Checkbox("TAA", &renderer.taa);
+
+				ImGui::Text("MSAA samples%s", renderer.taa ? " (off with TAA)" : "");
+				for (i32 samples = 1; samples <= 8; samples *= 2)
+				{
+					char label[8];
+					snprintf(label, sizeof(label), "%dx", samples);
+
+					if (samples > 1)
+					{
+						ImGui::SameLine();
+					}
+					ImGui::RadioButton(label, &renderer.msaaSamples, samples);
+				}
 
 				ImGui::Separator();
 
 				ImGui::Text("Bloom parameters");
+				ImGui::Checkbox("Bloom", &renderer.bloom);
 				ImGui::DragFloat("Highpass Threshold", &renderer.bloomThreshold, 1.0f, 0.0f, 10.0f, "%.0f");
 				ImGui::SliderInt("Blur radius", &renderer.bloomWidth, 1, 6);
 				ImGui::DragFloat("Bloom amount", &renderer.bloomAmount, 0.1f, 0.0f, 3.0f, "%.1f");
@@ -315,13 +455,37 @@ i32 main()
 			ImGui::End();
 
 			ImGui::Begin("Properties");
+			if (ImGui::CollapsingHeader("Transform", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				if (g_selectedEntity >= 0 && g_selectedEntity < g_models.size())
+				{
+					glm::vec4& translation = g_models[g_selectedEntity].worldTransform[3];
+					if (ImGui::DragFloat3("Translation", &translation.x, 0.01f))
+					{
+						g_renderer->OnTransformsChanged(g_models);
+					}
+				}
+			}
+
 			if (ImGui::CollapsingHeader("Material", ImGuiTreeNodeFlags_DefaultOpen))
 			{
-				if (selectedEntity >= 0 && selectedEntity < g_models.size())
+				if (g_selectedEntity >= 0 && g_selectedEntity < g_models.size())
 				{
-					Model*    model    = &g_models[selectedEntity];
+					Model*    model    = &g_models[g_selectedEntity];
 					Material* material = model->material;
 
+					// Models of a scene share the materials of the file, see ProcessNode()
+					u32 users = 0;
+					for (const Model& other : g_models)
+					{
+						users += other.material == material ? 1 : 0;
+					}
+
+					if (users > 1)
+					{
+						ImGui::TextDisabled("Shared by %u models, edits apply to all of them", users);
+					}
+
 					ImGui::Checkbox("Albedo", &material->hasAlbedo);
 					if (material->hasAlbedo)
 					{
@@ -441,8 +605,15 @@ i32 main()
 				ImGui::Text("\t\tGenerate cubemap: %.1lfms", stats->ibl.cubemap);
 				ImGui::Text("\t\tPrefilter specular: %.1lfms", stats->ibl.prefilter);
 				ImGui::Text("\t\tIrradiance convolution: %.1lfms", stats->ibl.irradiance);
+				ImGui::Text("\t\tLast switch: %.1lfms", stats->ibl.switchEnvironment);
 				ImGui::Text("\tScene");
 				ImGui::Text("\t\tLoad time: %.1lfms", stats->loadScene);
+				ImGui::Text("\t\tBVH: %u nodes, build: %.1lfms, last refit: %.3lfms", stats->bvh.nodes, stats->bvh.build, stats->bvh.refit);
+				ImGui::Text("\tPrograms");
+				ImGui::Text("\t\tBuild time: %.1lfms", stats->programs.buildTime);
+				ImGui::Text("\t\tBinary cache: %u hits, %u misses", stats->programs.cacheHits, stats->programs.cacheMisses);
+				ImGui::Text("\t\tScene variants: %u, warm-up wait: %.1lfms", stats->programs.warmupVariants, stats->programs.warmupWait);
+				ImGui::Text("\t\tCompiling: %u", Program::GetPendingBuildCount());
 
 				ImGui::Separator();
 
@@ -452,11 +623,17 @@ i32 main()
 
 				ImGui::Text("\tGeneral");
 				ImGui::Text("\t\tUpdate programs: %.3lfms", stats->frame.updatePrograms);
+				ImGui::Text("\t\tFrustum culling: %.3lfms", stats->frame.culling);
+				ImGui::Text("\t\tSoftware occlusion: %.3lfms", stats->frame.softwareOcclusion);
 				ImGui::Text("\tRendering");
+				ImGui::Text("\t\tShadows: %.3lfms (%u cascades, %u draws)", stats->frame.shadows, stats->frame.shadowCascades, stats->frame.shadowDraws);
+				ImGui::Text("\t\tLight culling: %.3lfms (%u lights)", stats->frame.lightCulling, stats->frame.lights);
 				ImGui::Text("\t\tzPrepass: %.3lfms", stats->frame.zPrepass);
 				ImGui::Text("\t\tRender models: %.3lfms", stats->frame.renderModels);
+				ImGui::Text("\t\tDepth pyramid: %.3lfms", stats->frame.depthPyramid);
 				ImGui::Text("\t\tRender envmap: %.3lfms", stats->frame.background);
 				ImGui::Text("\t\tResolve MSAA: %.3lfms", stats->frame.resolveMSAA);
+				ImGui::Text("\t\tTAA: %.3lfms", stats->frame.taa);
 				ImGui::Text("\tPost-Process");
 				ImGui::Text("\t\tLuminance + bloom threshold: %.3lfms", stats->frame.highpassAndLuminance);
 				ImGui::Text("\t\tBloom total: %.3lfms", stats->frame.bloomTotal);
@@ -471,7 +648,40 @@ i32 main()
 				ImGui::Separator();
 
 				ImGui::Text("Render stats");
+				ImGui::Checkbox("GPU-driven rendering", &renderer.gpuDriven);
+				ImGui::Checkbox("Occlusion culling", &renderer.occlusionCulling);
+				ImGui::Checkbox("Software occlusion culling", &renderer.softwareOcclusion);
+				ImGui::Checkbox("Depth pre-pass", &renderer.depthPrepass);
 				ImGui::Text("Drawing %d models", (i32)g_models.size());
+				if (renderer.IsGPUDriven())
+				{
+					ImGui::Text("Culled on the GPU, %u multi-draws", stats->frame.drawCalls);
+					ImGui::Text("Visible: %u, frustum culled: %u, occluded: %u",
+					            stats->frame.visibleModels,
+					            stats->frame.culledModels - stats->frame.occludedModels,
+					            stats->frame.occludedModels);
+					ImGui::Text("Early pass: %u, late pass: %u", stats->frame.earlyDraws, stats->frame.lateDraws);
+				}
+				else
+				{
+					ImGui::Text("Visible: %u, culled: %u (%u occluded)", stats->frame.visibleModels, stats->frame.culledModels, stats->frame.occludedModels);
+					ImGui::Text("Occluders: %u, %u triangles", stats->frame.occluders, stats->frame.occluderTriangles);
+					ImGui::Text("Draw calls: %u", stats->frame.drawCalls);
+				}
+				ImGui::Text("State changes: %u programs, %u materials, %u meshes",
+				            stats->frame.programChanges,
+				            stats->frame.materialChanges,
+				            stats->frame.meshChanges);
+				ImGui::Text("GL state calls: %u issued, %u elided", stats->frame.glCallsIssued, stats->frame.glCallsElided);
+				ImGui::Text("Render targets: %u textures, %.1lf MB, %u allocations",
+				            stats->renderTargets.textures,
+				            stats->renderTargets.memory,
+				            stats->renderTargets.allocations);
+				ImGui::Text("Frame graph: %u passes, %u culled, %u barriers",
+				            stats->frameGraph.passes,
+				            stats->frameGraph.culledPasses,
+				            stats->frameGraph.barriers);
+				ImGui::Text("Transients: %u in %u textures", stats->frameGraph.transients, stats->frameGraph.transientTextures);
 				i64 vertexTotal   = 0;
 				i64 triangleTotal = 0;
 				for (i32 i = 0; i < g_models.size(); ++i)
@@ -514,12 +724,16 @@ i32 main()
 		glfwPollEvents();
 	}
 
+	// Joins the background decodes and frees the GPU resources while the context is alive
+	renderer.Shutdown();
+
 	glfwTerminate();
 
 	return 0;
 }
 
 f64  lastX, lastY;
+f64  pressX, pressY;
 bool movingCamera = false;
 
 inline bool inViewport(f64 x, f64 y)
@@ -539,10 +753,23 @@ static void MouseButtonCallback(GLFWwindow* window, i32 button, i32 action, i32
 			movingCamera = true;
 			lastX        = x;
 			lastY        = y;
+			pressX       = x;
+			pressY       = y;
 		}
 	}
 	else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE)
 	{
+		f64 x, y;
+		glfwGetCursorPos(window, &x, &y);
+
+		// A click that did not rotate the camera selects what is under the cursor
+		if (movingCamera && fabs(x - pressX) + fabs(y - pressY) < 3.0)
+		{
+			g_pickRequested = true;
+			g_pickX         = x;
+			g_pickY         = y;
+		}
+
 		movingCamera = false;
 	}
 }
@@ -632,6 +859,28 @@ void SetupUI(GLFWwindow* window)
 	ImGui_ImplOpenGL3_Init("#version 450");
 }
 
+static void OpenScene(const char* filename)
+{
+	g_models         = LoadScene(filename);
+	g_selectedEntity = -1;
+	g_renderer->OnSceneLoaded(g_models);
+}
+
+static void PickEntity(f64 x, f64 y, const glm::mat4& proj)
+{
+	const glm::vec2 ndc = {2.0f * (f32)(x - g_viewportX) / g_viewportW - 1.0f, 1.0f - 2.0f * (f32)(y - g_viewportY) / g_viewportH};
+
+	const glm::mat4 invViewProj = glm::inverse(proj * g_camera.GetView());
+
+	const glm::vec4 nearPoint = invViewProj * glm::vec4(ndc, -1.0f, 1.0f);
+	const glm::vec4 farPoint  = invViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+
+	const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	const glm::vec3 target = glm::vec3(farPoint) / farPoint.w;
+
+	g_selectedEntity = g_renderer->Pick(origin, glm::normalize(target - origin));
+}
+
 static void DropCallback(GLFWwindow* window, i32 count, const char** paths)
 {
 	for (i32 i = 0; i < count; ++i)
@@ -639,11 +888,11 @@ static void DropCallback(GLFWwindow* window, i32 count, const char** paths)
 		std::string ext = GetFileExtension(paths[i]);
 		if (ext == "hdr")
 		{
-			LoadEnvironment(paths[i], g_env);
+			g_environments->Select(g_environments->Add(paths[i]));
 		}
 		else
 		{
-			g_models = LoadScene(paths[i]);
+			OpenScene(paths[i]);
 		}
 	}
 }
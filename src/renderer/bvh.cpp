@@ -0,0 +1,479 @@
+#include "bvh.h"
+
+#include "core/jobs.h"
+#include "core/utils.h"
+
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <utility>
+
+constexpr u32 BVHBinCount      = 16;
+constexpr u32 BVHMaxLeafSize   = 4;
+constexpr f32 BVHTraversalCost = 1.0f; // Relative to a primitive test
+
+// Below that, subtrees are not worth a job of their own
+constexpr u32 BVHMinSubtreeSize = 512;
+
+struct BVHBin
+{
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+	u32       count     = 0;
+};
+
+inline f32 HalfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	const glm::vec3 e = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// Entry distance of the ray in the box, FLT_MAX when it misses or the box is further than maxDistance
+inline f32 IntersectBox(const glm::vec3& origin, const glm::vec3& invDirection, f32 maxDistance, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	const glm::vec3 t0 = (boundsMin - origin) * invDirection;
+	const glm::vec3 t1 = (boundsMax - origin) * invDirection;
+
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar  = glm::max(t0, t1);
+
+	const f32 entry = Max(Max(tNear.x, tNear.y), Max(tNear.z, 0.0f));
+	const f32 exit  = Min(Min(tFar.x, tFar.y), Min(tFar.z, maxDistance));
+
+	return entry <= exit ? entry : FLT_MAX;
+}
+
+enum PlaneTest
+{
+	PlaneTest_Outside,
+	PlaneTest_Intersect,
+	PlaneTest_Inside,
+};
+
+inline PlaneTest TestPlane(const glm::vec4& plane, const glm::vec3& center, const glm::vec3& extent)
+{
+	const f32 distance = glm::dot(glm::vec3(plane), center) + plane.w;
+	const f32 radius   = glm::dot(glm::abs(glm::vec3(plane)), extent);
+
+	if (distance + radius < 0.0f)
+		return PlaneTest_Outside;
+	if (distance - radius >= 0.0f)
+		return PlaneTest_Inside;
+	return PlaneTest_Intersect;
+}
+
+void BVH::CopyPrimitives(const SceneBounds& bounds)
+{
+	const u32 count = bounds.GetCount();
+
+	m_boundsMin.resize(count);
+	m_boundsMax.resize(count);
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		const glm::vec3 center = bounds.GetCenter(i);
+		const glm::vec3 extent = bounds.GetExtent(i);
+
+		m_boundsMin[i] = center - extent;
+		m_boundsMax[i] = center + extent;
+	}
+}
+
+BVHNode BVH::MakeNode(u32 first, u32 count) const
+{
+	BVHNode node = {
+	    .boundsMin   = glm::vec3(FLT_MAX),
+	    .leftOrFirst = first,
+	    .boundsMax   = glm::vec3(-FLT_MAX),
+	    .count       = count,
+	};
+
+	for (u32 i = first; i < first + count; ++i)
+	{
+		node.boundsMin = glm::min(node.boundsMin, m_boundsMin[m_indices[i]]);
+		node.boundsMax = glm::max(node.boundsMax, m_boundsMax[m_indices[i]]);
+	}
+
+	return node;
+}
+
+void BVH::Build(const SceneBounds& bounds)
+{
+	CopyPrimitives(bounds);
+
+	const u32 count = bounds.GetCount();
+
+	m_nodes.clear();
+	m_indices.resize(count);
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		m_indices[i] = i;
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	m_nodes.push_back(MakeNode(0, count));
+
+	// Split the top of the tree until there is enough subtrees to keep every thread busy
+	const u32        subtreeSize = Max(count / (Jobs::ThreadCount() * 4), BVHMinSubtreeSize);
+	std::vector<u32> deferred;
+
+	BuildNodes(&m_nodes, 0, subtreeSize, &deferred);
+
+	// Subtrees cover disjoint index ranges, each one gets its own node array
+	std::vector<std::vector<BVHNode>> subtrees(deferred.size());
+
+	Jobs::ParallelFor((u32)deferred.size(), 1, [&](u32 begin, u32 end) {
+		for (u32 i = begin; i < end; ++i)
+		{
+			subtrees[i].push_back(m_nodes[deferred[i]]);
+			BuildNodes(&subtrees[i], 0, 0, nullptr);
+		}
+	});
+
+	// The subtree roots replace the deferred nodes, the rest is appended
+	for (u32 i = 0; i < deferred.size(); ++i)
+	{
+		const std::vector<BVHNode>& nodes = subtrees[i];
+		const u32                   base  = (u32)m_nodes.size() - 1;
+
+		for (u32 j = 0; j < nodes.size(); ++j)
+		{
+			BVHNode node = nodes[j];
+			if (node.count == 0)
+			{
+				node.leftOrFirst += base;
+			}
+
+			if (j == 0)
+			{
+				m_nodes[deferred[i]] = node;
+			}
+			else
+			{
+				m_nodes.push_back(node);
+			}
+		}
+	}
+}
+
+// Splits nodes[root] and its children until they become leaves, or until they hold less than
+// subtreeSize primitives if deferred is given
+void BVH::BuildNodes(std::vector<BVHNode>* nodes, u32 root, u32 subtreeSize, std::vector<u32>* deferred)
+{
+	std::vector<u32> stack = {root};
+
+	while (!stack.empty())
+	{
+		const u32     index = stack.back();
+		const BVHNode node  = (*nodes)[index];
+		stack.pop_back();
+
+		if (deferred != nullptr && node.count <= subtreeSize)
+		{
+			deferred->push_back(index);
+			continue;
+		}
+
+		u32 mid;
+		if (!Split(node, &mid))
+		{
+			continue;
+		}
+
+		const u32 left = (u32)nodes->size();
+
+		nodes->push_back(MakeNode(node.leftOrFirst, mid - node.leftOrFirst));
+		nodes->push_back(MakeNode(mid, node.leftOrFirst + node.count - mid));
+
+		(*nodes)[index].leftOrFirst = left;
+		(*nodes)[index].count       = 0;
+
+		stack.push_back(left);
+		stack.push_back(left + 1);
+	}
+}
+
+// Partitions the node primitives along the cheapest binned SAH split.
+// Returns false when keeping a leaf is cheaper.
+bool BVH::Split(const BVHNode& node, u32* mid)
+{
+	if (node.count <= BVHMaxLeafSize)
+	{
+		return false;
+	}
+
+	const u32 first = node.leftOrFirst;
+	const u32 last  = node.leftOrFirst + node.count;
+
+	glm::vec3 centroidMin = glm::vec3(FLT_MAX);
+	glm::vec3 centroidMax = glm::vec3(-FLT_MAX);
+
+	for (u32 i = first; i < last; ++i)
+	{
+		const glm::vec3 centroid = m_boundsMin[m_indices[i]] + m_boundsMax[m_indices[i]];
+		centroidMin              = glm::min(centroidMin, centroid);
+		centroidMax              = glm::max(centroidMax, centroid);
+	}
+
+	f32 bestCost  = (f32)node.count;
+	i32 bestAxis  = -1;
+	u32 bestSplit = 0;
+
+	for (i32 axis = 0; axis < 3; ++axis)
+	{
+		const f32 extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		const f32 scale = BVHBinCount / extent;
+
+		BVHBin bins[BVHBinCount];
+		for (u32 i = first; i < last; ++i)
+		{
+			const u32 primitive = m_indices[i];
+			const f32 centroid  = m_boundsMin[primitive][axis] + m_boundsMax[primitive][axis];
+			const u32 bin       = Min((u32)((centroid - centroidMin[axis]) * scale), BVHBinCount - 1);
+
+			bins[bin].boundsMin = glm::min(bins[bin].boundsMin, m_boundsMin[primitive]);
+			bins[bin].boundsMax = glm::max(bins[bin].boundsMax, m_boundsMax[primitive]);
+			bins[bin].count++;
+		}
+
+		// Sweep from the right to get the cost of every right side, then from the left
+		f32 rightCosts[BVHBinCount];
+		{
+			BVHBin right;
+			for (u32 bin = BVHBinCount - 1; bin > 0; --bin)
+			{
+				right.boundsMin = glm::min(right.boundsMin, bins[bin].boundsMin);
+				right.boundsMax = glm::max(right.boundsMax, bins[bin].boundsMax);
+				right.count += bins[bin].count;
+
+				rightCosts[bin] = right.count > 0 ? right.count * HalfArea(right.boundsMin, right.boundsMax) : 0.0f;
+			}
+		}
+
+		BVHBin left;
+		for (u32 split = 1; split < BVHBinCount; ++split)
+		{
+			left.boundsMin = glm::min(left.boundsMin, bins[split - 1].boundsMin);
+			left.boundsMax = glm::max(left.boundsMax, bins[split - 1].boundsMax);
+			left.count += bins[split - 1].count;
+
+			if (left.count == 0 || left.count == node.count)
+			{
+				continue;
+			}
+
+			const f32 leftCost = left.count * HalfArea(left.boundsMin, left.boundsMax);
+			const f32 cost     = BVHTraversalCost + (leftCost + rightCosts[split]) / HalfArea(node.boundsMin, node.boundsMax);
+
+			if (cost < bestCost)
+			{
+				bestCost  = cost;
+				bestAxis  = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+	{
+		return false;
+	}
+
+	const f32 scale = BVHBinCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+
+	u32* middle = std::partition(&m_indices[first], &m_indices[first] + node.count, [&](u32 primitive) {
+		const f32 centroid = m_boundsMin[primitive][bestAxis] + m_boundsMax[primitive][bestAxis];
+		return Min((u32)((centroid - centroidMin[bestAxis]) * scale), BVHBinCount - 1) < bestSplit;
+	});
+
+	*mid = (u32)(middle - m_indices.data());
+	return true;
+}
+
+void BVH::Refit(const SceneBounds& bounds)
+{
+	CopyPrimitives(bounds);
+
+	// Children are always stored after their parent
+	for (u32 i = (u32)m_nodes.size(); i-- > 0;)
+	{
+		BVHNode& node = m_nodes[i];
+
+		if (node.count > 0)
+		{
+			node = MakeNode(node.leftOrFirst, node.count);
+		}
+		else
+		{
+			const BVHNode& left  = m_nodes[node.leftOrFirst];
+			const BVHNode& right = m_nodes[node.leftOrFirst + 1];
+
+			node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+			node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+		}
+	}
+}
+
+void BVH::Cull(const Frustum& frustum, std::vector<u8>* visibility) const
+{
+	visibility->assign(m_indices.size(), 0);
+
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	// Planes the node is not known to be inside of, children inherit it
+	struct Entry
+	{
+		u32 node;
+		u32 planeMask;
+	};
+
+	constexpr u32 AllPlanes = (1u << 6) - 1;
+
+	std::vector<Entry> stack;
+	stack.reserve(64);
+	stack.push_back({0, AllPlanes});
+
+	while (!stack.empty())
+	{
+		const Entry    entry = stack.back();
+		const BVHNode& node  = m_nodes[entry.node];
+		stack.pop_back();
+
+		u32 planeMask = entry.planeMask;
+
+		if (planeMask != 0)
+		{
+			const glm::vec3 center = 0.5f * (node.boundsMin + node.boundsMax);
+			const glm::vec3 extent = 0.5f * (node.boundsMax - node.boundsMin);
+
+			bool outside = false;
+			for (u32 p = 0; p < 6 && !outside; ++p)
+			{
+				if (planeMask & (1u << p))
+				{
+					const PlaneTest test = TestPlane(frustum.planes[p], center, extent);
+
+					outside = test == PlaneTest_Outside;
+					if (test == PlaneTest_Inside)
+					{
+						planeMask &= ~(1u << p);
+					}
+				}
+			}
+
+			if (outside)
+			{
+				continue;
+			}
+		}
+
+		if (node.count == 0)
+		{
+			stack.push_back({node.leftOrFirst, planeMask});
+			stack.push_back({node.leftOrFirst + 1, planeMask});
+			continue;
+		}
+
+		for (u32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			const u32 primitive = m_indices[i];
+
+			bool visible = true;
+			if (planeMask != 0)
+			{
+				const glm::vec3 center = 0.5f * (m_boundsMin[primitive] + m_boundsMax[primitive]);
+				const glm::vec3 extent = 0.5f * (m_boundsMax[primitive] - m_boundsMin[primitive]);
+
+				for (u32 p = 0; p < 6 && visible; ++p)
+				{
+					visible = !(planeMask & (1u << p)) || TestPlane(frustum.planes[p], center, extent) != PlaneTest_Outside;
+				}
+			}
+
+			(*visibility)[primitive] = visible;
+		}
+	}
+}
+
+i32 BVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, f32* distance) const
+{
+	i32 hit     = -1;
+	f32 closest = FLT_MAX;
+
+	if (m_nodes.empty())
+	{
+		return hit;
+	}
+
+	const glm::vec3 invDirection = 1.0f / direction;
+
+	std::vector<u32> stack;
+	stack.reserve(64);
+
+	if (IntersectBox(origin, invDirection, closest, m_nodes[0].boundsMin, m_nodes[0].boundsMax) != FLT_MAX)
+	{
+		stack.push_back(0);
+	}
+
+	while (!stack.empty())
+	{
+		const BVHNode& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.count > 0)
+		{
+			for (u32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+			{
+				const u32 primitive = m_indices[i];
+				const f32 t         = IntersectBox(origin, invDirection, closest, m_boundsMin[primitive], m_boundsMax[primitive]);
+
+				if (t < closest)
+				{
+					closest = t;
+					hit     = (i32)primitive;
+				}
+			}
+
+			continue;
+		}
+
+		u32 nearChild = node.leftOrFirst;
+		u32 farChild  = node.leftOrFirst + 1;
+
+		f32 tNear = IntersectBox(origin, invDirection, closest, m_nodes[nearChild].boundsMin, m_nodes[nearChild].boundsMax);
+		f32 tFar  = IntersectBox(origin, invDirection, closest, m_nodes[farChild].boundsMin, m_nodes[farChild].boundsMax);
+
+		if (tFar < tNear)
+		{
+			std::swap(nearChild, farChild);
+			std::swap(tNear, tFar);
+		}
+
+		// Closest child on top of the stack
+		if (tFar != FLT_MAX)
+			stack.push_back(farChild);
+		if (tNear != FLT_MAX)
+			stack.push_back(nearChild);
+	}
+
+	if (hit >= 0)
+	{
+		*distance = closest;
+	}
+
+	return hit;
+}
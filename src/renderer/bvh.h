@@ -0,0 +1,54 @@
+#pragma once
+
+#include "renderer/culling.h"
+
+#include "core/defines.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Interior nodes have count == 0 and their children at left and left + 1,
+// leaves reference count primitives starting at first in the index array.
+struct BVHNode
+{
+	glm::vec3 boundsMin;
+	u32       leftOrFirst;
+	glm::vec3 boundsMax;
+	u32       count;
+};
+
+// Binned SAH bounding volume hierarchy over the world boxes of a SceneBounds.
+// The top of the tree is split on the calling thread, the subtrees below are built on the job pool.
+class BVH
+{
+public:
+	void Build(const SceneBounds& bounds);
+	// Updates the node bounds after the primitives moved, keeps the topology
+	void Refit(const SceneBounds& bounds);
+
+	// Same output as SceneBounds::Cull(), subtrees fully inside the frustum are accepted without testing
+	void Cull(const Frustum& frustum, std::vector<u8>* visibility) const;
+
+	// Closest primitive whose box is hit by the ray, -1 if none
+	i32 Raycast(const glm::vec3& origin, const glm::vec3& direction, f32* distance) const;
+
+	u32 GetNodeCount() const
+	{
+		return (u32)m_nodes.size();
+	}
+
+private:
+	void CopyPrimitives(const SceneBounds& bounds);
+	void BuildNodes(std::vector<BVHNode>* nodes, u32 root, u32 subtreeSize, std::vector<u32>* deferred);
+	bool Split(const BVHNode& node, u32* mid);
+
+	BVHNode MakeNode(u32 first, u32 count) const;
+
+private:
+	std::vector<BVHNode> m_nodes;
+	std::vector<u32>     m_indices;
+
+	std::vector<glm::vec3> m_boundsMin;
+	std::vector<glm::vec3> m_boundsMax;
+};
@@ -0,0 +1,103 @@
+#include "clustered_lighting.h"
+
+#include "renderer/program.h"
+
+#include "core/utils.h"
+
+#include <math.h>
+
+constexpr u32 ClusterGroupSize = 128; // Matches local_size_x in cluster_lights.comp.glsl
+
+void ClusteredLighting::Initialize()
+{
+	m_buildProgram = Program::MakeCompute("clusterLights", "cluster_lights.comp.glsl");
+
+	glCreateBuffers(1, &m_countBuffer);
+	glNamedBufferStorage(m_countBuffer, ClusterCount * sizeof(u32), nullptr, 0);
+
+	glCreateBuffers(1, &m_indexBuffer);
+	glNamedBufferStorage(m_indexBuffer, ClusterCount * MaxLightsPerCluster * sizeof(u32), nullptr, 0);
+}
+
+void ClusteredLighting::Update(const std::vector<Light>& lights, const glm::mat4& proj, const glm::vec2& viewportSize, FrameData* frameData)
+{
+	m_lightCount = (u32)lights.size();
+	m_lightData.resize(m_lightCount);
+
+	for (u32 i = 0; i < m_lightCount; ++i)
+	{
+		const Light& light = lights[i];
+		LightData&   data  = m_lightData[i];
+
+		data.position  = light.position;
+		data.range     = light.range;
+		data.color     = light.color * light.intensity;
+		data.direction = glm::normalize(light.direction);
+
+		// Smooth falloff between the cosines of the two angles, a point light always gets 1
+		if (light.isSpot)
+		{
+			const f32 cosOuter = cosf(light.outerAngle);
+			const f32 cosInner = cosf(Min(light.innerAngle, light.outerAngle));
+
+			data.spotScale  = 1.0f / Max(cosInner - cosOuter, 1e-4f);
+			data.spotOffset = -cosOuter * data.spotScale;
+		}
+		else
+		{
+			data.spotScale  = 0.0f;
+			data.spotOffset = 1.0f;
+		}
+	}
+
+	if (m_lightCount > m_lightCapacity || m_lightBuffer == 0)
+	{
+		glDeleteBuffers(1, &m_lightBuffer);
+
+		m_lightCapacity = Max(m_lightCount, Max(m_lightCapacity * 2, 64u));
+
+		glCreateBuffers(1, &m_lightBuffer);
+		glNamedBufferStorage(m_lightBuffer, m_lightCapacity * sizeof(LightData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	if (m_lightCount > 0)
+	{
+		glNamedBufferSubData(m_lightBuffer, 0, m_lightCount * sizeof(LightData), m_lightData.data());
+	}
+
+	// Planes of a GL perspective projection
+	m_near        = proj[3][2] / (proj[2][2] - 1.0f);
+	m_far         = proj[3][2] / (proj[2][2] + 1.0f);
+	m_inverseProj = glm::inverse(proj);
+
+	const f32 logDepthRange = logf(m_far / m_near);
+
+	frameData->clusterScaleBias = glm::vec4(ClusterCountX / viewportSize.x,
+	                                        ClusterCountY / viewportSize.y,
+	                                        ClusterCountZ / logDepthRange,
+	                                        -ClusterCountZ * logf(m_near) / logDepthRange);
+	// Without the binning the cluster lists are garbage, the shading then skips the punctual lights
+	frameData->clusterGrid      = glm::uvec4(ClusterCountX, ClusterCountY, ClusterCountZ, m_buildProgram->IsReady() ? m_lightCount : 0);
+}
+
+void ClusteredLighting::Build()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LightDataBinding, m_lightBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ClusterLightCountBinding, m_countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ClusterLightIndexBinding, m_indexBuffer);
+
+	// The shading skips the clusters entirely without lights
+	if (m_lightCount == 0 || !m_buildProgram->IsReady())
+	{
+		return;
+	}
+
+	m_buildProgram->Bind();
+	m_buildProgram->SetUniform(UNIFORM("inverseProj"), m_inverseProj);
+	m_buildProgram->SetUniform(UNIFORM("nearPlane"), m_near);
+	m_buildProgram->SetUniform(UNIFORM("farPlane"), m_far);
+
+	glDispatchCompute((ClusterCount + ClusterGroupSize - 1) / ClusterGroupSize, 1, 1);
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "renderer/frame_data.h"
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class Program;
+
+constexpr u32 LightDataBinding         = 8; // Shader storage buffers, see clustered_lighting.glsl
+constexpr u32 ClusterLightCountBinding = 9;
+constexpr u32 ClusterLightIndexBinding = 10;
+
+// Point light, or spot light when isSpot is set
+struct Light
+{
+	glm::vec3 position  = glm::vec3(0.0f);
+	glm::vec3 color     = glm::vec3(1.0f);
+	f32       intensity = 100.0f;
+	f32       range     = 10.0f; // The light has no influence past it
+
+	bool      isSpot     = false;
+	glm::vec3 direction  = glm::vec3(0.0f, -1.0f, 0.0f);
+	f32       innerAngle = 0.35f; // Radians, from the direction
+	f32       outerAngle = 0.5f;
+};
+
+// Bins the lights into a grid of view space froxels every frame, exponentially sliced in depth,
+// so that a fragment only iterates over the lights overlapping its cluster.
+class ClusteredLighting
+{
+public:
+	// Mirrors clustered_lighting.glsl
+	static constexpr u32 ClusterCountX       = 16;
+	static constexpr u32 ClusterCountY       = 9;
+	static constexpr u32 ClusterCountZ       = 24;
+	static constexpr u32 MaxLightsPerCluster = 64;
+	static constexpr u32 ClusterCount        = ClusterCountX * ClusterCountY * ClusterCountZ;
+
+	void Initialize();
+
+	// Uploads the lights and fills the cluster parameters of the frame data
+	void Update(const std::vector<Light>& lights, const glm::mat4& proj, const glm::vec2& viewportSize, FrameData* frameData);
+
+	// Expects the frame data to be bound, leaves the light and cluster buffers bound
+	void Build();
+
+private:
+	// std430, mirrors LightData in clustered_lighting.glsl
+	struct LightData
+	{
+		glm::vec3 position;
+		f32       range;
+		glm::vec3 color; // Premultiplied by the intensity
+		f32       spotScale;
+		glm::vec3 direction;
+		f32       spotOffset;
+	};
+
+	static_assert(sizeof(LightData) == 48);
+
+private:
+	Program* m_buildProgram = nullptr;
+
+	GLuint m_lightBuffer   = 0;
+	u32    m_lightCapacity = 0;
+	GLuint m_countBuffer   = 0;
+	GLuint m_indexBuffer   = 0;
+
+	u32       m_lightCount = 0;
+	glm::mat4 m_inverseProj;
+	f32       m_near = 0.0f;
+	f32       m_far  = 0.0f;
+
+	std::vector<LightData> m_lightData;
+};
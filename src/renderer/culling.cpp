@@ -0,0 +1,114 @@
+#include "culling.h"
+
+#include "core/jobs.h"
+#include "core/simd.h"
+
+#include <math.h>
+
+// Groups of SimdWidth boxes per job batch, small scenes stay on the calling thread
+constexpr u32 CullBatchSize = 256;
+
+Frustum MakeFrustum(const glm::mat4& viewProj)
+{
+	const glm::vec4 row0 = {viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]};
+	const glm::vec4 row1 = {viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]};
+	const glm::vec4 row2 = {viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]};
+	const glm::vec4 row3 = {viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]};
+
+	Frustum frustum = {{row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2}};
+
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return frustum;
+}
+
+void SceneBounds::Resize(u32 count)
+{
+	const u32 paddedCount = (count + SimdWidth - 1) / SimdWidth * SimdWidth;
+
+	m_count = count;
+
+	// Padding boxes are never reported, zero them so the kernel reads defined values
+	for (std::vector<f32>* array : {&m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ})
+	{
+		array->assign(paddedCount, 0.0f);
+	}
+}
+
+void SceneBounds::Set(u32 index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform)
+{
+	const glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+	const glm::vec3 extent = 0.5f * (boundsMax - boundsMin);
+
+	const glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+
+	// Extent of the transformed box along each world axis
+	const glm::mat3 absolute    = glm::mat3(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2])));
+	const glm::vec3 worldExtent = absolute * extent;
+
+	m_centerX[index] = worldCenter.x;
+	m_centerY[index] = worldCenter.y;
+	m_centerZ[index] = worldCenter.z;
+	m_extentX[index] = worldExtent.x;
+	m_extentY[index] = worldExtent.y;
+	m_extentZ[index] = worldExtent.z;
+}
+
+void SceneBounds::Cull(const Frustum& frustum, std::vector<u8>* visibility) const
+{
+	visibility->resize(m_centerX.size());
+
+	u8*       result     = visibility->data();
+	const u32 groupCount = (u32)m_centerX.size() / SimdWidth;
+
+	Jobs::ParallelFor(groupCount, CullBatchSize, [&](u32 begin, u32 end) {
+		F32x normals[6][3];
+		F32x absNormals[6][3];
+		F32x distances[6];
+
+		for (u32 p = 0; p < 6; ++p)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+
+			for (u32 axis = 0; axis < 3; ++axis)
+			{
+				normals[p][axis]    = SimdSet(plane[axis]);
+				absNormals[p][axis] = SimdSet(fabsf(plane[axis]));
+			}
+
+			distances[p] = SimdSet(plane.w);
+		}
+
+		const F32x zero = SimdSet(0.0f);
+
+		for (u32 group = begin; group < end; ++group)
+		{
+			const u32 i = group * SimdWidth;
+
+			const F32x cx = SimdLoad(&m_centerX[i]);
+			const F32x cy = SimdLoad(&m_centerY[i]);
+			const F32x cz = SimdLoad(&m_centerZ[i]);
+			const F32x ex = SimdLoad(&m_extentX[i]);
+			const F32x ey = SimdLoad(&m_extentY[i]);
+			const F32x ez = SimdLoad(&m_extentZ[i]);
+
+			// A box is outside as soon as it lies entirely behind one plane
+			u32 inside = (1u << SimdWidth) - 1;
+			for (u32 p = 0; p < 6 && inside != 0; ++p)
+			{
+				const F32x distance = cx * normals[p][0] + cy * normals[p][1] + cz * normals[p][2] + distances[p];
+				const F32x radius   = ex * absNormals[p][0] + ey * absNormals[p][1] + ez * absNormals[p][2];
+
+				inside &= SimdMoveMask(distance + radius >= zero);
+			}
+
+			for (u32 lane = 0; lane < SimdWidth; ++lane)
+			{
+				result[i + lane] = (inside >> lane) & 1;
+			}
+		}
+	});
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Normalized planes pointing inwards: left, right, bottom, top, near, far
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+Frustum MakeFrustum(const glm::mat4& viewProj);
+
+// World space AABBs of the scene models, stored as center/extent SoA so that the culling
+// tests SimdWidth boxes at once. The arrays are padded to a multiple of SimdWidth.
+class SceneBounds
+{
+public:
+	void Resize(u32 count);
+	void Set(u32 index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform);
+
+	// visibility[i] is 1 when box i intersects the frustum, 0 otherwise
+	void Cull(const Frustum& frustum, std::vector<u8>* visibility) const;
+
+	u32 GetCount() const
+	{
+		return m_count;
+	}
+
+	glm::vec3 GetCenter(u32 index) const
+	{
+		return {m_centerX[index], m_centerY[index], m_centerZ[index]};
+	}
+
+	glm::vec3 GetExtent(u32 index) const
+	{
+		return {m_extentX[index], m_extentY[index], m_extentZ[index]};
+	}
+
+private:
+	u32 m_count = 0;
+
+	std::vector<f32> m_centerX, m_centerY, m_centerZ;
+	std::vector<f32> m_extentX, m_extentY, m_extentZ;
+};
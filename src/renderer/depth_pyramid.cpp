@@ -0,0 +1,83 @@
+#include "depth_pyramid.h"
+
+#include "renderer/gl_state.h"
+#include "renderer/program.h"
+#include "renderer/render_target_pool.h"
+
+#include <math.h>
+
+constexpr u32 DepthPyramidGroupSize = 16; // Matches local_size in depth_pyramid.comp.glsl
+
+void DepthPyramid::Initialize()
+{
+	m_resolveProgram    = Program::MakeCompute("depthPyramidResolve", "depth_pyramid.comp.glsl", {"RESOLVE_MSAA_DEPTH"});
+	m_copyProgram       = Program::MakeCompute("depthPyramidCopy", "depth_pyramid.comp.glsl", {"RESOLVE_MSAA_DEPTH", "SINGLE_SAMPLE"});
+	m_downsampleProgram = Program::MakeCompute("depthPyramidDownsample", "depth_pyramid.comp.glsl");
+}
+
+void DepthPyramid::Resize(const glm::vec2& size, const glm::uvec2& capacity)
+{
+	m_size       = size;
+	m_levelCount = (u32)floor(log2(fmax(size.x, size.y))) + 1;
+
+	if (m_capacity == capacity)
+	{
+		return;
+	}
+
+	if (m_texture != 0)
+	{
+		RenderTargetPool::Get()->Release(m_texture);
+	}
+
+	m_capacity = capacity;
+
+	const RenderTargetDesc desc = {
+	    .format = GL_R32F,
+	    .width  = capacity.x,
+	    .height = capacity.y,
+	    .levels = (u32)floor(log2(fmax(capacity.x, capacity.y))) + 1,
+	};
+
+	m_texture = RenderTargetPool::Get()->Acquire(desc);
+	glTextureParameteri(m_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(m_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(m_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void DepthPyramid::Build(GLuint depthTexture, u32 samples)
+{
+	u32 width  = (u32)m_size.x;
+	u32 height = (u32)m_size.y;
+
+	Program* resolveProgram = samples > 1 ? m_resolveProgram : m_copyProgram;
+
+	resolveProgram->Bind();
+	resolveProgram->SetUniform(UNIFORM("outputSize"), glm::vec2(width, height));
+	GLState::BindTextureUnit(0, depthTexture);
+	GLState::BindImageTexture(1, m_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glDispatchCompute((width + DepthPyramidGroupSize - 1) / DepthPyramidGroupSize, (height + DepthPyramidGroupSize - 1) / DepthPyramidGroupSize, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	m_downsampleProgram->Bind();
+
+	for (u32 level = 1; level < m_levelCount; ++level)
+	{
+		const glm::vec2 inputSize(width, height);
+
+		width  = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+
+		m_downsampleProgram->SetUniform(UNIFORM("inputSize"), inputSize);
+		m_downsampleProgram->SetUniform(UNIFORM("outputSize"), glm::vec2(width, height));
+
+		GLState::BindImageTexture(0, m_texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		GLState::BindImageTexture(1, m_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((width + DepthPyramidGroupSize - 1) / DepthPyramidGroupSize, (height + DepthPyramidGroupSize - 1) / DepthPyramidGroupSize, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	// The culling pass reads it through a sampler
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
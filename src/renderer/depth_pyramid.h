@@ -0,0 +1,49 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+class Program;
+
+// Hierarchical Z: each texel of a level holds the farthest depth of the texels it covers in the
+// previous one, so that a box whose nearest depth is behind it is hidden. Level 0 matches the
+// viewport, built from every sample of the depth. Like the render targets, the
+// texture comes from the RenderTargetPool and only its bottom left corner is used.
+class DepthPyramid
+{
+public:
+	void Initialize();
+	// The texture is only reallocated when the capacity changes
+	void Resize(const glm::vec2& size, const glm::uvec2& capacity);
+
+	// Expects the depth writes to be finished, a single sample depth is a plain 2D texture
+	void Build(GLuint depthTexture, u32 samples);
+
+	GLuint GetTexture() const
+	{
+		return m_texture;
+	}
+
+	u32 GetLevelCount() const
+	{
+		return m_levelCount;
+	}
+
+	// Used part of level 0, level i is max(size >> i, 1)
+	glm::vec2 GetSize() const
+	{
+		return m_size;
+	}
+
+private:
+	Program* m_resolveProgram    = nullptr;
+	Program* m_copyProgram       = nullptr; // Single sample
+	Program* m_downsampleProgram = nullptr;
+
+	GLuint     m_texture    = 0;
+	glm::vec2  m_size       = glm::vec2(0.0f);
+	glm::uvec2 m_capacity   = glm::uvec2(0);
+	u32        m_levelCount = 0;
+};
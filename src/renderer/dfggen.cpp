@@ -1,53 +1,81 @@
+#include "renderer/dfggen.h"
 
 #include "core/defines.h"
 #include "core/utils.h"
+#include "core/simd.h"
+#include "core/jobs.h"
 
-#include <stdint.h>
-#include <stdlib.h>
 #include <math.h>
-#include <algorithm>
 #include <vector>
 
-#include <glm/vec2.hpp>
-#include <glm/vec3.hpp>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
-f32 Vis(f32 a, f32 NoV, f32 NoL)
+// Heitz 2014, "Understanding the Masking-Shadowing Function in Microfacet-Based BRDFs"
+// Height-correlated GGX, evaluated for SimdWidth NoV values at once
+inline F32x Vis(F32x a2, F32x NoV, F32x NoL)
 {
-	// Heitz 2014, "Understanding the Masking-Shadowing Function in Microfacet-Based BRDFs"
-	// Height-correlated GGX
-	const f32 a2    = a * a;
-	const f32 GGX_L = NoV * sqrtf((NoL - NoL * a2) * NoL + a2);
-	const f32 GGX_V = NoL * sqrtf((NoV - NoV * a2) * NoV + a2);
-	return 0.5f / (GGX_V + GGX_L);
+	const F32x GGX_L = NoV * SimdSqrt((NoL - NoL * a2) * NoL + a2);
+	const F32x GGX_V = NoL * SimdSqrt((NoV - NoV * a2) * NoV + a2);
+	return SimdSet(0.5f) / (GGX_V + GGX_L);
 }
 
-inline glm::vec3 HemisphereImportanceSampleDGGX(const glm::vec2& u, const f32 a)
+inline F32x Pow5(F32x x)
 {
-	const f32 phi       = Tau * u.x;
-	const f32 cosTheta2 = (1.0f - u.y) / (1.0f + (a + 1.0f) * ((a - 1.0f) * u.y));
-	const f32 cosTheta  = sqrtf(cosTheta2);
-	const f32 sinTheta  = sqrtf(1.0f - cosTheta2);
-	return {sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta};
+	const F32x x2 = x * x;
+	return x2 * x2 * x;
 }
 
-glm::vec2 DFV(f32 NoV, f32 roughness, u32 sampleCount)
+// The importance sampled half vectors only depend on the roughness, so a row of the LUT shares them
+// and only V varies along it. Lanes are spread over NoV, which keeps the sample loop branchless.
+static void DFVRow(f32 a, u32 w, u32 sampleCount, const glm::vec2* hammersley, u32* output)
 {
-	glm::vec2 r(0.0f);
-
-	const glm::vec3 V(sqrtf(1.0f - NoV * NoV), 0.0f, NoV);
-	const f32       invSampleCount = 1.0f / sampleCount;
+	std::vector<f32> hx(sampleCount);
+	std::vector<f32> hz(sampleCount);
 
 	for (u32 i = 0; i < sampleCount; ++i)
 	{
-		const glm::vec2 u   = Hammersley(i, invSampleCount);
-		const glm::vec3 H   = HemisphereImportanceSampleDGGX(u, roughness);
-		const glm::vec3 L   = 2.0f * glm::dot(V, H) * H - V;
-		const f32       VoH = Saturate(glm::dot(V, H));
-		const f32       NoL = Saturate(L.z);
-		const f32       NoH = Saturate(H.z);
-		if (NoL > 0)
+		const glm::vec2 u = hammersley[i];
+
+		const f32 phi       = Tau * u.x;
+		const f32 cosTheta2 = (1.0f - u.y) / (1.0f + (a + 1.0f) * ((a - 1.0f) * u.y));
+
+		// V lies in the XZ plane, H.y never contributes
+		hx[i] = sqrtf(1.0f - cosTheta2) * cosf(phi);
+		hz[i] = sqrtf(cosTheta2);
+	}
+
+	const F32x a2             = SimdSet(a * a);
+	const F32x zero           = SimdSet(0.0f);
+	const F32x one            = SimdSet(1.0f);
+	const f32  invSampleCount = 1.0f / sampleCount;
+
+	for (u32 x = 0; x < w; x += SimdWidth)
+	{
+		f32 lanes[SimdWidth];
+		for (u32 lane = 0; lane < SimdWidth; ++lane)
 		{
+			lanes[lane] = Saturate((x + lane + 0.5f) / w);
+		}
+
+		const F32x NoV = SimdLoad(lanes);
+		const F32x Vx  = SimdSqrt(one - NoV * NoV);
+
+		F32x rx = zero;
+		F32x ry = zero;
+
+		for (u32 i = 0; i < sampleCount; ++i)
+		{
+			const F32x Hx = SimdSet(hx[i]);
+			const F32x Hz = SimdSet(hz[i]);
+
+			const F32x VoH = Vx * Hx + NoV * Hz;
+			const F32x Lz  = SimdSet(2.0f) * VoH * Hz - NoV;
+
+			const F32x clampedVoH = SimdSaturate(VoH);
+			const F32x NoL        = SimdSaturate(Lz);
+			const F32x NoH        = SimdSaturate(Hz);
+
 			/*
 			 * Fc = (1 - V•H)^5
 			 * F(h) = f0*(1 - Fc) + f90*Fc
@@ -69,78 +97,62 @@ glm::vec2 DFV(f32 NoV, f32 roughness, u32 sampleCount)
 			 *
 			 *   Er() = f0 * DFV.x + f90 * DFV.y
 			 */
-			const f32 v  = Vis(roughness, NoV, NoL) * NoL * (VoH / NoH);
-			const f32 Fc = Pow5(1.0 - VoH);
-			r.x += v * (1.0f - Fc);
-			r.y += v * Fc;
+			const F32x v  = Vis(a2, NoV, NoL) * NoL * (clampedVoH / NoH);
+			const F32x Fc = Pow5(one - clampedVoH);
+
+			const M32x valid = NoL > zero;
+			rx               = rx + SimdSelect(valid, v * (one - Fc), zero);
+			ry               = ry + SimdSelect(valid, v * Fc, zero);
 		}
-	}
 
-	return 4.0f * r * invSampleCount;
+		f32 resultX[SimdWidth];
+		f32 resultY[SimdWidth];
+		SimdStore(resultX, rx);
+		SimdStore(resultY, ry);
+
+		for (u32 lane = 0; lane < SimdWidth && x + lane < w; ++lane)
+		{
+			const glm::vec2 d = 4.0f * glm::vec2(resultX[lane], resultY[lane]) * invSampleCount;
+			output[x + lane]  = glm::packHalf2x16(d);
+		}
+	}
 }
 
-std::vector<glm::vec3> PrecomputeDFG(u32 w, u32 h, u32 sampleCount) // 128, 128, 512
+std::vector<u32> PrecomputeDFG(u32 w, u32 h, u32 sampleCount)
 {
-	std::vector<glm::vec3> lutDataRG32F;
-	lutDataRG32F.resize(w * h);
+	// Hammersley points are shared by every texel
+	const u32 paddedSampleCount = (sampleCount + SimdWidth - 1) / SimdWidth * SimdWidth;
+	const f32 invSampleCount    = 1.0f / sampleCount;
 
-	for (u32 y = 0; y < h; ++y)
+	std::vector<glm::vec2> hammersley(paddedSampleCount);
+
+	for (u32 i = 0; i < paddedSampleCount; i += SimdWidth)
 	{
-		const f32 roughness       = Saturate((h - y + 0.5f) / h);
-		const f32 linearRoughness = roughness * roughness;
-		for (u32 x = 0; x < w; ++x)
+		F32x x, y;
+		SimdHammersley(i, invSampleCount, &x, &y);
+
+		f32 xs[SimdWidth];
+		f32 ys[SimdWidth];
+		SimdStore(xs, x);
+		SimdStore(ys, y);
+
+		for (u32 lane = 0; lane < SimdWidth; ++lane)
 		{
-			const f32 NoV = Saturate((x + 0.5f) / w);
-			// const f32 m2  = m * m;
-
-			// const f32 vx = sqrtf(1.0f - NoV * NoV);
-			// const f32 vy = 0.0f;
-			// const f32 vz = NoV;
-
-			// f32 scale = 0.0f;
-			// f32 bias  = 0.0f;
-
-			const glm::vec2 d = DFV(NoV, linearRoughness, sampleCount);
-
-			lutDataRG32F[y * w + x] = glm::vec3(d.x, d.y, 0.0);
-
-			// for (u32 i = 0; i < sampleCount; ++i)
-			// {
-			// 	const glm::vec2 h = Hammersley(i, 1.0f / sampleCount);
-
-			// 	const f32 phi      = 2.0f * MATH_PI * h.x;
-			// 	const f32 cosPhi   = cosf(phi);
-			// 	const f32 sinPhi   = sinf(phi);
-			// 	const f32 cosTheta = sqrtf((1.0f - h.y) / (1.0f + (m2 - 1.0f) * h.y));
-			// 	const f32 sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
-
-			// 	const f32 hx = sinTheta * cosf(phi);
-			// 	const f32 hy = sinTheta * sinf(phi);
-			// 	const f32 hz = cosTheta;
-
-			// 	const f32 vdh = vx * hx + vy * hy + vz * hz;
-			// 	const f32 lx  = 2.0f * vdh * hx - vx;
-			// 	const f32 ly  = 2.0f * vdh * hy - vy;
-			// 	const f32 lz  = 2.0f * vdh * hz - vz;
-
-			// 	const f32 NoL   = std::max(lz, 0.0f);
-			// 	const f32 ndoth = std::max(hz, 0.0f);
-			// 	const f32 vdoth = std::max(vdh, 0.0f);
-
-			// 	if (NoL > 0.0f)
-			// 	{
-			// 		const f32 vis         = Vis(roughness, NoV, NoL);
-			// 		const f32 ndotlVisPDF = NoL * vis * (4.0f * vdoth / ndoth);
-			// 		const f32 fresnel     = powf(1.0f - vdoth, 5.0f);
-
-			// 		scale += ndotlVisPDF * (1.0f - fresnel);
-			// 		bias += ndotlVisPDF * fresnel;
-			// 	}
-			// }
-			// scale /= sampleCount;
-			// bias /= sampleCount;
+			hammersley[i + lane] = glm::vec2(xs[lane], ys[lane]);
 		}
 	}
 
-	return lutDataRG32F;
-}
\ No newline at end of file
+	std::vector<u32> lutDataRG16F(w * h);
+
+	Jobs::ParallelFor(h, 1, [&](u32 begin, u32 end) {
+		for (u32 y = begin; y < end; ++y)
+		{
+			const f32 roughness       = Saturate((h - y + 0.5f) / h);
+			const f32 linearRoughness = roughness * roughness;
+
+			DFVRow(linearRoughness, w, sampleCount, hammersley.data(), &lutDataRG16F[y * w]);
+		}
+	});
+
+	return lutDataRG16F;
+}
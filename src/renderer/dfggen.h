@@ -0,0 +1,16 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <vector>
+
+constexpr u32 DFGSize        = 128;
+constexpr u32 DFGSampleCount = 1024;
+
+// Returns w * h RG16F texels, each one packed in a u32 (DFV.x in the low half, DFV.y in the high half)
+std::vector<u32> PrecomputeDFG(u32 w, u32 h, u32 sampleCount);
+
+#if SPARK_BAKED_DFG
+// Generated at build time by the bake_dfg tool
+extern const u32 g_bakedDFG[DFGSize * DFGSize];
+#endif
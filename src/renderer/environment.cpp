@@ -3,6 +3,7 @@
 #include "renderer/program.h"
 #include "renderer/render_primitives.h"
 #include "renderer/frame_stats.h"
+#include "renderer/gl_state.h"
 
 #include "core/defines.h"
 #include "core/utils.h"
@@ -14,40 +15,153 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-void LoadEnvironment(const char* filename, Environment* env)
+#include <vector>
+
+struct PrefilterSample
 {
-	FrameStats* stats = FrameStats::Get();
-	Timer       timer;
-	Timer       procTimer;
+	glm::vec3 direction; // Tangent space (N = +Z), so direction.z is also NoL
+	f32       lod;
+};
 
-	stbi_set_flip_vertically_on_load(true);
+struct PrefilterMipInfos
+{
+	u32 sampleOffset;
+	u32 sampleCount;
+	f32 invTotalWeight;
+};
+
+constexpr u32 PrefilterMipLevels = 6;
 
-	i32  w, h, c;
-	f32* data = stbi_loadf(filename, &w, &h, &c, 0);
+global_variable GLuint            g_prefilterSamples     = 0;
+global_variable u32               g_prefilterCubemapSize = 0;
+global_variable PrefilterMipInfos g_prefilterMips[PrefilterMipLevels];
 
-	stbi_set_flip_vertically_on_load(false);
+inline u32 PrefilterSampleCount(u32 mip)
+{
+	// Low roughness lobes are narrow and the source lod already integrates most of the footprint,
+	// so the sample count can grow with roughness instead of paying the worst case on every mip.
+	return 32u << mip;
+}
 
-	if (data == nullptr)
+inline f32 D_GGX(f32 a, f32 NoH)
+{
+	const f32 a2 = a * a;
+	const f32 f  = (NoH * a2 - NoH) * NoH + 1.0f;
+	return a2 / (Pi * f * f);
+}
+
+// Since the prefilter assumes V = N, every texel of a given mip uses the same set of tangent space directions
+// and source mip levels. They only depend on the roughness and the source cubemap size, so build them once.
+static void BuildPrefilterSamples(u32 cubemapSize)
+{
+	if (g_prefilterCubemapSize == cubemapSize)
 	{
 		return;
 	}
 
-	const u32 cubemapSize = 1024;
+	std::vector<PrefilterSample> samples;
+
+	// Texel solid angle of the source cubemap
+	const f32 omegaP = 4.0f * Pi / (6.0f * cubemapSize * cubemapSize);
+
+	g_prefilterMips[0] = {};
+
+	for (u32 mip = 1; mip < PrefilterMipLevels; ++mip)
+	{
+		const f32 perceptualRoughness = (f32)mip / (f32)(PrefilterMipLevels - 1);
+		const f32 roughness           = perceptualRoughness * perceptualRoughness;
+
+		const u32 sampleCount    = PrefilterSampleCount(mip);
+		const f32 invSampleCount = 1.0f / sampleCount;
+
+		PrefilterMipInfos* infos = &g_prefilterMips[mip];
+		infos->sampleOffset      = (u32)samples.size();
+
+		f32 totalWeight = 0.0f;
+
+		for (u32 i = 0; i < sampleCount; ++i)
+		{
+			const glm::vec2 u = Hammersley(i, invSampleCount);
+
+			const f32 phi       = Tau * u.x;
+			const f32 cosTheta2 = (1.0f - u.y) / (1.0f + (roughness + 1.0f) * ((roughness - 1.0f) * u.y));
+			const f32 cosTheta  = sqrtf(cosTheta2);
+			const f32 sinTheta  = sqrtf(1.0f - cosTheta2);
+
+			const glm::vec3 H(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+
+			// V = N = +Z
+			const f32       NoH = H.z;
+			const glm::vec3 L   = glm::normalize(2.0f * NoH * H - glm::vec3(0.0f, 0.0f, 1.0f));
+			const f32       NoL = L.z;
+
+			if (NoL > 0.0f)
+			{
+				// With V = N, VoH = NoH and the pdf simplifies to D / 4
+				const f32 pdf    = D_GGX(roughness, NoH) * 0.25f + 1e-4f;
+				const f32 omegaS = 1.0f / (sampleCount * pdf + 1e-4f);
+				const f32 lod    = Max(0.5f * log2f(omegaS / omegaP), 0.0f);
+
+				samples.push_back({L, lod});
+				totalWeight += NoL;
+			}
+		}
+
+		infos->sampleCount    = (u32)samples.size() - infos->sampleOffset;
+		infos->invTotalWeight = 1.0f / totalWeight;
+	}
+
+	if (glIsBuffer(g_prefilterSamples))
+	{
+		glDeleteBuffers(1, &g_prefilterSamples);
+	}
+
+	glCreateBuffers(1, &g_prefilterSamples);
+	glNamedBufferStorage(g_prefilterSamples, samples.size() * sizeof(PrefilterSample), samples.data(), 0);
+
+	g_prefilterCubemapSize = cubemapSize;
+}
+
+bool LoadEnvironmentImage(const char* filename, EnvironmentImage* image)
+{
+	// Can run on any thread, do not touch the global stb flag
+	stbi_set_flip_vertically_on_load_thread(true);
+
+	i32 c;
+	image->data = stbi_loadf(filename, &image->width, &image->height, &c, 3);
+
+	stbi_set_flip_vertically_on_load_thread(false);
+
+	return image->data != nullptr;
+}
+
+void FreeEnvironmentImage(EnvironmentImage* image)
+{
+	stbi_image_free(image->data);
+	*image = {};
+}
+
+void BakeEnvironment(const EnvironmentImage& image, Environment* env)
+{
+	FrameStats* stats = FrameStats::Get();
+	Timer       timer;
+	Timer       procTimer;
+
+	const i32 w           = image.width;
+	const i32 h           = image.height;
+	const u32 cubemapSize = EnvironmentCubemapSize;
 
 	GLuint equirectangularTexture;
 	glCreateTextures(GL_TEXTURE_2D, 1, &equirectangularTexture);
 
-	// glTextureStorage2D(equirectangularTexture, levels, GL_RGB32F, w, h);
 	glTextureStorage2D(equirectangularTexture, log2f(Min(w, h)), GL_RGB32F, w, h);
-	glTextureSubImage2D(equirectangularTexture, 0, 0, 0, w, h, GL_RGB, GL_FLOAT, data);
+	glTextureSubImage2D(equirectangularTexture, 0, 0, 0, w, h, GL_RGB, GL_FLOAT, image.data);
 	glTextureParameteri(equirectangularTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(equirectangularTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(equirectangularTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTextureParameteri(equirectangularTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	stbi_image_free(data);
-
-	stats->ibl.loadTexture = timer.Tick();
+	defer(glDeleteTextures(1, &equirectangularTexture));
 
 	// Cleanup old data
 	if (!glIsTexture(env->envMap))
@@ -64,11 +178,12 @@ void LoadEnvironment(const char* filename, Environment* env)
 
 	Program* equirectangularToCubemapProgram = Program::GetProgramByName("equirectangularToCubemap");
 	equirectangularToCubemapProgram->Bind();
-	glBindTextureUnit(0, equirectangularTexture);
-	glBindImageTexture(1, env->envMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	equirectangularToCubemapProgram->SetUniform(UNIFORM("cubemapSize"), glm::vec2(cubemapSize, cubemapSize));
+	GLState::BindTextureUnit(0, equirectangularTexture);
+	GLState::BindImageTexture(1, env->envMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
 	glDispatchCompute(cubemapSize / 8, cubemapSize / 8, 1);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 
 	glGenerateTextureMipmap(env->envMap);
 
@@ -77,7 +192,7 @@ void LoadEnvironment(const char* filename, Environment* env)
 	if (!glIsTexture(env->radianceMap))
 	{
 		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &env->radianceMap);
-		glTextureStorage2D(env->radianceMap, 6, GL_RGBA32F, cubemapSize, cubemapSize);
+		glTextureStorage2D(env->radianceMap, PrefilterMipLevels, GL_RGBA32F, cubemapSize, cubemapSize);
 
 		glTextureParameteri(env->radianceMap, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTextureParameteri(env->radianceMap, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -86,20 +201,27 @@ void LoadEnvironment(const char* filename, Environment* env)
 		glTextureParameteri(env->radianceMap, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	}
 
+	BuildPrefilterSamples(cubemapSize);
+
+	// Roughness 0 is a perfect mirror, the first mip is a plain copy of the source cubemap
+	glCopyImageSubData(env->envMap, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, env->radianceMap, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, cubemapSize, cubemapSize, 6);
+
 	Program* prefilterEnvmapProgram = Program::GetProgramByName("prefilterEnvmap");
 	prefilterEnvmapProgram->Bind();
-	glBindTextureUnit(0, env->envMap);
+	GLState::BindTextureUnit(0, env->envMap);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_prefilterSamples);
 
-	u32 mipLevels = 6;
-	u32 mipSize   = cubemapSize;
+	u32 mipSize = cubemapSize / 2;
 
-	for (u32 mip = 0; mip < mipLevels; ++mip, mipSize /= 2)
+	for (u32 mip = 1; mip < PrefilterMipLevels; ++mip, mipSize /= 2)
 	{
-		const f32 roughness = (f32)mip / (f32)(mipLevels - 1);
+		const PrefilterMipInfos& infos = g_prefilterMips[mip];
 
-		glBindImageTexture(1, env->radianceMap, mip, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-		prefilterEnvmapProgram->SetUniform("roughness", roughness);
-		prefilterEnvmapProgram->SetUniform("mipSize", glm::vec2(mipSize, mipSize));
+		GLState::BindImageTexture(1, env->radianceMap, mip, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		prefilterEnvmapProgram->SetUniform(UNIFORM("mipSize"), glm::vec2(mipSize, mipSize));
+		prefilterEnvmapProgram->SetUniform(UNIFORM("sampleOffset"), infos.sampleOffset);
+		prefilterEnvmapProgram->SetUniform(UNIFORM("sampleCount"), infos.sampleCount);
+		prefilterEnvmapProgram->SetUniform(UNIFORM("invTotalWeight"), infos.invTotalWeight);
 
 		glDispatchCompute(mipSize / 8, mipSize / 8, 1);
 	}
@@ -112,7 +234,7 @@ void LoadEnvironment(const char* filename, Environment* env)
 	{
 		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &env->irradianceMap);
 
-		glTextureStorage2D(env->irradianceMap, 1, GL_RGBA32F, 64, 64);
+		glTextureStorage2D(env->irradianceMap, 1, GL_RGBA32F, EnvironmentIrradianceSize, EnvironmentIrradianceSize);
 
 		glTextureParameteri(env->irradianceMap, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTextureParameteri(env->irradianceMap, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -123,13 +245,42 @@ void LoadEnvironment(const char* filename, Environment* env)
 
 	Program* irradianceProgram = Program::GetProgramByName("irradiance");
 	irradianceProgram->Bind();
-	glBindTextureUnit(0, env->envMap); // glBindImageTexture(0, env->envMap, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(1, env->irradianceMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	GLState::BindTextureUnit(0, env->envMap); // glBindImageTexture(0, env->envMap, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+	GLState::BindImageTexture(1, env->irradianceMap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
-	glDispatchCompute(8, 8, 1);
+	glDispatchCompute(EnvironmentIrradianceSize / 8, EnvironmentIrradianceSize / 8, 1);
 
 	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
 	stats->ibl.irradiance = timer.Tick();
 	stats->ibl.total      = procTimer.Tick();
 }
+
+void DestroyEnvironment(Environment* env)
+{
+	// The DFG LUT is shared between environments and owned by the renderer
+	glDeleteTextures(1, &env->envMap);
+	glDeleteTextures(1, &env->radianceMap);
+	glDeleteTextures(1, &env->irradianceMap);
+
+	env->envMap        = 0;
+	env->radianceMap   = 0;
+	env->irradianceMap = 0;
+}
+
+u64 GetEnvironmentMemorySize()
+{
+	auto cubemapSize = [](u32 size, u32 levels) {
+		u64 total = 0;
+		for (u32 level = 0; level < levels; ++level, size /= 2)
+		{
+			total += 6ull * size * size * 4 * sizeof(f32);
+		}
+		return total;
+	};
+
+	const u32 envMapLevels = (u32)log2f(EnvironmentCubemapSize);
+
+	return cubemapSize(EnvironmentCubemapSize, envMapLevels) + cubemapSize(EnvironmentCubemapSize, PrefilterMipLevels) +
+	       cubemapSize(EnvironmentIrradianceSize, 1);
+}
@@ -2,6 +2,9 @@
 
 #include "core/defines.h"
 
+constexpr u32 EnvironmentCubemapSize    = 1024;
+constexpr u32 EnvironmentIrradianceSize = 64;
+
 struct Environment
 {
 	u32 envMap        = 0;
@@ -10,4 +13,20 @@ struct Environment
 	u32 iblDFG        = 0;
 };
 
-void LoadEnvironment(const char* filename, Environment* env);
\ No newline at end of file
+// Decoded equirectangular HDR image (RGB32F)
+struct EnvironmentImage
+{
+	f32* data   = nullptr;
+	i32  width  = 0;
+	i32  height = 0;
+};
+
+// Decoding does not touch GL and can run on any thread, baking must run on the GL thread
+bool LoadEnvironmentImage(const char* filename, EnvironmentImage* image);
+void FreeEnvironmentImage(EnvironmentImage* image);
+void BakeEnvironment(const EnvironmentImage& image, Environment* env);
+
+void DestroyEnvironment(Environment* env);
+
+// GPU memory used by the baked textures of one environment
+u64 GetEnvironmentMemorySize();
\ No newline at end of file
@@ -0,0 +1,309 @@
+#include "renderer/environment_library.h"
+
+#include "renderer/frame_stats.h"
+
+#include "core/utils.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+void EnvironmentLibrary::Initialize(u32 iblDFG)
+{
+	m_iblDFG       = iblDFG;
+	m_empty.iblDFG = iblDFG;
+}
+
+void EnvironmentLibrary::Shutdown()
+{
+	for (Entry* entry : m_entries)
+	{
+		if (IsDecoding(*entry))
+		{
+			EnvironmentImage image = entry->decode.get();
+			FreeEnvironmentImage(&image);
+		}
+
+		if (entry->baked)
+		{
+			DestroyEnvironment(&entry->env);
+		}
+
+		delete entry;
+	}
+
+	m_entries.clear();
+	m_current = -1;
+}
+
+void EnvironmentLibrary::AddDirectory(const char* directory)
+{
+	std::vector<std::filesystem::path> files;
+
+	std::error_code error;
+	for (const auto& file : std::filesystem::directory_iterator(directory, error))
+	{
+		if (file.is_regular_file() && file.path().extension() == ".hdr")
+		{
+			files.push_back(file.path());
+		}
+	}
+
+	// The iteration order depends on the filesystem
+	std::sort(files.begin(), files.end());
+
+	for (const std::filesystem::path& file : files)
+	{
+		Add(file.string().c_str());
+	}
+}
+
+i32 EnvironmentLibrary::Add(const char* filename)
+{
+	for (i32 i = 0; i < GetCount(); ++i)
+	{
+		if (m_entries[i]->filename == filename)
+		{
+			return i;
+		}
+	}
+
+	Entry* entry      = new Entry;
+	entry->filename   = filename;
+	entry->name       = std::filesystem::path(filename).stem().string();
+	entry->env.iblDFG = m_iblDFG;
+
+	m_entries.push_back(entry);
+
+	return GetCount() - 1;
+}
+
+i32 EnvironmentLibrary::Find(const char* name) const
+{
+	for (i32 i = 0; i < GetCount(); ++i)
+	{
+		if (m_entries[i]->name == name)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void EnvironmentLibrary::Select(i32 index)
+{
+	if (index < 0 || index >= GetCount() || index == m_current)
+	{
+		return;
+	}
+
+	Timer  timer;
+	Entry* entry = m_entries[index];
+
+	if (!entry->baked)
+	{
+		// Slow path, the environment was not preloaded
+		EnvironmentImage image;
+
+		if (IsDecoding(*entry))
+		{
+			image = entry->decode.get();
+		}
+		else
+		{
+			Timer decodeTimer;
+			LoadEnvironmentImage(entry->filename.c_str(), &image);
+			entry->decodeTime = decodeTimer.Tick();
+		}
+
+		if (image.data == nullptr)
+		{
+			fprintf(stderr, "Could not load environment %s\n", entry->filename.c_str());
+			return;
+		}
+
+		MakeRoom(index, false);
+		Bake(entry, &image);
+	}
+
+	m_current       = index;
+	entry->lastUsed = ++m_frame;
+
+	FrameStats::Get()->ibl.switchEnvironment = timer.Tick();
+}
+
+void EnvironmentLibrary::Update()
+{
+	++m_frame;
+
+	if (m_current >= 0)
+	{
+		m_entries[m_current]->lastUsed = m_frame;
+	}
+
+	// Bake at most one finished decode per frame
+	for (i32 i = 0; i < GetCount(); ++i)
+	{
+		Entry* entry = m_entries[i];
+
+		if (IsDecoding(*entry) && entry->decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			EnvironmentImage image = entry->decode.get();
+
+			if (image.data == nullptr)
+			{
+				// Not preloaded again, Select() still reports the error
+				entry->loadFailed = true;
+				continue;
+			}
+
+			if (MakeRoom(i, true))
+			{
+				Bake(entry, &image);
+				break;
+			}
+
+			FreeEnvironmentImage(&image);
+		}
+	}
+
+	// Then start decoding the next candidates, one at a time to keep CPU memory in check
+	for (i32 i = 0; i < GetCount(); ++i)
+	{
+		if (IsDecoding(*m_entries[i]))
+		{
+			return;
+		}
+	}
+
+	const u64 environmentSize = GetEnvironmentMemorySize();
+
+	for (i32 offset = 1; offset <= preloadCount && offset < GetCount(); ++offset)
+	{
+		const i32 index = (Max(m_current, 0) + offset) % GetCount();
+		Entry*    entry = m_entries[index];
+
+		if (!entry->baked && !entry->loadFailed && !IsDecoding(*entry) && GetMemoryUsage() + environmentSize <= memoryBudget)
+		{
+			StartDecode(entry);
+			return;
+		}
+	}
+}
+
+Environment* EnvironmentLibrary::GetCurrent()
+{
+	return m_current >= 0 ? &m_entries[m_current]->env : &m_empty;
+}
+
+i32 EnvironmentLibrary::GetCurrentIndex() const
+{
+	return m_current;
+}
+
+i32 EnvironmentLibrary::GetCount() const
+{
+	return (i32)m_entries.size();
+}
+
+const char* EnvironmentLibrary::GetName(i32 index) const
+{
+	return m_entries[index]->name.c_str();
+}
+
+bool EnvironmentLibrary::IsBaked(i32 index) const
+{
+	return m_entries[index]->baked;
+}
+
+u64 EnvironmentLibrary::GetMemoryUsage() const
+{
+	u64 count = 0;
+	for (const Entry* entry : m_entries)
+	{
+		count += entry->baked ? 1 : 0;
+	}
+
+	return count * GetEnvironmentMemorySize();
+}
+
+bool EnvironmentLibrary::IsDecoding(const Entry& entry) const
+{
+	return entry.decode.valid();
+}
+
+bool EnvironmentLibrary::IsCandidate(i32 index) const
+{
+	for (i32 offset = 1; offset <= preloadCount && offset < GetCount(); ++offset)
+	{
+		if ((Max(m_current, 0) + offset) % GetCount() == index)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void EnvironmentLibrary::StartDecode(Entry* entry)
+{
+	entry->decode = std::async(std::launch::async, [entry] {
+		Timer            timer;
+		EnvironmentImage image;
+		LoadEnvironmentImage(entry->filename.c_str(), &image);
+		entry->decodeTime = timer.Tick();
+		return image;
+	});
+}
+
+void EnvironmentLibrary::Bake(Entry* entry, EnvironmentImage* image)
+{
+	BakeEnvironment(*image, &entry->env);
+	FreeEnvironmentImage(image);
+
+	entry->baked      = true;
+	entry->loadFailed = false;
+	entry->lastUsed   = m_frame;
+
+	FrameStats::Get()->ibl.loadTexture = entry->decodeTime;
+}
+
+bool EnvironmentLibrary::MakeRoom(i32 keepIndex, bool keepCandidates)
+{
+	const u64 environmentSize = GetEnvironmentMemorySize();
+
+	while (GetMemoryUsage() + environmentSize > memoryBudget)
+	{
+		// Evict the least recently used environment, never the current one
+		Entry* victim = nullptr;
+
+		for (i32 i = 0; i < GetCount(); ++i)
+		{
+			Entry* entry = m_entries[i];
+
+			if (!entry->baked || i == m_current || i == keepIndex || (keepCandidates && IsCandidate(i)))
+			{
+				continue;
+			}
+
+			if (victim == nullptr || entry->lastUsed < victim->lastUsed)
+			{
+				victim = entry;
+			}
+		}
+
+		if (victim == nullptr)
+		{
+			// Explicit selections may go over budget, preloads may not
+			return !keepCandidates;
+		}
+
+		DestroyEnvironment(&victim->env);
+		victim->baked = false;
+	}
+
+	return true;
+}
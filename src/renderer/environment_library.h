@@ -0,0 +1,72 @@
+#pragma once
+
+#include "renderer/environment.h"
+
+#include "core/defines.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+// Keeps several baked environments alive under a GPU memory budget, so that switching between them
+// only changes the textures that get bound. The next candidates are decoded in the background and
+// baked on the GL thread, at most one per frame.
+class EnvironmentLibrary
+{
+public:
+	void Initialize(u32 iblDFG);
+	void Shutdown();
+
+	// Adds every .hdr file of the directory
+	void AddDirectory(const char* directory);
+	i32  Add(const char* filename);
+	// Index of the environment whose file stem is name, -1 if none
+	i32 Find(const char* name) const;
+
+	void Select(i32 index);
+
+	// Called once per frame from the GL thread
+	void Update();
+
+	Environment* GetCurrent();
+
+	i32         GetCurrentIndex() const;
+	i32         GetCount() const;
+	const char* GetName(i32 index) const;
+	bool        IsBaked(i32 index) const;
+	u64         GetMemoryUsage() const;
+
+public:
+	u64 memoryBudget = 1024ull * 1024 * 1024;
+	i32 preloadCount = 2;
+
+private:
+	struct Entry
+	{
+		std::string filename;
+		std::string name;
+
+		Environment env;
+		bool        baked      = false;
+		bool        loadFailed = false; // Skipped by the preloading
+		u64         lastUsed   = 0;
+		f64         decodeTime = 0.0;
+
+		std::future<EnvironmentImage> decode;
+	};
+
+	bool IsDecoding(const Entry& entry) const;
+	bool IsCandidate(i32 index) const;
+	void StartDecode(Entry* entry);
+	void Bake(Entry* entry, EnvironmentImage* image);
+	bool MakeRoom(i32 keepIndex, bool keepCandidates);
+
+private:
+	std::vector<Entry*> m_entries;
+
+	i32 m_current = -1;
+	u64 m_frame   = 0;
+	u32 m_iblDFG  = 0;
+
+	Environment m_empty;
+};
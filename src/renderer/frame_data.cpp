@@ -0,0 +1,114 @@
+#include "frame_data.h"
+
+#include "core/utils.h"
+
+#include <string.h>
+
+inline GLsizeiptr AlignUp(GLsizeiptr size, GLsizeiptr align)
+{
+	return (size + align - 1) / align * align;
+}
+
+void FrameDataBuffer::Begin(const FrameData& frameData, u32 drawCount, u32 materialCount)
+{
+	if (drawCount > m_drawCapacity || materialCount > m_materialCapacity || m_buffer == 0)
+	{
+		const u32 drawCapacity     = drawCount > m_drawCapacity ? Max(drawCount, m_drawCapacity * 2) : m_drawCapacity;
+		const u32 materialCapacity = materialCount > m_materialCapacity ? Max(materialCount, m_materialCapacity * 2) : m_materialCapacity;
+
+		Allocate(Max(drawCapacity, 256u), Max(materialCapacity, 64u));
+	}
+
+	GLsync& fence = m_fences[m_frame];
+	if (fence != nullptr)
+	{
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	u8* region = m_data + m_frame * m_regionSize;
+	memcpy(region, &frameData, sizeof(FrameData));
+}
+
+DrawData* FrameDataBuffer::GetDrawData()
+{
+	return (DrawData*)(m_data + m_frame * m_regionSize + m_drawOffset);
+}
+
+MaterialData* FrameDataBuffer::GetMaterialData()
+{
+	return (MaterialData*)(m_data + m_frame * m_regionSize + m_materialOffset);
+}
+
+void FrameDataBuffer::Bind()
+{
+	const GLsizeiptr offset = m_frame * m_regionSize;
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, FrameDataBinding, m_buffer, offset, sizeof(FrameData));
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DrawDataBinding, m_buffer, offset + m_drawOffset, m_drawCapacity * sizeof(DrawData));
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, MaterialDataBinding, m_buffer, offset + m_materialOffset, m_materialCapacity * sizeof(MaterialData));
+}
+
+void FrameDataBuffer::End()
+{
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_frame           = (m_frame + 1) % FrameCount;
+}
+
+void FrameDataBuffer::Allocate(u32 drawCapacity, u32 materialCapacity)
+{
+	// The previous buffer may still be read by frames in flight
+	for (GLsync& fence : m_fences)
+	{
+		if (fence != nullptr)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+	}
+
+	Release();
+
+	GLint uniformAlignment = 0, storageAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+	const GLsizeiptr alignment = Max(uniformAlignment, storageAlignment);
+
+	m_drawCapacity     = drawCapacity;
+	m_materialCapacity = materialCapacity;
+	m_drawOffset       = AlignUp(sizeof(FrameData), alignment);
+	m_materialOffset   = AlignUp(m_drawOffset + drawCapacity * sizeof(DrawData), alignment);
+	m_regionSize       = AlignUp(m_materialOffset + materialCapacity * sizeof(MaterialData), alignment);
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &m_buffer);
+	glNamedBufferStorage(m_buffer, m_regionSize * FrameCount, nullptr, flags);
+	m_data = (u8*)glMapNamedBufferRange(m_buffer, 0, m_regionSize * FrameCount, flags);
+}
+
+void FrameDataBuffer::Release()
+{
+	for (GLsync& fence : m_fences)
+	{
+		if (fence != nullptr)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (m_buffer != 0)
+	{
+		glUnmapNamedBuffer(m_buffer);
+		glDeleteBuffers(1, &m_buffer);
+	}
+
+	m_buffer = 0;
+	m_data   = nullptr;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Mirrors resources/shaders/frame_data.glsl
+
+constexpr u32 FrameDataBinding    = 0; // Uniform buffer
+constexpr u32 DrawDataBinding     = 1; // Shader storage buffer
+constexpr u32 MaterialDataBinding = 2; // Shader storage buffer
+
+constexpr u32 MaterialTextureCount = 7;
+constexpr u32 ShadowCascadeCount   = 4;
+
+// std140
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::vec3 eyePosition;
+	f32       padding0;
+	glm::vec3 lightDirection; // Direction the directional light travels along
+	f32       padding1;
+	glm::vec4 lightColor; // Color times intensity of the directional light
+	glm::vec4 frustumPlanes[6]; // See Frustum in culling.h
+
+	// See ClusteredLighting
+	glm::vec4  clusterScaleBias; // xy: pixels to cluster, z: log depth scale, w: log depth bias
+	glm::uvec4 clusterGrid;      // xyz: cluster counts, w: light count
+
+	// See ShadowMaps, all 0 when the directional light casts no shadows
+	glm::mat4 shadowMatrices[ShadowCascadeCount]; // World to shadow map texture coordinates and depth
+	glm::vec4 shadowSplits;                       // View depth where each cascade ends
+	glm::vec4 shadowTexelSize;                    // World size of a texel of each cascade
+};
+
+// std430, indexed by the draw base instance
+struct DrawData
+{
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+	u32       materialIndex;
+	u32       padding[3];
+};
+
+// std430, indexed by DrawData::materialIndex
+struct MaterialData
+{
+	glm::vec4 albedo;
+	glm::vec4 emissive; // rgb: emissive, a: emissive factor
+	f32       roughness;
+	f32       metallic;
+	u32       mask;
+	u32       padding0;
+	u64       textures[MaterialTextureCount]; // Bindless handles indexed by TextureUnit, 0 when not bindless
+	u64       padding1;
+};
+
+static_assert(sizeof(FrameData) == 592);
+static_assert(sizeof(DrawData) == 144);
+static_assert(sizeof(MaterialData) == 112);
+
+// Persistently mapped ring holding the frame, draw and material data of the frames in flight.
+// Each frame writes its own region and fences it, so the CPU never waits unless it gets
+// FrameCount frames ahead of the GPU.
+class FrameDataBuffer
+{
+public:
+	static constexpr u32 FrameCount = 3;
+
+	// Waits for the region of the current frame, grows the buffer if needed
+	void Begin(const FrameData& frameData, u32 drawCount, u32 materialCount);
+
+	DrawData*     GetDrawData();
+	MaterialData* GetMaterialData();
+
+	// Binds the region of the current frame, then fences it
+	void Bind();
+	void End();
+
+private:
+	void Allocate(u32 drawCapacity, u32 materialCapacity);
+	void Release();
+
+private:
+	GLuint m_buffer           = 0;
+	u8*    m_data             = nullptr;
+	u32    m_drawCapacity     = 0;
+	u32    m_materialCapacity = 0;
+
+	// From the start of a region
+	GLsizeiptr m_drawOffset     = 0;
+	GLsizeiptr m_materialOffset = 0;
+	GLsizeiptr m_regionSize     = 0;
+
+	u32    m_frame              = 0;
+	GLsync m_fences[FrameCount] = {};
+};
@@ -0,0 +1,241 @@
+#include "frame_graph.h"
+
+#include "renderer/frame_stats.h"
+
+#include <algorithm>
+
+void FrameGraph::Reset()
+{
+	m_resources.clear();
+	m_passes.clear();
+	m_exports.clear();
+
+	m_finalBarriers = 0;
+}
+
+FrameGraphResource FrameGraph::Import(const char* name, GLuint texture)
+{
+	m_resources.push_back({.name = name, .desc = {}, .texture = texture, .transient = false});
+	return (FrameGraphResource)m_resources.size() - 1;
+}
+
+FrameGraphResource FrameGraph::Create(const char* name, const RenderTargetDesc& desc)
+{
+	m_resources.push_back({.name = name, .desc = desc, .texture = 0, .transient = true});
+	return (FrameGraphResource)m_resources.size() - 1;
+}
+
+void FrameGraph::Export(FrameGraphResource resource, ResourceAccess nextAccess)
+{
+	m_exports.push_back({resource, nextAccess});
+}
+
+void FrameGraph::AddPass(const char* name, std::vector<FrameGraphUse> reads, std::vector<FrameGraphUse> writes, ExecuteFunc execute)
+{
+	Pass pass = {
+	    .name    = name,
+	    .reads   = std::move(reads),
+	    .writes  = std::move(writes),
+	    .execute = std::move(execute),
+	};
+
+	m_passes.push_back(std::move(pass));
+}
+
+GLbitfield FrameGraph::GetBarrierBit(ResourceAccess access)
+{
+	switch (access)
+	{
+		case ResourceAccess_Sampled:
+			return GL_TEXTURE_FETCH_BARRIER_BIT;
+
+		case ResourceAccess_ImageLoad:
+		case ResourceAccess_ImageStore:
+			return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+
+		case ResourceAccess_Framebuffer:
+			return GL_FRAMEBUFFER_BARRIER_BIT;
+	}
+
+	return GL_ALL_BARRIER_BITS;
+}
+
+void FrameGraph::Compile()
+{
+	const i32 passCount = (i32)m_passes.size();
+
+	// Walking back from the exports, a pass is needed when it writes something a later needed pass
+	// reads. Earlier contents of a texture are kept alive too, since a pass may only write part of it
+	std::vector<u8> needed(m_resources.size(), 0);
+
+	for (const FrameGraphUse& use : m_exports)
+	{
+		needed[use.resource] = 1;
+	}
+
+	for (i32 i = passCount - 1; i >= 0; --i)
+	{
+		Pass& pass = m_passes[i];
+
+		pass.culled = std::none_of(pass.writes.begin(), pass.writes.end(), [&](const FrameGraphUse& use) { return needed[use.resource] != 0; });
+
+		if (!pass.culled)
+		{
+			for (const FrameGraphUse& use : pass.reads)
+			{
+				needed[use.resource] = 1;
+			}
+		}
+	}
+
+	for (Resource& resource : m_resources)
+	{
+		resource.firstPass = -1;
+		resource.lastPass  = -1;
+	}
+
+	// Bits each resource still waits for since its last imageStore(), a barrier makes them visible to every resource
+	std::vector<GLbitfield> pending(m_resources.size(), 0);
+
+	const auto require = [&](const FrameGraphUse& use) -> GLbitfield {
+		return pending[use.resource] & GetBarrierBit(use.access);
+	};
+
+	const auto issue = [&](GLbitfield barriers) {
+		for (GLbitfield& bits : pending)
+		{
+			bits &= ~barriers;
+		}
+	};
+
+	u32 culledCount  = 0;
+	u32 barrierCount = 0;
+
+	for (i32 i = 0; i < passCount; ++i)
+	{
+		Pass& pass = m_passes[i];
+
+		if (pass.culled)
+		{
+			++culledCount;
+			continue;
+		}
+
+		pass.barriers = 0;
+
+		// Writes after an imageStore() wait as well, so that they land in order
+		for (const FrameGraphUse& use : pass.reads)
+		{
+			pass.barriers |= require(use);
+		}
+
+		for (const FrameGraphUse& use : pass.writes)
+		{
+			pass.barriers |= require(use);
+		}
+
+		issue(pass.barriers);
+
+		if (pass.barriers != 0)
+		{
+			++barrierCount;
+		}
+
+		// Anything may read the stored texels next, the barrier is only known once that reader is
+		for (const FrameGraphUse& use : pass.writes)
+		{
+			if (use.access == ResourceAccess_ImageStore)
+			{
+				pending[use.resource] = GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT;
+			}
+		}
+
+		for (const std::vector<FrameGraphUse>* uses : {&pass.reads, &pass.writes})
+		{
+			for (const FrameGraphUse& use : *uses)
+			{
+				Resource& resource = m_resources[use.resource];
+
+				resource.firstPass = resource.firstPass < 0 ? i : resource.firstPass;
+				resource.lastPass  = i;
+			}
+		}
+	}
+
+	for (const FrameGraphUse& use : m_exports)
+	{
+		m_finalBarriers |= require(use);
+	}
+
+	if (m_finalBarriers != 0)
+	{
+		++barrierCount;
+	}
+
+	FrameStats* stats = FrameStats::Get();
+
+	stats->frameGraph.passes       = (u32)passCount - culledCount;
+	stats->frameGraph.culledPasses = culledCount;
+	stats->frameGraph.barriers     = barrierCount;
+}
+
+void FrameGraph::Execute()
+{
+	RenderTargetPool* pool = RenderTargetPool::Get();
+
+	u32 transients = 0;
+
+	// Distinct textures handed to the transients, less than the transients when some were aliased
+	std::vector<GLuint> textures;
+
+	for (i32 i = 0; i < (i32)m_passes.size(); ++i)
+	{
+		const Pass& pass = m_passes[i];
+
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		for (Resource& resource : m_resources)
+		{
+			if (resource.transient && resource.firstPass == i)
+			{
+				resource.texture = pool->Acquire(resource.desc);
+				++transients;
+
+				if (std::find(textures.begin(), textures.end(), resource.texture) == textures.end())
+				{
+					textures.push_back(resource.texture);
+				}
+			}
+		}
+
+		if (pass.barriers != 0)
+		{
+			glMemoryBarrier(pass.barriers);
+		}
+
+		pass.execute();
+
+		// Free for the transients of the next passes
+		for (Resource& resource : m_resources)
+		{
+			if (resource.transient && resource.lastPass == i)
+			{
+				pool->Release(resource.texture);
+				resource.texture = 0;
+			}
+		}
+	}
+
+	if (m_finalBarriers != 0)
+	{
+		glMemoryBarrier(m_finalBarriers);
+	}
+
+	FrameStats* stats = FrameStats::Get();
+
+	stats->frameGraph.transients        = transients;
+	stats->frameGraph.transientTextures = (u32)textures.size();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "renderer/render_target_pool.h"
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <vector>
+
+using FrameGraphResource = u32;
+
+// How a pass touches a texture, decides the memory barrier a later access needs
+enum ResourceAccess
+{
+	ResourceAccess_Sampled,     // texture() or texelFetch()
+	ResourceAccess_ImageLoad,   // imageLoad()
+	ResourceAccess_ImageStore,  // imageStore(), the only write that is not synchronized by GL
+	ResourceAccess_Framebuffer, // Attachment, blit source or destination
+};
+
+struct FrameGraphUse
+{
+	FrameGraphResource resource;
+	ResourceAccess     access;
+};
+
+// Passes declare the textures they read and write, then the graph is compiled every frame:
+// - passes whose writes nothing needs are culled, along with the transients only they use,
+// - a pass only waits for the barrier bits matching how it reads what the previous passes stored,
+// - transients are taken from the RenderTargetPool right before their first use and given back
+//   right after their last one, so that transients of the same desc that do not overlap share
+//   a texture.
+class FrameGraph
+{
+public:
+	using ExecuteFunc = std::function<void()>;
+
+	// Starts recording a new frame
+	void Reset();
+
+	// Texture owned outside of the graph, kept as is
+	FrameGraphResource Import(const char* name, GLuint texture);
+	// Texture only living during the frame
+	FrameGraphResource Create(const char* name, const RenderTargetDesc& desc);
+	// Read after the graph, the passes writing it are never culled
+	void Export(FrameGraphResource resource, ResourceAccess nextAccess);
+
+	void AddPass(const char* name, std::vector<FrameGraphUse> reads, std::vector<FrameGraphUse> writes, ExecuteFunc execute);
+
+	void Compile();
+	void Execute();
+
+	// Only valid while executing a pass using the resource
+	GLuint GetTexture(FrameGraphResource resource) const
+	{
+		return m_resources[resource].texture;
+	}
+
+private:
+	struct Resource
+	{
+		const char*      name;
+		RenderTargetDesc desc;
+		GLuint           texture;
+		bool             transient;
+
+		// Compiled
+		i32 firstPass;
+		i32 lastPass;
+	};
+
+	struct Pass
+	{
+		const char*                name;
+		std::vector<FrameGraphUse> reads;
+		std::vector<FrameGraphUse> writes;
+		ExecuteFunc                execute;
+
+		// Compiled
+		bool       culled;
+		GLbitfield barriers; // Issued right before the pass
+	};
+
+	static GLbitfield GetBarrierBit(ResourceAccess access);
+
+private:
+	std::vector<Resource>      m_resources;
+	std::vector<Pass>          m_passes;
+	std::vector<FrameGraphUse> m_exports;
+
+	GLbitfield m_finalBarriers = 0;
+};
@@ -14,24 +14,92 @@ struct FrameStats
 		f64 prefilter     = 0.0;
 		f64 irradiance    = 0.0;
 		f64 total         = 0.0;
+
+		f64 switchEnvironment = 0.0;
 	} ibl;
 
 	f64 loadScene = 0.0;
 
+	struct
+	{
+		f64 build = 0.0;
+		f64 refit = 0.0;
+		u32 nodes = 0;
+	} bvh;
+
+	struct
+	{
+		f64 buildTime   = 0.0;
+		u32 cacheHits   = 0;
+		u32 cacheMisses = 0;
+
+		u32 warmupVariants = 0;
+		f64 warmupWait     = 0.0;
+	} programs;
+
 	struct
 	{
 		f64 updatePrograms       = 0.0;
+		f64 culling              = 0.0;
+		f64 softwareOcclusion    = 0.0;
+		f64 shadows              = 0.0;
+		f64 lightCulling         = 0.0;
 		f64 zPrepass             = 0.0;
 		f64 renderModels         = 0.0;
+		f64 depthPyramid         = 0.0;
 		f64 background           = 0.0;
 		f64 resolveMSAA          = 0.0;
+		f64 taa                  = 0.0;
 		f64 highpassAndLuminance = 0.0;
 		f64 bloomDownsample      = 0.0;
 		f64 bloomUpsample        = 0.0;
 		f64 bloomTotal           = 0.0;
 		f64 finalCompositing     = 0.0;
+
+		u32 visibleModels = 0;
+		u32 culledModels  = 0;
+
+		u32 occludedModels = 0;
+
+		// GPU-driven path, instances drawn before and after the depth pyramid
+		u32 earlyDraws = 0;
+		u32 lateDraws  = 0;
+
+		// CPU path, software occlusion
+		u32 occluders         = 0;
+		u32 occluderTriangles = 0;
+
+		u32 lights = 0;
+
+		// Cascades rendered again this frame, the others were cached
+		u32 shadowCascades = 0;
+		u32 shadowDraws    = 0;
+
+		u32 programChanges  = 0;
+		u32 materialChanges = 0;
+		u32 meshChanges     = 0;
+		u32 drawCalls       = 0;
+
+		u32 glCallsIssued = 0;
+		u32 glCallsElided = 0;
 	} frame;
 
+	struct
+	{
+		u32 textures    = 0;
+		u32 allocations = 0; // Since startup, steady while resizing within the size class
+		f64 memory      = 0.0; // MB
+	} renderTargets;
+
+	struct
+	{
+		u32 passes            = 0;
+		u32 culledPasses      = 0;
+		u32 barriers          = 0;
+		u32 transients        = 0;
+		u32 transientTextures = 0; // Below transients when some share a texture
+	} frameGraph;
+
 	f64 renderTotal = 0.0;
 	f64 frameTotal  = 0.0;
 
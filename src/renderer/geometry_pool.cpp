@@ -0,0 +1,106 @@
+#include "geometry_pool.h"
+
+#include "renderer/renderer.h"
+
+#include "core/utils.h"
+
+#include <stddef.h>
+
+#include <vector>
+
+GeometryPool* GeometryPool::Get()
+{
+	static GeometryPool pool;
+	return &pool;
+}
+
+void GeometryPool::Initialize()
+{
+	glCreateVertexArrays(1, &m_vao);
+
+	const struct
+	{
+		BindingPoint bindingPoint;
+		ElementType  elementType;
+		u32          offset;
+	} attributes[] = {
+	    {BindingPoint_Position, ElementType_Vec3, offsetof(Vertex, position)},
+	    {BindingPoint_Normal, ElementType_Vec3, offsetof(Vertex, normal)},
+	    {BindingPoint_Texcoord0, ElementType_Vec2, offsetof(Vertex, texcoord)},
+	};
+
+	for (const auto& attribute : attributes)
+	{
+		glEnableVertexArrayAttrib(m_vao, attribute.bindingPoint);
+		glVertexArrayAttribFormat(m_vao, attribute.bindingPoint, attribute.elementType, GL_FLOAT, GL_FALSE, attribute.offset);
+		glVertexArrayAttribBinding(m_vao, attribute.bindingPoint, 0);
+	}
+
+	glCreateVertexArrays(1, &m_depthVao);
+	glEnableVertexArrayAttrib(m_depthVao, BindingPoint_Position);
+	glVertexArrayAttribFormat(m_depthVao, BindingPoint_Position, ElementType_Vec3, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(m_depthVao, BindingPoint_Position, 0);
+}
+
+void GeometryPool::Grow(GLuint* buffer, u32* capacity, u32 used, u32 required, u32 elementSize)
+{
+	const u32 newCapacity = Max(required, Max(*capacity * 2, 1u << 16));
+
+	GLuint newBuffer;
+	glCreateBuffers(1, &newBuffer);
+	glNamedBufferStorage(newBuffer, (GLsizeiptr)newCapacity * elementSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	if (*buffer != 0)
+	{
+		glCopyNamedBufferSubData(*buffer, newBuffer, 0, 0, (GLsizeiptr)used * elementSize);
+		glDeleteBuffers(1, buffer);
+	}
+
+	*buffer   = newBuffer;
+	*capacity = newCapacity;
+}
+
+GeometryRange GeometryPool::Add(const Vertex* vertices, u32 vertexCount, const u32* indices, u32 indexCount)
+{
+	if (m_vao == 0)
+	{
+		Initialize();
+	}
+
+	if (m_vertexCount + vertexCount > m_vertexCapacity)
+	{
+		Grow(&m_vertexBuffer, &m_vertexCapacity, m_vertexCount, m_vertexCount + vertexCount, sizeof(Vertex));
+		glVertexArrayVertexBuffer(m_vao, 0, m_vertexBuffer, 0, sizeof(Vertex));
+
+		Grow(&m_positionBuffer, &m_positionCapacity, m_vertexCount, m_vertexCount + vertexCount, sizeof(glm::vec3));
+		glVertexArrayVertexBuffer(m_depthVao, 0, m_positionBuffer, 0, sizeof(glm::vec3));
+	}
+
+	if (m_indexCount + indexCount > m_indexCapacity)
+	{
+		Grow(&m_indexBuffer, &m_indexCapacity, m_indexCount, m_indexCount + indexCount, sizeof(u32));
+		glVertexArrayElementBuffer(m_vao, m_indexBuffer);
+		glVertexArrayElementBuffer(m_depthVao, m_indexBuffer);
+	}
+
+	std::vector<glm::vec3> positions(vertexCount);
+	for (u32 i = 0; i < vertexCount; ++i)
+	{
+		positions[i] = vertices[i].position;
+	}
+
+	glNamedBufferSubData(m_vertexBuffer, (GLintptr)m_vertexCount * sizeof(Vertex), (GLsizeiptr)vertexCount * sizeof(Vertex), vertices);
+	glNamedBufferSubData(m_positionBuffer, (GLintptr)m_vertexCount * sizeof(glm::vec3), (GLsizeiptr)vertexCount * sizeof(glm::vec3), positions.data());
+	glNamedBufferSubData(m_indexBuffer, (GLintptr)m_indexCount * sizeof(u32), (GLsizeiptr)indexCount * sizeof(u32), indices);
+
+	const GeometryRange range = {
+	    .firstIndex = m_indexCount,
+	    .indexCount = indexCount,
+	    .baseVertex = (i32)m_vertexCount,
+	};
+
+	m_vertexCount += vertexCount;
+	m_indexCount += indexCount;
+
+	return range;
+}
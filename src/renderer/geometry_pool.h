@@ -0,0 +1,59 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+struct Vertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texcoord;
+};
+
+struct GeometryRange
+{
+	u32 firstIndex;
+	u32 indexCount;
+	i32 baseVertex;
+};
+
+// Vertices and 32 bit indices of every imported mesh, packed in two buffers behind a single VAO
+// so that one multi-draw can reference any mesh. The positions are also kept in their own tightly
+// packed stream, behind a second VAO sharing the indices, for depth-only passes.
+class GeometryPool
+{
+public:
+	static GeometryPool* Get();
+
+	GeometryRange Add(const Vertex* vertices, u32 vertexCount, const u32* indices, u32 indexCount);
+
+	GLuint GetVertexArray() const
+	{
+		return m_vao;
+	}
+
+	GLuint GetDepthVertexArray() const
+	{
+		return m_depthVao;
+	}
+
+private:
+	void Initialize();
+	// Reallocates the buffer to fit at least required elements, keeping the first used ones
+	void Grow(GLuint* buffer, u32* capacity, u32 used, u32 required, u32 elementSize);
+
+private:
+	GLuint m_vao            = 0;
+	GLuint m_depthVao       = 0;
+	GLuint m_vertexBuffer   = 0;
+	GLuint m_positionBuffer = 0;
+	GLuint m_indexBuffer    = 0;
+
+	u32 m_vertexCount      = 0;
+	u32 m_vertexCapacity   = 0;
+	u32 m_positionCapacity = 0;
+	u32 m_indexCount       = 0;
+	u32 m_indexCapacity    = 0;
+};
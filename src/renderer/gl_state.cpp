@@ -0,0 +1,241 @@
+#include "gl_state.h"
+
+constexpr u32    TextureUnitCount = 16;
+constexpr u32    ImageUnitCount   = 8;
+constexpr GLuint UnknownObject    = ~0u;
+constexpr GLenum UnknownEnum      = ~0u;
+
+enum TriState : i8
+{
+	TriState_Unknown = -1,
+	TriState_False   = 0,
+	TriState_True    = 1,
+};
+
+struct ImageBinding
+{
+	GLuint texture;
+	i32    level;
+	bool   layered;
+	i32    layer;
+	GLenum access;
+	GLenum format;
+
+	bool operator==(const ImageBinding& other) const = default;
+};
+
+struct StateCache
+{
+	GLuint program;
+	GLuint vao;
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+
+	GLuint       textures[TextureUnitCount];
+	ImageBinding images[ImageUnitCount];
+
+	TriState depthTest;
+	TriState depthMask;
+	TriState colorMask;
+	TriState blend;
+	GLenum   depthFunc;
+	GLenum   blendSrc;
+	GLenum   blendDst;
+
+	u32 issued;
+	u32 elided;
+};
+
+global_variable StateCache g_state;
+
+// Returns true when the call has to be issued
+inline bool Track(bool changed)
+{
+	if (changed)
+	{
+		++g_state.issued;
+	}
+	else
+	{
+		++g_state.elided;
+	}
+
+	return changed;
+}
+
+inline TriState ToTriState(bool value)
+{
+	return value ? TriState_True : TriState_False;
+}
+
+namespace GLState
+{
+void Invalidate()
+{
+	g_state.program         = UnknownObject;
+	g_state.vao             = UnknownObject;
+	g_state.drawFramebuffer = UnknownObject;
+	g_state.readFramebuffer = UnknownObject;
+
+	for (GLuint& texture : g_state.textures)
+	{
+		texture = UnknownObject;
+	}
+
+	for (ImageBinding& image : g_state.images)
+	{
+		image = {.texture = UnknownObject};
+	}
+
+	g_state.depthTest = TriState_Unknown;
+	g_state.depthMask = TriState_Unknown;
+	g_state.colorMask = TriState_Unknown;
+	g_state.blend     = TriState_Unknown;
+	g_state.depthFunc = UnknownEnum;
+	g_state.blendSrc  = UnknownEnum;
+	g_state.blendDst  = UnknownEnum;
+
+	g_state.issued = 0;
+	g_state.elided = 0;
+}
+
+void UseProgram(GLuint program)
+{
+	if (Track(g_state.program != program))
+	{
+		glUseProgram(program);
+		g_state.program = program;
+	}
+}
+
+void BindVertexArray(GLuint vao)
+{
+	if (Track(g_state.vao != vao))
+	{
+		glBindVertexArray(vao);
+		g_state.vao = vao;
+	}
+}
+
+void BindTextureUnit(u32 unit, GLuint texture)
+{
+	if (unit >= TextureUnitCount)
+	{
+		Track(true);
+		glBindTextureUnit(unit, texture);
+	}
+	else if (Track(g_state.textures[unit] != texture))
+	{
+		glBindTextureUnit(unit, texture);
+		g_state.textures[unit] = texture;
+	}
+}
+
+void BindImageTexture(u32 unit, GLuint texture, i32 level, bool layered, i32 layer, GLenum access, GLenum format)
+{
+	const ImageBinding binding = {texture, level, layered, layer, access, format};
+
+	if (unit >= ImageUnitCount)
+	{
+		Track(true);
+		glBindImageTexture(unit, texture, level, layered, layer, access, format);
+	}
+	else if (Track(g_state.images[unit] != binding))
+	{
+		glBindImageTexture(unit, texture, level, layered, layer, access, format);
+		g_state.images[unit] = binding;
+	}
+}
+
+void BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	const bool draw = target != GL_READ_FRAMEBUFFER;
+	const bool read = target != GL_DRAW_FRAMEBUFFER;
+
+	const bool changed = (draw && g_state.drawFramebuffer != framebuffer) || (read && g_state.readFramebuffer != framebuffer);
+
+	if (Track(changed))
+	{
+		glBindFramebuffer(target, framebuffer);
+
+		if (draw)
+			g_state.drawFramebuffer = framebuffer;
+		if (read)
+			g_state.readFramebuffer = framebuffer;
+	}
+}
+
+void SetDepthTest(bool enabled)
+{
+	if (Track(g_state.depthTest != ToTriState(enabled)))
+	{
+		if (enabled)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+
+		g_state.depthTest = ToTriState(enabled);
+	}
+}
+
+void SetDepthFunc(GLenum func)
+{
+	if (Track(g_state.depthFunc != func))
+	{
+		glDepthFunc(func);
+		g_state.depthFunc = func;
+	}
+}
+
+void SetDepthMask(bool enabled)
+{
+	if (Track(g_state.depthMask != ToTriState(enabled)))
+	{
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		g_state.depthMask = ToTriState(enabled);
+	}
+}
+
+void SetColorMask(bool enabled)
+{
+	if (Track(g_state.colorMask != ToTriState(enabled)))
+	{
+		const GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+		glColorMask(mask, mask, mask, mask);
+		g_state.colorMask = ToTriState(enabled);
+	}
+}
+
+void SetBlend(bool enabled)
+{
+	if (Track(g_state.blend != ToTriState(enabled)))
+	{
+		if (enabled)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+
+		g_state.blend = ToTriState(enabled);
+	}
+}
+
+void SetBlendFunc(GLenum src, GLenum dst)
+{
+	if (Track(g_state.blendSrc != src || g_state.blendDst != dst))
+	{
+		glBlendFunc(src, dst);
+		g_state.blendSrc = src;
+		g_state.blendDst = dst;
+	}
+}
+
+u32 GetIssuedCount()
+{
+	return g_state.issued;
+}
+
+u32 GetElidedCount()
+{
+	return g_state.elided;
+}
+}
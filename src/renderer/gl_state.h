@@ -0,0 +1,31 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+
+// Shadows the bits of GL state the renderer touches every frame so that binding what is
+// already bound costs nothing. Everything going through these wrappers must not be changed
+// behind their back, call Invalidate() after code that does (ImGui for instance).
+namespace GLState
+{
+void Invalidate();
+
+void UseProgram(GLuint program);
+void BindVertexArray(GLuint vao);
+void BindTextureUnit(u32 unit, GLuint texture);
+void BindImageTexture(u32 unit, GLuint texture, i32 level, bool layered, i32 layer, GLenum access, GLenum format);
+void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+void SetDepthTest(bool enabled);
+void SetDepthFunc(GLenum func);
+void SetDepthMask(bool enabled);
+// All channels at once
+void SetColorMask(bool enabled);
+void SetBlend(bool enabled);
+void SetBlendFunc(GLenum src, GLenum dst);
+
+// GL calls issued and skipped since the last Invalidate()
+u32 GetIssuedCount();
+u32 GetElidedCount();
+}
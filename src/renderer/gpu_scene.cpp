@@ -0,0 +1,337 @@
+#include "gpu_scene.h"
+
+#include "renderer/depth_pyramid.h"
+#include "renderer/geometry_pool.h"
+#include "renderer/gl_state.h"
+#include "renderer/material.h"
+#include "renderer/program.h"
+#include "renderer/renderer.h"
+#include "renderer/texture.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unordered_map>
+
+constexpr u32 CullGroupSize = 64; // Matches local_size_x in cull_instances.comp.glsl
+
+bool GPUScene::IsSupported()
+{
+	return GLAD_GL_VERSION_4_6 && IsBindlessTextureSupported();
+}
+
+void GPUScene::Initialize()
+{
+	m_cullProgram = Program::MakeCompute("cullInstances", "cull_instances.comp.glsl");
+
+	// Each frame binds its own range, which must start on the offset alignment
+	GLint alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_statisticsStride = (sizeof(CullStatistics) + alignment - 1) / alignment * alignment;
+
+	// Read back by the CPU and cleared by it before each frame
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &m_statisticsBuffer);
+	glNamedBufferStorage(m_statisticsBuffer, StatisticsFrameCount * m_statisticsStride, nullptr, flags | GL_DYNAMIC_STORAGE_BIT);
+	m_statisticsData = (u8*)glMapNamedBufferRange(m_statisticsBuffer, 0, StatisticsFrameCount * m_statisticsStride, flags);
+
+	memset(m_statisticsData, 0, StatisticsFrameCount * m_statisticsStride);
+}
+
+void GPUScene::Shutdown()
+{
+	Release();
+
+	for (GLsync& fence : m_statisticsFences)
+	{
+		if (fence != nullptr)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (m_statisticsBuffer != 0)
+	{
+		glUnmapNamedBuffer(m_statisticsBuffer);
+		glDeleteBuffers(1, &m_statisticsBuffer);
+
+		m_statisticsBuffer = 0;
+		m_statisticsData   = nullptr;
+	}
+}
+
+void GPUScene::Release()
+{
+	GLuint buffers[] = {m_drawBuffer, m_instanceBuffer, m_commandBuffer, m_countBuffer, m_visibility};
+	glDeleteBuffers(5, buffers);
+
+	m_drawBuffer     = 0;
+	m_instanceBuffer = 0;
+	m_commandBuffer  = 0;
+	m_countBuffer    = 0;
+	m_visibility     = 0;
+}
+
+void GPUScene::Build(const std::vector<Model>& models, const std::vector<u32>& materialIndices, const std::vector<Material*>& materials, const SceneBounds& bounds)
+{
+	Release();
+
+	m_instanceCount = (u32)models.size();
+
+	m_materialMasks.resize(materials.size());
+	for (u32 i = 0; i < materials.size(); ++i)
+	{
+		m_materialMasks[i] = materials[i]->GetMask();
+	}
+
+	// One group per mask, the variant programs are shared by the materials with the same mask
+	std::unordered_map<u32, u32> groupsByMask;
+	std::vector<u32>             instanceGroups(m_instanceCount);
+
+	m_groups.clear();
+
+	for (u32 i = 0; i < m_instanceCount; ++i)
+	{
+		const u32 material = materialIndices[i];
+		auto [it, inserted] = groupsByMask.try_emplace(m_materialMasks[material], (u32)m_groups.size());
+
+		if (inserted)
+		{
+			m_groups.push_back({.material = materials[material], .commandOffset = 0, .instanceCount = 0});
+		}
+
+		instanceGroups[i] = it->second;
+		m_groups[it->second].instanceCount++;
+	}
+
+	// Each group owns a contiguous range of commands, large enough for all its instances
+	u32 commandOffset = 0;
+	for (DrawGroup& group : m_groups)
+	{
+		group.commandOffset = commandOffset;
+		commandOffset += group.instanceCount;
+	}
+
+	m_drawData.resize(m_instanceCount);
+	m_instances.resize(m_instanceCount);
+
+	for (u32 i = 0; i < m_instanceCount; ++i)
+	{
+		const Mesh*      mesh  = models[i].mesh;
+		const DrawGroup& group = m_groups[instanceGroups[i]];
+
+		m_drawData[i].materialIndex = materialIndices[i];
+
+		m_instances[i].firstIndex    = mesh->firstIndex;
+		m_instances[i].indexCount    = mesh->indexCount;
+		m_instances[i].baseVertex    = mesh->baseVertex;
+		m_instances[i].group         = instanceGroups[i];
+		m_instances[i].commandOffset = group.commandOffset;
+	}
+
+	if (m_instanceCount == 0)
+	{
+		return;
+	}
+
+	glCreateBuffers(1, &m_drawBuffer);
+	glNamedBufferStorage(m_drawBuffer, m_instanceCount * sizeof(DrawData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	glCreateBuffers(1, &m_instanceBuffer);
+	glNamedBufferStorage(m_instanceBuffer, m_instanceCount * sizeof(InstanceData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	// The late phase writes its own commands, the early ones may still be in use
+	glCreateBuffers(1, &m_commandBuffer);
+	glNamedBufferStorage(m_commandBuffer, 2 * m_instanceCount * sizeof(DrawElementsIndirectCommand), nullptr, 0);
+
+	glCreateBuffers(1, &m_countBuffer);
+	glNamedBufferStorage(m_countBuffer, 2 * m_groups.size() * sizeof(u32), nullptr, 0);
+
+	// Everything is assumed visible until the first occlusion test
+	const u32 visible = 1;
+	glCreateBuffers(1, &m_visibility);
+	glNamedBufferStorage(m_visibility, m_instanceCount * sizeof(u32), nullptr, 0);
+	glClearNamedBufferData(m_visibility, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &visible);
+
+	WriteInstances(models, bounds);
+}
+
+void GPUScene::UpdateTransforms(const std::vector<Model>& models, const SceneBounds& bounds)
+{
+	if (m_instanceCount == models.size() && m_instanceCount > 0)
+	{
+		WriteInstances(models, bounds);
+	}
+}
+
+void GPUScene::WriteInstances(const std::vector<Model>& models, const SceneBounds& bounds)
+{
+	for (u32 i = 0; i < m_instanceCount; ++i)
+	{
+		const glm::mat4& transform = models[i].worldTransform;
+
+		m_drawData[i].model        = transform;
+		m_drawData[i].normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(transform))));
+
+		m_instances[i].center = bounds.GetCenter(i);
+		m_instances[i].extent = bounds.GetExtent(i);
+	}
+
+	glNamedBufferSubData(m_drawBuffer, 0, m_instanceCount * sizeof(DrawData), m_drawData.data());
+	glNamedBufferSubData(m_instanceBuffer, 0, m_instanceCount * sizeof(InstanceData), m_instances.data());
+}
+
+bool GPUScene::IsOutdated(const std::vector<Material*>& materials) const
+{
+	if (materials.size() != m_materialMasks.size())
+	{
+		return true;
+	}
+
+	for (u32 i = 0; i < materials.size(); ++i)
+	{
+		if (materials[i]->GetMask() != m_materialMasks[i])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void GPUScene::BeginFrame()
+{
+	GLsync& fence = m_statisticsFences[m_statisticsFrame];
+	if (fence != nullptr)
+	{
+		// Written StatisticsFrameCount frames ago, the wait is almost always free
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		fence = nullptr;
+
+		memcpy(&m_statistics, m_statisticsData + m_statisticsFrame * m_statisticsStride, sizeof(CullStatistics));
+	}
+
+	memset(m_statisticsData + m_statisticsFrame * m_statisticsStride, 0, sizeof(CullStatistics));
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CullStatisticsBinding, m_statisticsBuffer, m_statisticsFrame * m_statisticsStride, sizeof(CullStatistics));
+}
+
+void GPUScene::EndFrame()
+{
+	glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+	m_statisticsFences[m_statisticsFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_statisticsFrame                     = (m_statisticsFrame + 1) % StatisticsFrameCount;
+}
+
+void GPUScene::Cull(CullPhase phase, const DepthPyramid* depthPyramid)
+{
+	if (m_instanceCount == 0)
+	{
+		return;
+	}
+
+	const u32 region     = phase == CullPhase_Late ? 1 : 0;
+	const u32 groupCount = (u32)m_groups.size();
+
+	glClearNamedBufferSubData(m_countBuffer, GL_R32UI, region * groupCount * sizeof(u32), groupCount * sizeof(u32), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	m_cullProgram->Bind();
+	m_cullProgram->SetUniform(UNIFORM("instanceCount"), m_instanceCount);
+	m_cullProgram->SetUniform(UNIFORM("phase"), (u32)phase);
+	m_cullProgram->SetUniform(UNIFORM("commandBase"), region * m_instanceCount);
+	m_cullProgram->SetUniform(UNIFORM("countBase"), region * groupCount);
+
+	if (phase == CullPhase_Late)
+	{
+		assert(depthPyramid != nullptr);
+
+		GLState::BindTextureUnit(0, depthPyramid->GetTexture());
+		m_cullProgram->SetUniform(UNIFORM("depthPyramidLevels"), depthPyramid->GetLevelCount());
+		m_cullProgram->SetUniform(UNIFORM("depthPyramidSize"), depthPyramid->GetSize());
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, InstanceDataBinding, m_instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawCommandBinding, m_commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawCountBinding, m_countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VisibilityBinding, m_visibility);
+
+	glDispatchCompute((m_instanceCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GPUScene::MultiDraw(CullPhase phase, u32 groupIndex) const
+{
+	const u32        region     = phase == CullPhase_Late ? 1 : 0;
+	const u32        groupCount = (u32)m_groups.size();
+	const DrawGroup& group      = m_groups[groupIndex];
+
+	const uintptr_t commandOffset = (uintptr_t)(region * m_instanceCount + group.commandOffset) * sizeof(DrawElementsIndirectCommand);
+	const GLintptr  countOffset   = (GLintptr)(region * groupCount + groupIndex) * sizeof(u32);
+
+	glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)commandOffset, countOffset, group.instanceCount, 0);
+}
+
+u32 GPUScene::Draw(CullPhase phase)
+{
+	if (m_instanceCount == 0)
+	{
+		return 0;
+	}
+
+	GLState::BindVertexArray(GeometryPool::Get()->GetVertexArray());
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glBindBuffer(GL_PARAMETER_BUFFER, m_countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawDataBinding, m_drawBuffer);
+
+	for (u32 i = 0; i < m_groups.size(); ++i)
+	{
+		m_groups[i].material->GetProgram()->Bind();
+		MultiDraw(phase, i);
+	}
+
+	return (u32)m_groups.size();
+}
+
+u32 GPUScene::DrawDepth(CullPhase phase, Program* opaqueProgram, Program* alphaTestedProgram)
+{
+	if (m_instanceCount == 0)
+	{
+		return 0;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glBindBuffer(GL_PARAMETER_BUFFER, m_countBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawDataBinding, m_drawBuffer);
+
+	// Opaque groups first, they all share the same program and vertex stream
+	opaqueProgram->Bind();
+	GLState::BindVertexArray(GeometryPool::Get()->GetDepthVertexArray());
+
+	for (u32 i = 0; i < m_groups.size(); ++i)
+	{
+		if (!m_groups[i].material->IsAlphaTested())
+		{
+			MultiDraw(phase, i);
+		}
+	}
+
+	alphaTestedProgram->Bind();
+	GLState::BindVertexArray(GeometryPool::Get()->GetVertexArray());
+
+	for (u32 i = 0; i < m_groups.size(); ++i)
+	{
+		if (m_groups[i].material->IsAlphaTested())
+		{
+			MultiDraw(phase, i);
+		}
+	}
+
+	return (u32)m_groups.size();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "renderer/culling.h"
+#include "renderer/frame_data.h"
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct Model;
+struct Material;
+class Program;
+class DepthPyramid;
+
+constexpr u32 InstanceDataBinding   = 3; // Shader storage buffers of the culling pass
+constexpr u32 DrawCommandBinding    = 4;
+constexpr u32 DrawCountBinding      = 5;
+constexpr u32 VisibilityBinding     = 6;
+constexpr u32 CullStatisticsBinding = 7;
+
+// Occlusion culling runs in two phases: the instances visible last frame are drawn first, their
+// depth feeds a DepthPyramid, then everything else is tested against it and drawn if visible.
+enum CullPhase
+{
+	CullPhase_All   = 0, // Frustum culling only
+	CullPhase_Early = 1,
+	CullPhase_Late  = 2,
+};
+
+// Instance counts of a frame, read back a few frames late
+struct CullStatistics
+{
+	u32 frustumCulled;
+	u32 occlusionCulled;
+	u32 earlyDraws;
+	u32 lateDraws;
+};
+
+// Matches the layout expected by glMultiDrawElementsIndirectCount
+struct DrawElementsIndirectCommand
+{
+	u32 count;
+	u32 instanceCount;
+	u32 firstIndex;
+	i32 baseVertex;
+	u32 baseInstance;
+};
+
+// The scene instances resident on the GPU. Their draw data and bounds live in storage buffers,
+// a compute pass culls them against the frustum and appends the indirect commands of each draw
+// group, one group per material variant, so that the opaque pass is one multi-draw per program.
+// Requires the meshes to live in the GeometryPool, and bindless textures.
+class GPUScene
+{
+public:
+	static bool IsSupported();
+
+	void Initialize();
+	// Frees every buffer, the GL context must still be current
+	void Shutdown();
+
+	// models[i] uses materials[materialIndices[i]]
+	void Build(const std::vector<Model>& models, const std::vector<u32>& materialIndices, const std::vector<Material*>& materials, const SceneBounds& bounds);
+	void UpdateTransforms(const std::vector<Model>& models, const SceneBounds& bounds);
+
+	// True when a material changed variant since Build()
+	bool IsOutdated(const std::vector<Material*>& materials) const;
+
+	// Brackets the culling passes of a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// Expects the frame data to be bound, the late phase reads depthPyramid
+	void Cull(CullPhase phase, const DepthPyramid* depthPyramid = nullptr);
+	// Draws what the last Cull() of the phase kept, returns the number of draw calls issued
+	u32 Draw(CullPhase phase);
+	// Same with the depth programs, opaque groups read the position-only stream
+	u32 DrawDepth(CullPhase phase, Program* opaqueProgram, Program* alphaTestedProgram);
+
+	// The statistics of the latest frame the GPU completed
+	const CullStatistics& GetStatistics() const
+	{
+		return m_statistics;
+	}
+
+private:
+	struct DrawGroup
+	{
+		const Material* material; // Any material of the group, they all share the same program
+		u32             commandOffset;
+		u32             instanceCount;
+	};
+
+	// std430, mirrors InstanceData in cull_instances.comp.glsl
+	struct InstanceData
+	{
+		glm::vec3 center;
+		u32       firstIndex;
+		glm::vec3 extent;
+		u32       indexCount;
+		i32       baseVertex;
+		u32       group;
+		u32       commandOffset;
+		u32       padding;
+	};
+
+	static_assert(sizeof(InstanceData) == 48);
+
+	void Release();
+
+	void MultiDraw(CullPhase phase, u32 groupIndex) const;
+
+	void WriteInstances(const std::vector<Model>& models, const SceneBounds& bounds);
+
+private:
+	Program* m_cullProgram = nullptr;
+
+	GLuint m_drawBuffer     = 0; // DrawData of every instance
+	GLuint m_instanceBuffer = 0;
+	GLuint m_commandBuffer  = 0; // One range per phase
+	GLuint m_countBuffer    = 0; // One count per group and phase
+	GLuint m_visibility     = 0; // Whether each instance passed the last occlusion test
+
+	// Persistently mapped, one CullStatistics per frame in flight
+	static constexpr u32 StatisticsFrameCount = 3;
+
+	GLuint          m_statisticsBuffer                       = 0;
+	u8*             m_statisticsData                         = nullptr;
+	GLsizeiptr      m_statisticsStride                       = 0; // Rounded up to the storage buffer offset alignment
+	GLsync          m_statisticsFences[StatisticsFrameCount] = {};
+	u32             m_statisticsFrame                        = 0;
+	CullStatistics  m_statistics                             = {};
+
+	u32 m_instanceCount = 0;
+
+	std::vector<DrawGroup>    m_groups;
+	std::vector<u32>          m_materialMasks; // At build time
+	std::vector<DrawData>     m_drawData;
+	std::vector<InstanceData> m_instances;
+};
@@ -1,11 +1,26 @@
 #include "material.h"
 
+#include "renderer/gl_state.h"
+#include "renderer/texture.h"
+
+global_variable u32 g_materialCount = 0;
+
 Material::Material(const char* matName, const char* baseVS, const char* baseFS)
-    : m_name(matName)
+    : m_sortId(++g_materialCount)
+    , m_name(matName)
     , m_baseVS(baseVS)
     , m_baseFS(baseFS)
 {
 	(void)m_padding;
+
+	std::vector<const char*> uberDefines = {"UBER_SHADER"};
+	if (IsBindlessTextureSupported())
+	{
+		uberDefines.push_back("BINDLESS_MATERIALS");
+	}
+
+	// Fallback used while the variants compile
+	m_uberProgram = Program::MakeRender((m_baseVS + "+" + m_baseFS + "_uber").c_str(), m_baseVS.c_str(), m_baseFS.c_str(), uberDefines);
 }
 
 u32 Material::GetMask() const
@@ -28,89 +43,91 @@ u32 Material::GetMask() const
 	return result;
 }
 
-void Material::Bind(Program* program, const Environment* env)
+// Samplers use fixed bindings in the shader unless they are bindless, scalars go through WriteMaterialData()
+void Material::Bind() const
 {
-	if (hasAlbedo)
-		program->SetUniform("u_albedo", albedo);
-	if (hasRoughness)
-		program->SetUniform("u_roughness", roughness);
-	if (hasMetallic)
-		program->SetUniform("u_metallic", metallic);
-	if (hasEmissive)
+	if (IsBindlessTextureSupported())
 	{
-		program->SetUniform("u_emissive", emissive);
-		program->SetUniform("u_emissiveFactor", emissiveFactor);
+		return;
 	}
 
-	GLint index = 0;
-
 	if (hasAlbedoTexture)
-	{
-		program->SetUniform("s_albedo", index);
-		glBindTextureUnit(index, albedoTexture);
-		++index;
-	}
-
+		GLState::BindTextureUnit(TextureUnit_Albedo, albedoTexture);
 	if (hasRoughnessTexture)
-	{
-		program->SetUniform("s_roughness", index);
-		glBindTextureUnit(index, roughnessTexture);
-		++index;
-	}
-
+		GLState::BindTextureUnit(TextureUnit_Roughness, roughnessTexture);
 	if (hasMetallicTexture)
-	{
-		program->SetUniform("s_metallic", index);
-		glBindTextureUnit(index, metallicTexture);
-		++index;
-	}
-
+		GLState::BindTextureUnit(TextureUnit_Metallic, metallicTexture);
 	if (hasMetallicRoughnessTexture)
-	{
-		program->SetUniform("s_metallicRoughness", index);
-		glBindTextureUnit(index, metallicRoughnessTexture);
-		++index;
-	}
-
+		GLState::BindTextureUnit(TextureUnit_MetallicRoughness, metallicRoughnessTexture);
 	if (hasEmissiveTexture)
-	{
-		program->SetUniform("s_emissive", index);
-		program->SetUniform("u_emissiveFactor", emissiveFactor);
-		glBindTextureUnit(index, emissiveTexture);
-		++index;
-	}
-
+		GLState::BindTextureUnit(TextureUnit_Emissive, emissiveTexture);
 	if (hasNormalMap)
-	{
-		program->SetUniform("s_normal", index);
-		glBindTextureUnit(index, normalMap);
-		++index;
-	}
-
+		GLState::BindTextureUnit(TextureUnit_Normal, normalMap);
 	if (hasAmbientOcclusionMap)
+		GLState::BindTextureUnit(TextureUnit_AmbientOcclusion, ambientOcclusionMap);
+}
+
+void Material::WriteMaterialData(MaterialData* data) const
+{
+	data->albedo    = glm::vec4(albedo, 1.0f);
+	data->emissive  = glm::vec4(emissive, emissiveFactor);
+	data->roughness = roughness;
+	data->metallic  = metallic;
+	data->mask      = GetMask();
+
+	if (IsBindlessTextureSupported())
 	{
-		program->SetUniform("s_ambientOcclusion", index);
-		glBindTextureUnit(index, ambientOcclusionMap);
-		++index;
+		const struct
+		{
+			bool   enabled;
+			GLuint texture;
+		} textures[MaterialTextureCount] = {
+		    {hasAlbedoTexture, albedoTexture},
+		    {hasRoughnessTexture, roughnessTexture},
+		    {hasMetallicTexture, metallicTexture},
+		    {hasMetallicRoughnessTexture, metallicRoughnessTexture},
+		    {hasEmissiveTexture, emissiveTexture},
+		    {hasNormalMap, normalMap},
+		    {hasAmbientOcclusionMap, ambientOcclusionMap},
+		};
+
+		for (u32 i = 0; i < MaterialTextureCount; ++i)
+		{
+			data->textures[i] = textures[i].enabled && textures[i].texture != 0 ? GetTextureHandle(textures[i].texture) : 0;
+		}
 	}
+}
 
-	program->SetUniform("s_irradianceMap", index);
-	glBindTextureUnit(index, env->irradianceMap);
-	++index;
+void Material::PrepareProgram() const
+{
+	GetVariantProgram();
+}
+
+Program* Material::GetProgram() const
+{
+	Program* program = GetVariantProgram();
 
-	program->SetUniform("s_radianceMap", index);
-	glBindTextureUnit(index, env->radianceMap);
-	// glBindTextureUnit(index, g_envCubeMap);
-	++index;
+	if (program->IsReady())
+	{
+		return program;
+	}
 
-	program->SetUniform("s_iblDFG", index);
-	glBindTextureUnit(index, env->iblDFG);
-	++index;
+	return m_uberProgram;
 }
 
-Program* Material::GetProgram() const
+Program* Material::GetVariantProgram() const
 {
-	return Program::MakeRender(GetUniqueName().c_str(), m_baseVS.c_str(), m_baseFS.c_str(), GetDefines());
+	// The has* flags are edited directly, a mask change is the only thing that invalidates the cached program
+	const u32 mask = GetMask();
+
+	if (m_program == nullptr || mask != m_programMask)
+	{
+		// Submitting an already known variant is a lookup, new ones compile in the background
+		m_program     = Program::MakeRender(GetUniqueName().c_str(), m_baseVS.c_str(), m_baseFS.c_str(), GetDefines());
+		m_programMask = mask;
+	}
+
+	return m_program;
 }
 
 std::vector<const char*> Material::GetDefines() const
@@ -131,10 +148,16 @@ std::vector<const char*> Material::GetDefines() const
 	if (hasAmbientOcclusionMap)      defines.push_back("HAS_AMBIENT_OCCLUSION_MAP");
 	// clang-format on
 
+	if (IsBindlessTextureSupported())
+	{
+		defines.push_back("BINDLESS_MATERIALS");
+	}
+
 	return defines;
 }
 
 std::string Material::GetUniqueName() const
 {
-	return m_name + "_" + std::to_string(GetMask());
+	// Shared by every material using the same shaders and features
+	return m_baseVS + "+" + m_baseFS + "_" + std::to_string(GetMask());
 }
\ No newline at end of file
@@ -2,28 +2,70 @@
 
 #include "program.h"
 #include "environment.h"
+#include "frame_data.h"
 
 #include <glad/glad.h>
 
 #include <string>
 
+// Fixed units matching the sampler bindings of pbr.frag, the uber shader samples every slot so they can
+// not be packed depending on the mask
+enum TextureUnit
+{
+	TextureUnit_Albedo            = 0,
+	TextureUnit_Roughness         = 1,
+	TextureUnit_Metallic          = 2,
+	TextureUnit_MetallicRoughness = 3,
+	TextureUnit_Emissive          = 4,
+	TextureUnit_Normal            = 5,
+	TextureUnit_AmbientOcclusion  = 6,
+
+	// Environment, bound once per frame by the renderer
+	TextureUnit_Irradiance = 7,
+	TextureUnit_Radiance   = 8,
+	TextureUnit_DFG        = 9,
+
+	// Cascades of the directional light, bound once per frame by the renderer
+	TextureUnit_Shadow = 10,
+};
+
 struct Material
 {
 	Material(const char* matName, const char* baseVS, const char* baseFS);
 
 	u32      GetMask() const;
-	void     Bind(Program* program, const Environment* env);
+	void     Bind() const;
+	// The alpha of the albedo texture discards fragments, see GetAlpha() in pbr.frag.glsl
+	bool IsAlphaTested() const
+	{
+		return hasAlbedoTexture;
+	}
+	void     WriteMaterialData(MaterialData* data) const;
+	u32 GetSortId() const
+	{
+		return m_sortId;
+	}
+
+	// Submits the variant matching the current mask without waiting for it
+	void PrepareProgram() const;
+	// The variant matching the current mask, or the uber shader while the variant is compiling
 	Program* GetProgram() const;
 
 private:
+	Program*                 GetVariantProgram() const;
 	std::vector<const char*> GetDefines() const;
 	std::string              GetUniqueName() const;
 
 private:
+	u32         m_sortId;
 	std::string m_name;
 	std::string m_baseVS;
 	std::string m_baseFS;
 
+	mutable Program* m_program     = nullptr;
+	mutable u32      m_programMask = 0;
+	Program*         m_uberProgram = nullptr;
+
 public:
 	glm::vec3 albedo         = glm::vec3(0.5f, 0.5f, 0.5f);
 	f32       roughness      = 0.0f;
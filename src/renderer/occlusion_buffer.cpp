@@ -0,0 +1,286 @@
+#include "occlusion_buffer.h"
+
+#include "core/jobs.h"
+#include "core/simd.h"
+#include "core/utils.h"
+
+#include <float.h>
+#include <math.h>
+
+constexpr u32 FullTileMask = ~0u;
+
+static_assert(OcclusionBuffer::TileWidth * OcclusionBuffer::TileHeight == 32, "Tile coverage is a 32 bit mask");
+static_assert(OcclusionBuffer::TileWidth % SimdWidth == 0);
+
+void OcclusionBuffer::Begin(const glm::mat4& viewProj, u32 width, u32 height)
+{
+	m_viewProj = viewProj;
+	m_tilesX   = Max(width / TileWidth, 1u);
+	m_tilesY   = Max(height / TileHeight, 1u);
+	m_width    = m_tilesX * TileWidth;
+	m_height   = m_tilesY * TileHeight;
+
+	// Padded so that the last tiles of a row can be loaded SimdWidth at a time
+	const u32 tileCount = m_tilesX * m_tilesY;
+	m_tileDepth.assign(tileCount + SimdWidth, 1.0f);
+	m_layerDepth.assign(tileCount, 0.0f);
+	m_layerMask.assign(tileCount, 0);
+
+	m_occluders.clear();
+	m_triangles.clear();
+}
+
+void OcclusionBuffer::AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<u32>& indices, const glm::mat4& transform)
+{
+	const u32 firstTriangle = m_occluders.empty() ? 0 : m_occluders.back().firstTriangle + (u32)m_occluders.back().indices->size() / 3;
+
+	m_occluders.push_back({
+	    .positions     = &positions,
+	    .indices       = &indices,
+	    .transform     = transform,
+	    .firstTriangle = firstTriangle,
+	});
+}
+
+void OcclusionBuffer::Rasterize()
+{
+	if (m_occluders.empty())
+	{
+		return;
+	}
+
+	const Occluder& last = m_occluders.back();
+	m_triangles.resize(last.firstTriangle + last.indices->size() / 3);
+
+	Jobs::ParallelFor((u32)m_occluders.size(), 1, [&](u32 begin, u32 end) {
+		std::vector<glm::vec4> clipPositions;
+
+		for (u32 i = begin; i < end; ++i)
+		{
+			const Occluder& occluder = m_occluders[i];
+			const glm::mat4 mvp      = m_viewProj * occluder.transform;
+			const u32*      indices  = occluder.indices->data();
+			const u32       count    = (u32)occluder.indices->size() / 3;
+
+			clipPositions.resize(occluder.positions->size());
+			for (u32 v = 0; v < clipPositions.size(); ++v)
+			{
+				clipPositions[v] = mvp * glm::vec4((*occluder.positions)[v], 1.0f);
+			}
+
+			for (u32 t = 0; t < count; ++t)
+			{
+				SetupTriangle(clipPositions[indices[3 * t]], clipPositions[indices[3 * t + 1]], clipPositions[indices[3 * t + 2]], &m_triangles[occluder.firstTriangle + t]);
+			}
+		}
+	});
+
+	// Each job owns a row of tiles, so the tiles are updated without synchronization
+	Jobs::ParallelFor(m_tilesY, 1, [&](u32 begin, u32 end) {
+		for (u32 tileY = begin; tileY < end; ++tileY)
+		{
+			for (const Triangle& triangle : m_triangles)
+			{
+				if ((i32)tileY < triangle.tileMinY || (i32)tileY > triangle.tileMaxY)
+				{
+					continue;
+				}
+
+				for (i32 tileX = triangle.tileMinX; tileX <= triangle.tileMaxX; ++tileX)
+				{
+					RasterizeTile(triangle, (u32)tileX, tileY);
+				}
+			}
+		}
+	});
+}
+
+void OcclusionBuffer::SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, Triangle* triangle) const
+{
+	triangle->tileMinX = 0;
+	triangle->tileMaxX = -1;
+	triangle->tileMinY = 0;
+	triangle->tileMaxY = -1;
+
+	// Triangles crossing the near plane are dropped, which only loses occlusion
+	if (v0.z < -v0.w || v1.z < -v1.w || v2.z < -v2.w || v0.w <= 0.0f || v1.w <= 0.0f || v2.w <= 0.0f)
+	{
+		return;
+	}
+
+	glm::vec3        p[3];
+	const glm::vec4* clip[3] = {&v0, &v1, &v2};
+
+	for (u32 i = 0; i < 3; ++i)
+	{
+		const glm::vec3 ndc = glm::vec3(*clip[i]) / clip[i]->w;
+		p[i]                = {(ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height, ndc.z * 0.5f + 0.5f};
+	}
+
+	f32 area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+
+	if (fabsf(area) < 1e-6f)
+	{
+		return;
+	}
+
+	// Occluders are two sided, only the winding of the edge functions matters
+	if (area < 0.0f)
+	{
+		const glm::vec3 swap = p[1];
+		p[1]                 = p[2];
+		p[2]                 = swap;
+		area                 = -area;
+	}
+
+	for (u32 i = 0; i < 3; ++i)
+	{
+		const glm::vec3& a = p[i];
+		const glm::vec3& b = p[(i + 1) % 3];
+
+		triangle->edgeA[i] = a.y - b.y;
+		triangle->edgeB[i] = b.x - a.x;
+		triangle->edgeC[i] = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+	}
+
+	const glm::vec3 d1 = p[1] - p[0];
+	const glm::vec3 d2 = p[2] - p[0];
+
+	triangle->depthA   = (d1.z * d2.y - d2.z * d1.y) / area;
+	triangle->depthB   = (d2.z * d1.x - d1.z * d2.x) / area;
+	triangle->depthC   = p[0].z - triangle->depthA * p[0].x - triangle->depthB * p[0].y;
+	triangle->maxDepth = Max(p[0].z, Max(p[1].z, p[2].z));
+
+	const f32 minX = Min(p[0].x, Min(p[1].x, p[2].x));
+	const f32 maxX = Max(p[0].x, Max(p[1].x, p[2].x));
+	const f32 minY = Min(p[0].y, Min(p[1].y, p[2].y));
+	const f32 maxY = Max(p[0].y, Max(p[1].y, p[2].y));
+
+	triangle->tileMinX = Max((i32)floorf(minX / TileWidth), 0);
+	triangle->tileMaxX = Min((i32)floorf(maxX / TileWidth), (i32)m_tilesX - 1);
+	triangle->tileMinY = Max((i32)floorf(minY / TileHeight), 0);
+	triangle->tileMaxY = Min((i32)floorf(maxY / TileHeight), (i32)m_tilesY - 1);
+}
+
+void OcclusionBuffer::RasterizeTile(const Triangle& triangle, u32 tileX, u32 tileY)
+{
+	const u32 index = tileY * m_tilesX + tileX;
+	const f32 x0    = (f32)(tileX * TileWidth);
+	const f32 y0    = (f32)(tileY * TileHeight);
+
+	// Farthest depth of the triangle plane over the tile, the plane is linear so a corner holds it
+	const f32 cornerDepth = Max(Max(triangle.depthA * x0 + triangle.depthB * y0, triangle.depthA * (x0 + TileWidth) + triangle.depthB * y0),
+	                            Max(triangle.depthA * x0 + triangle.depthB * (y0 + TileHeight), triangle.depthA * (x0 + TileWidth) + triangle.depthB * (y0 + TileHeight)));
+	const f32 depth       = Min(cornerDepth + triangle.depthC, triangle.maxDepth);
+
+	if (depth >= m_tileDepth[index])
+	{
+		return;
+	}
+
+	// Coverage of the pixel centers, SimdWidth pixels of a row at a time
+	const F32x laneOffsets = SimdToF32(SimdIota(0)) + SimdSet(0.5f);
+	const F32x zero        = SimdSet(0.0f);
+
+	F32x edgeA[3], edgeB[3], edgeC[3];
+	for (u32 e = 0; e < 3; ++e)
+	{
+		edgeA[e] = SimdSet(triangle.edgeA[e]);
+		edgeB[e] = SimdSet(triangle.edgeB[e]);
+		edgeC[e] = SimdSet(triangle.edgeC[e]);
+	}
+
+	u32 mask = 0;
+
+	for (u32 row = 0; row < TileHeight; ++row)
+	{
+		const F32x y = SimdSet(y0 + row + 0.5f);
+
+		for (u32 column = 0; column < TileWidth; column += SimdWidth)
+		{
+			const F32x x = SimdSet(x0 + column) + laneOffsets;
+
+			const M32x inside = (edgeA[0] * x + edgeB[0] * y + edgeC[0] >= zero) & (edgeA[1] * x + edgeB[1] * y + edgeC[1] >= zero) &
+			                    (edgeA[2] * x + edgeB[2] * y + edgeC[2] >= zero);
+
+			mask |= SimdMoveMask(inside) << (row * TileWidth + column);
+		}
+	}
+
+	if (mask == 0)
+	{
+		return;
+	}
+
+	const u32 layerMask  = m_layerMask[index] | mask;
+	const f32 layerDepth = m_layerMask[index] == 0 ? depth : Max(m_layerDepth[index], depth);
+
+	// Every pixel is covered by something no farther than the layer depth
+	if (layerMask == FullTileMask)
+	{
+		m_tileDepth[index]  = Min(m_tileDepth[index], layerDepth);
+		m_layerDepth[index] = 0.0f;
+		m_layerMask[index]  = 0;
+	}
+	else
+	{
+		m_layerDepth[index] = layerDepth;
+		m_layerMask[index]  = layerMask;
+	}
+}
+
+bool OcclusionBuffer::IsOccluded(const glm::vec3& center, const glm::vec3& extent) const
+{
+	f32 minX = FLT_MAX, minY = FLT_MAX, nearest = FLT_MAX;
+	f32 maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+	for (u32 i = 0; i < 8; ++i)
+	{
+		const glm::vec3 corner = center + extent * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+		const glm::vec4 clip   = m_viewProj * glm::vec4(corner, 1.0f);
+
+		// Crosses the near plane
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+		{
+			return false;
+		}
+
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+
+		minX    = Min(minX, (ndc.x * 0.5f + 0.5f) * m_width);
+		maxX    = Max(maxX, (ndc.x * 0.5f + 0.5f) * m_width);
+		minY    = Min(minY, (ndc.y * 0.5f + 0.5f) * m_height);
+		maxY    = Max(maxY, (ndc.y * 0.5f + 0.5f) * m_height);
+		nearest = Min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	const i32 tileMinX = Max((i32)floorf(minX / TileWidth), 0);
+	const i32 tileMaxX = Min((i32)floorf(maxX / TileWidth), (i32)m_tilesX - 1);
+	const i32 tileMinY = Max((i32)floorf(minY / TileHeight), 0);
+	const i32 tileMaxY = Min((i32)floorf(maxY / TileHeight), (i32)m_tilesY - 1);
+
+	if (tileMinX > tileMaxX || tileMinY > tileMaxY)
+	{
+		return false;
+	}
+
+	const F32x boxDepth = SimdSet(nearest);
+
+	// Visible as soon as one tile may hold something behind the box
+	for (i32 tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+	{
+		const f32* row = &m_tileDepth[tileY * m_tilesX];
+
+		for (i32 tileX = tileMinX; tileX <= tileMaxX; tileX += SimdWidth)
+		{
+			const u32 lanes = (1u << Min((u32)(tileMaxX - tileX + 1), SimdWidth)) - 1;
+
+			if ((SimdMoveMask(boxDepth <= SimdLoad(row + tileX)) & lanes) != 0)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
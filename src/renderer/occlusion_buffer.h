@@ -0,0 +1,72 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Low resolution depth buffer the occluders are rasterized into on the CPU, so that hidden
+// models are rejected before submission without any GPU round-trip.
+// The buffer is split in 8x4 pixel tiles. Each tile keeps a conservative far depth for the
+// whole tile plus a working layer made of a coverage mask and its far depth; once the mask
+// is full the working layer is merged into the tile depth (masked occlusion culling).
+class OcclusionBuffer
+{
+public:
+	static constexpr u32 TileWidth  = 8;
+	static constexpr u32 TileHeight = 4;
+
+	// Clears the buffer and forgets the occluders of the previous frame
+	void Begin(const glm::mat4& viewProj, u32 width, u32 height);
+
+	// The arrays must stay alive until Rasterize() returns
+	void AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<u32>& indices, const glm::mat4& transform);
+
+	// Transforms and rasterizes the occluders on the worker threads
+	void Rasterize();
+
+	// True when the world space box is hidden behind the rasterized occluders
+	bool IsOccluded(const glm::vec3& center, const glm::vec3& extent) const;
+
+	u32 GetTriangleCount() const
+	{
+		return (u32)m_triangles.size();
+	}
+
+private:
+	struct Occluder
+	{
+		const std::vector<glm::vec3>* positions;
+		const std::vector<u32>*       indices;
+		glm::mat4                     transform;
+		u32                           firstTriangle;
+	};
+
+	// Screen space, edge functions are >= 0 inside
+	struct Triangle
+	{
+		f32 edgeA[3], edgeB[3], edgeC[3];
+		f32 depthA, depthB, depthC; // Depth plane
+		f32 maxDepth;
+		i32 tileMinX, tileMinY, tileMaxX, tileMaxY; // Inclusive, empty when min > max
+	};
+
+	void SetupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, Triangle* triangle) const;
+	void RasterizeTile(const Triangle& triangle, u32 tileX, u32 tileY);
+
+private:
+	glm::mat4 m_viewProj;
+
+	u32 m_width  = 0;
+	u32 m_height = 0;
+	u32 m_tilesX = 0;
+	u32 m_tilesY = 0;
+
+	std::vector<f32> m_tileDepth;  // Farthest depth of the tile
+	std::vector<f32> m_layerDepth; // Farthest depth of the working layer
+	std::vector<u32> m_layerMask;  // Pixels covered by the working layer
+
+	std::vector<Occluder> m_occluders;
+	std::vector<Triangle> m_triangles;
+};
@@ -1,168 +1,229 @@
 #include "program.h"
 
+#include "renderer/frame_stats.h"
+#include "renderer/gl_state.h"
+#include "renderer/shader_preprocessor.h"
+
+#include "core/file_watcher.h"
+#include "core/hash.h"
+#include "core/utils.h"
+
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 #include <string>
 #include <unordered_map>
-#include <regex>
 
 std::unordered_map<std::string, Program> g_programsByName;
 
+global_variable FileWatcher g_shaderWatcher;
+global_variable bool        g_shaderWatcherStarted = false; // Tried once, Start() already reports a failure
+
+// Programs with a build in flight, polled once per frame
+[[clang::no_destroy]] global_variable std::vector<Program*> g_pendingPrograms;
+
 inline std::string GetShaderFullPath(const char* filename)
 {
 	return std::string("resources/shaders/") + filename;
 }
 
-inline std::string GetFileContent(const char* filename)
+// Does not query the compile status, so that the driver can compile in the background
+inline u32 SubmitShader(GLenum shaderType, const std::string& source)
 {
-	FILE* file = fopen(filename, "r");
-	if (!file)
-	{
-		return "";
-	}
+	const char* sourceData = source.data();
 
-	defer(fclose(file));
-
-	fseek(file, SEEK_SET, SEEK_END);
-	long filesize = ftell(file);
-	rewind(file);
+	u32 shader = glCreateShader(shaderType);
 
-	std::string fileContent;
-	fileContent.resize(filesize);
-	filesize = (size_t)fread(fileContent.data(), 1, filesize, file);
-	fileContent.resize(filesize);
+	glShaderSource(shader, 1, &sourceData, nullptr);
+	glCompileShader(shader);
 
-	return fileContent;
+	return shader;
 }
 
-inline std::string ParseShader(const char* input, int level = 0)
+inline void PrintShaderErrors(const char* filename, u32 shader)
 {
-	// Tokenize string
-	std::vector<std::string> lines;
-
-	const char* ptr       = input;
-	const char* lineStart = input;
+	i32 compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
 
-	while (*ptr)
+	if (!compiled)
 	{
-		bool isNewLine = false;
+		char error[512];
+		glGetShaderInfoLog(shader, 512, nullptr, error);
+		fprintf(stderr, "Could not compile shader %s:\n%s\n", filename, RemapShaderLog(error).c_str());
+	}
+}
 
-		switch (*ptr)
+inline bool IsParallelCompileSupported()
+{
+	local_variable const bool supported = [] {
+		if (GLAD_GL_KHR_parallel_shader_compile)
 		{
-			case '\n':
-			{
-				isNewLine = true;
-				if (*(ptr + 1) == '\r')
-					++ptr;
-			}
-			break;
+			// Let the driver pick the number of compiler threads
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			return true;
+		}
+		return false;
+	}();
 
-			case '\r':
-			{
-				isNewLine = true;
-				if (*(ptr + 1) == '\n')
-					++ptr;
-			}
-			break;
+	return supported;
+}
 
-			default:
-				break;
-		}
+// Program binaries are only valid for the driver that produced them
+struct ProgramBinaryHeader
+{
+	u32    magic;
+	u32    version;
+	u64    key;
+	GLenum format;
+	u32    size;
+};
 
-		++ptr;
-		if (isNewLine)
-		{
-			lines.emplace_back(lineStart, ptr);
-			lineStart = ptr;
-		}
-	}
+constexpr u32 ProgramBinaryMagic   = 0x4E495042; // "BPIN"
+constexpr u32 ProgramBinaryVersion = 1;
 
-	lines.emplace_back(lineStart, ptr);
+global_variable const char* g_programCacheDirectory = "cache/shaders/";
 
-	std::string content = "";
+inline bool IsProgramCacheEnabled()
+{
+	local_variable const bool enabled = [] {
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
 
-	// Look for #includes
-	for (auto&& line : lines)
-	{
-		if (line.find("#include") != std::string::npos)
-		{
-			auto i = line.find_first_of("\"<");
-			auto j = line.find_last_of("\">");
+		std::error_code error;
+		std::filesystem::create_directories(g_programCacheDirectory, error);
 
-			auto filename = line.substr(i + 1, j - i - 1);
+		return formatCount > 0 && !error;
+	}();
 
-			auto src = GetFileContent(GetShaderFullPath(filename.c_str()).c_str());
-			content += ParseShader(src.c_str(), level + 1);
-			content += "\n"; // Just in case
-		}
-		else
+	return enabled;
+}
+
+inline u64 GetDriverHash()
+{
+	local_variable const u64 hash = [] {
+		u64 h = HashOffsetBasis;
+		for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
 		{
-			content += line;
+			const char* str = (const char*)glGetString(name);
+			h               = HashString(str != nullptr ? str : "", h);
 		}
-	}
+		return h;
+	}();
+
+	return hash;
+}
 
-	return content;
+inline std::string GetProgramCachePath(u64 key)
+{
+	char filename[32];
+	snprintf(filename, sizeof(filename), "%016llx.bin", (unsigned long long)key);
+	return std::string(g_programCacheDirectory) + filename;
 }
 
-inline u32 CompileShader(const char* filename, GLenum shaderType, const std::vector<const char*>& defines)
+inline GLuint LoadProgramBinary(u64 key)
 {
-	std::string src = GetFileContent(filename);
-	if (src.empty())
+	const std::string path = GetProgramCachePath(key);
+
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		return 0;
+	}
+
+	defer(fclose(file));
+
+	ProgramBinaryHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != ProgramBinaryMagic || header.version != ProgramBinaryVersion ||
+	    header.key != key)
 	{
 		return 0;
 	}
 
-	std::string completeShader = "#version 450\n";
-	for (const char* define : defines)
+	std::vector<u8> binary(header.size);
+	if (fread(binary.data(), 1, header.size, file) != header.size)
 	{
-		completeShader.append(std::string("#define ") + define + "\n");
+		return 0;
 	}
 
-	completeShader.append(src);
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), header.size);
 
-	std::string finalShader = ParseShader(completeShader.c_str());
+	// Fails when the driver got updated in a way that does not show in its version string
+	i32 linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
 
-	const char* finalShaderData = finalShader.data();
+	if (!linked)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
 
-	u32 shader = glCreateShader(shaderType);
+	return program;
+}
 
-	glShaderSource(shader, 1, &finalShaderData, nullptr);
-	glCompileShader(shader);
+inline void SaveProgramBinary(u64 key, GLuint program)
+{
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
 
-	i32 compiled = GL_FALSE;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (size <= 0)
+	{
+		return;
+	}
 
-	if (!compiled)
+	ProgramBinaryHeader header = {
+	    .magic   = ProgramBinaryMagic,
+	    .version = ProgramBinaryVersion,
+	    .key     = key,
+	};
+
+	std::vector<u8> binary(size);
+	glGetProgramBinary(program, size, nullptr, &header.format, binary.data());
+	header.size = (u32)size;
+
+	// Write to a temporary file first so that a crash never leaves a truncated binary behind
+	const std::string path    = GetProgramCachePath(key);
+	const std::string tmpPath = path + ".tmp";
+
+	FILE* file = fopen(tmpPath.c_str(), "wb");
+	if (!file)
 	{
-		char error[512];
-		glGetShaderInfoLog(shader, 512, nullptr, error);
-		fprintf(stderr, "Could not compile shader %s: %s\n", filename, error);
-		glDeleteShader(shader);
-		shader = 0;
+		return;
 	}
 
-	return shader;
+	const bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, size, file) == (size_t)size;
+	fclose(file);
+
+	std::error_code error;
+	if (written)
+	{
+		std::filesystem::rename(tmpPath, path, error);
+	}
+	else
+	{
+		std::filesystem::remove(tmpPath, error);
+	}
 }
 
 Program* Program::MakeRender(const char* name, const char* vsfile, const char* fsfile, const StringArray& defines)
 {
 	if (!g_programsByName.contains(name))
 	{
-		Program program(name);
+		// Built in place, pending builds keep a pointer to the program
+		Program& program = g_programsByName.emplace(name, Program(name)).first->second;
 
 		program.m_defines   = defines;
 		std::string vshader = GetShaderFullPath(vsfile);
 
-		program.m_shaders.push_back({GL_VERTEX_SHADER, vshader.c_str(), std::filesystem::last_write_time(vshader.c_str())});
+		program.m_shaders.push_back({GL_VERTEX_SHADER, vshader});
 
 		if (fsfile != nullptr && strcmp(fsfile, "") != 0)
 		{
 			std::string fshader = GetShaderFullPath(fsfile);
-			program.m_shaders.push_back({GL_FRAGMENT_SHADER, fshader.c_str(), std::filesystem::last_write_time(fshader.c_str())});
+			program.m_shaders.push_back({GL_FRAGMENT_SHADER, fshader});
 		}
 
 		program.Build();
-
-		g_programsByName[name] = program;
 	}
 
 	return &g_programsByName[name];
@@ -172,15 +233,14 @@ Program* Program::MakeCompute(const char* name, const char* csfile, const String
 {
 	if (!g_programsByName.contains(name))
 	{
-		Program program(name);
+		// Built in place, pending builds keep a pointer to the program
+		Program& program = g_programsByName.emplace(name, Program(name)).first->second;
 
 		program.m_defines   = defines;
 		std::string cshader = GetShaderFullPath(csfile);
 
-		program.m_shaders.push_back({GL_COMPUTE_SHADER, cshader.c_str(), std::filesystem::last_write_time(cshader.c_str())});
+		program.m_shaders.push_back({GL_COMPUTE_SHADER, cshader});
 		program.Build();
-
-		g_programsByName[name] = program;
 	}
 
 	return &g_programsByName[name];
@@ -198,151 +258,305 @@ Program* Program::GetProgramByName(const char* name)
 
 void Program::UpdateAllPrograms()
 {
-	for (auto&& program : g_programsByName)
+	std::erase_if(g_pendingPrograms, [](Program* program) {
+		program->IsReady();
+		return !program->IsPending();
+	});
+
+	if (!g_shaderWatcherStarted)
 	{
-		program.second.Update();
+		g_shaderWatcher.Start(GetShaderFullPath("").c_str());
+		g_shaderWatcherStarted = true;
 	}
-}
 
-Program::Program(const char* name)
-    : m_name(name)
-{
-}
+	// Only touches an atomic flag unless something changed on disk
+	std::vector<std::string> changedFiles;
+	if (!g_shaderWatcher.Poll(&changedFiles))
+	{
+		return;
+	}
 
-void Program::Update()
-{
-	bool needsUpdate = false;
+	for (const std::string& file : changedFiles)
+	{
+		InvalidateShaderFile(file);
+	}
 
-	for (auto&& shader : m_shaders)
+	for (auto&& program : g_programsByName)
 	{
-		auto shaderTime = std::filesystem::last_write_time(shader.filename);
-		if (shaderTime > shader.time)
+		for (const std::string& file : changedFiles)
 		{
-			needsUpdate = true;
-			shader.time = shaderTime;
+			if (program.second.DependsOn(file))
+			{
+				program.second.Build();
+				break;
+			}
 		}
 	}
+}
 
-	if (needsUpdate)
+void Program::FinishPendingBuilds()
+{
+	for (Program* program : g_pendingPrograms)
 	{
-		Build();
+		if (program->IsPending())
+		{
+			program->FinishBuild();
+		}
 	}
+
+	g_pendingPrograms.clear();
+}
+
+u32 Program::GetPendingBuildCount()
+{
+	return (u32)g_pendingPrograms.size();
+}
+
+global_variable u32 g_programCount = 0;
+
+Program::Program(const char* name)
+    : m_name(name)
+    , m_sortId(++g_programCount)
+{
+}
+
+bool Program::DependsOn(const std::string& filename) const
+{
+	return std::find(m_dependencies.begin(), m_dependencies.end(), filename) != m_dependencies.end();
 }
 
 void Program::Bind()
 {
-	glUseProgram(m_id);
+	// Callers that do not check IsReady() get the blocking behaviour
+	if (m_pendingId != 0 && m_id == 0)
+	{
+		FinishBuild();
+	}
+
+	GLState::UseProgram(m_id);
 }
 
-void Program::SetUniform(const char* name, int32_t value) const
+void Program::SetUniform(UniformId id, int32_t value) const
 {
-	glUniform1i(GetLocation(name), value);
+	glUniform1i(GetLocation(id), value);
 }
-void Program::SetUniform(const char* name, u32 value) const
+void Program::SetUniform(UniformId id, u32 value) const
 {
-	glUniform1ui(GetLocation(name), value);
+	glUniform1ui(GetLocation(id), value);
 }
-void Program::SetUniform(const char* name, f32 value) const
+void Program::SetUniform(UniformId id, f32 value) const
 {
-	glUniform1f(GetLocation(name), value);
+	glUniform1f(GetLocation(id), value);
 }
-void Program::SetUniform(const char* name, const glm::vec2& value) const
+void Program::SetUniform(UniformId id, const glm::vec2& value) const
 {
-	glUniform2fv(GetLocation(name), 1, &value[0]);
+	glUniform2fv(GetLocation(id), 1, &value[0]);
 }
-void Program::SetUniform(const char* name, const glm::vec3& value) const
+void Program::SetUniform(UniformId id, const glm::vec3& value) const
 {
-	glUniform3fv(GetLocation(name), 1, &value[0]);
+	glUniform3fv(GetLocation(id), 1, &value[0]);
 }
-void Program::SetUniform(const char* name, const glm::vec4& value) const
+void Program::SetUniform(UniformId id, const glm::vec4& value) const
 {
-	glUniform4fv(GetLocation(name), 1, &value[0]);
+	glUniform4fv(GetLocation(id), 1, &value[0]);
 }
-void Program::SetUniform(const char* name, const glm::mat2& value) const
+void Program::SetUniform(UniformId id, const glm::mat2& value) const
 {
-	glUniformMatrix2fv(GetLocation(name), 1, false, &value[0][0]);
+	glUniformMatrix2fv(GetLocation(id), 1, false, &value[0][0]);
 }
-void Program::SetUniform(const char* name, const glm::mat3& value) const
+void Program::SetUniform(UniformId id, const glm::mat3& value) const
 {
-	glUniformMatrix3fv(GetLocation(name), 1, false, &value[0][0]);
+	glUniformMatrix3fv(GetLocation(id), 1, false, &value[0][0]);
 }
-void Program::SetUniform(const char* name, const glm::mat4& value) const
+void Program::SetUniform(UniformId id, const glm::mat4& value) const
 {
-	glUniformMatrix4fv(GetLocation(name), 1, false, &value[0][0]);
+	glUniformMatrix4fv(GetLocation(id), 1, false, &value[0][0]);
 }
 
 void Program::Build()
 {
-	std::vector<GLuint> shaders;
+	FrameStats* stats = FrameStats::Get();
+	Timer       timer;
+
+	defer(stats->programs.buildTime += timer.Tick());
+
+	// A rebuild requested while the previous one is still compiling supersedes it
+	CancelBuild();
+
+	std::vector<PreprocessedShader> sources(m_shaders.size());
+
+	u64 key = GetDriverHash();
 
-	bool allValid = true;
+	// Recorded before compiling, so that fixing a broken include still triggers a rebuild
+	m_dependencies.clear();
 
-	for (const auto& shader : m_shaders)
+	for (u32 i = 0; i < m_shaders.size(); ++i)
 	{
-		GLuint shaderID = CompileShader(shader.filename.data(), shader.type, m_defines);
-		if (glIsShader(shaderID))
+		const bool valid = PreprocessShader(m_shaders[i].filename.data(), m_defines, &sources[i]);
+
+		for (u32 fileId : sources[i].files)
 		{
-			shaders.push_back(shaderID);
+			m_dependencies.push_back(GetShaderFilename(fileId));
 		}
-		else
+
+		if (!valid)
 		{
-			allValid = false;
-			break;
+			fprintf(stderr, "Could not read shader %s\n", m_shaders[i].filename.data());
+			return;
 		}
+
+		key = HashCombine(key, m_shaders[i].type);
+		key = HashCombine(key, sources[i].hash);
 	}
 
-	if (!allValid)
+	const bool useCache = IsProgramCacheEnabled();
+
+	if (useCache)
 	{
-		for (auto shader : shaders)
+		if (GLuint program = LoadProgramBinary(key); program != 0)
 		{
-			glDeleteShader(shader);
+			++stats->programs.cacheHits;
+			SetProgram(program);
+			return;
 		}
-		return;
+
+		++stats->programs.cacheMisses;
 	}
 
 	GLuint program = glCreateProgram();
 
-	for (GLuint shader : shaders)
+	if (useCache)
 	{
-		if (glIsShader(shader))
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	for (u32 i = 0; i < m_shaders.size(); ++i)
+	{
+		GLuint shader = SubmitShader(m_shaders[i].type, sources[i].source);
+		glAttachShader(program, shader);
+		m_pendingShaders.push_back(shader);
+	}
+
+	glLinkProgram(program);
+
+	m_pendingId  = program;
+	m_pendingKey = useCache ? key : 0;
+
+	if (IsParallelCompileSupported())
+	{
+		if (std::find(g_pendingPrograms.begin(), g_pendingPrograms.end(), this) == g_pendingPrograms.end())
 		{
-			glAttachShader(program, shader);
+			g_pendingPrograms.push_back(this);
 		}
 	}
+	else
+	{
+		FinishBuild();
+	}
+}
 
-	glLinkProgram(program);
+bool Program::IsReady()
+{
+	if (m_pendingId != 0)
+	{
+		GLint completed = GL_TRUE;
+		if (IsParallelCompileSupported())
+		{
+			glGetProgramiv(m_pendingId, GL_COMPLETION_STATUS_KHR, &completed);
+		}
+
+		if (completed)
+		{
+			FinishBuild();
+		}
+	}
+
+	// While a rebuild is pending, the previous version stays usable
+	return m_id != 0;
+}
+
+void Program::FinishBuild()
+{
+	GLuint program = m_pendingId;
 
 	i32 linked = GL_FALSE;
 	glGetProgramiv(program, GL_LINK_STATUS, &linked);
 
 	if (!linked)
 	{
+		for (u32 i = 0; i < m_pendingShaders.size(); ++i)
+		{
+			PrintShaderErrors(m_shaders[i].filename.data(), m_pendingShaders[i]);
+		}
+
 		char error[512];
 		glGetProgramInfoLog(program, 512, nullptr, error);
 		fprintf(stderr, "Could not link program %s: %s\n", m_name.data(), error);
-		glDeleteProgram(program);
-		program = 0;
 	}
 
-	for (GLuint shader : shaders)
+	for (GLuint shader : m_pendingShaders)
 	{
-		if (glIsShader(shader))
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+	}
+
+	if (linked)
+	{
+		if (m_pendingKey != 0)
 		{
-			glDetachShader(program, shader);
-			glDeleteShader(shader);
+			SaveProgramBinary(m_pendingKey, program);
 		}
+
+		SetProgram(program);
+	}
+	else
+	{
+		glDeleteProgram(program);
+	}
+
+	m_pendingId  = 0;
+	m_pendingKey = 0;
+	m_pendingShaders.clear();
+}
+
+void Program::CancelBuild()
+{
+	if (m_pendingId == 0)
+	{
+		return;
 	}
 
-	if (glIsProgram(program))
+	for (GLuint shader : m_pendingShaders)
 	{
-		m_id = program;
-		GetUniformInfos();
+		glDeleteShader(shader);
 	}
+
+	glDeleteProgram(m_pendingId);
+
+	m_pendingId  = 0;
+	m_pendingKey = 0;
+	m_pendingShaders.clear();
+}
+
+void Program::SetProgram(GLuint program)
+{
+	if (glIsProgram(m_id))
+	{
+		glDeleteProgram(m_id);
+	}
+
+	m_id = program;
+	GetUniformInfos();
 }
 
 void Program::GetUniformInfos()
 {
-	m_uniforms.clear();
+	m_uniformTable.clear();
+	m_uniformMask = 0;
+
+#if _DEBUG
+	m_uniformNames.clear();
+#endif
 
 	GLint uniformCount = 0;
 	glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &uniformCount);
@@ -355,6 +569,19 @@ void Program::GetUniformInfos()
 		GLenum  type          = GL_NONE;
 		glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
 
+		u32 capacity = 8;
+		while (capacity < 2 * (u32)uniformCount)
+		{
+			capacity *= 2;
+		}
+
+		m_uniformTable.assign(capacity, {0, -1});
+		m_uniformMask = capacity - 1;
+
+#if _DEBUG
+		m_uniformNames.assign(capacity, "");
+#endif
+
 		char* uniformName = new char[maxNameLength];
 
 		for (GLint i = 0; i < uniformCount; ++i)
@@ -363,15 +590,42 @@ void Program::GetUniformInfos()
 
 			GLint location = glGetUniformLocation(m_id, uniformName);
 
-			m_uniforms.emplace(std::make_pair(std::string(uniformName, length), location));
+			const u64 hash64 = HashBytes(uniformName, length);
+			u32       hash   = (u32)(hash64 ^ (hash64 >> 32));
+			hash             = hash != 0 ? hash : 1u;
+
+			u32 slot = hash & m_uniformMask;
+			while (m_uniformTable[slot].hash != 0 && m_uniformTable[slot].hash != hash)
+			{
+				slot = (slot + 1) & m_uniformMask;
+			}
+
+			if (m_uniformTable[slot].hash == hash)
+			{
+				fprintf(stderr, "Uniform hash collision in program %s: %s\n", m_name.data(), uniformName);
+				continue;
+			}
+
+			m_uniformTable[slot] = {hash, location};
+
+#if _DEBUG
+			m_uniformNames[slot] = std::string(uniformName, length);
+#endif
 		}
 
 		delete[] uniformName;
 	}
 }
 
-GLint Program::GetLocation(const char* name) const
+void Program::CheckUniformCollision(u32 slot, UniformId id) const
 {
-	auto it = m_uniforms.find(name);
-	return (it == m_uniforms.end()) ? -1 : it->second;
+#if _DEBUG
+	if (strcmp(m_uniformNames[slot].c_str(), id.name) != 0)
+	{
+		fprintf(stderr, "Uniform %s collides with %s in program %s\n", id.name, m_uniformNames[slot].c_str(), m_name.data());
+	}
+#else
+	(void)slot;
+	(void)id;
+#endif
 }
@@ -1,22 +1,41 @@
 #pragma once
 
 #include "core/defines.h"
+#include "core/hash.h"
 
 #include <glad/glad.h>
 
 #include <glm/glm.hpp>
 
 #include <string>
-#include <filesystem>
-#include <unordered_map>
+#include <vector>
+
+#if _DEBUG
+#	include <string.h>
+#endif
 
 struct shader
 {
-	GLenum                          type;
-	std::string                     filename;
-	std::filesystem::file_time_type time;
+	GLenum      type;
+	std::string filename;
 };
 
+// Uniform names hashed at compile time, see UNIFORM()
+struct UniformId
+{
+	u32         hash; // Never 0, which marks empty slots
+	const char* name; // Diagnostics only
+};
+
+consteval UniformId MakeUniformId(const char* name)
+{
+	const u64 hash   = HashString(name);
+	const u32 folded = (u32)(hash ^ (hash >> 32));
+	return {folded != 0 ? folded : 1u, name};
+}
+
+#define UNIFORM(name) MakeUniformId(name)
+
 class Program
 {
 	using StringArray = std::vector<const char*>;
@@ -29,38 +48,102 @@ public:
 	static Program* MakeCompute(const char* name, const char* csfile, const StringArray& defines = StringArray());
 	static Program* GetProgramByName(const char* name);
 	static void     UpdateAllPrograms();
+	// Blocks until every submitted build is linked, the driver still compiles them in parallel
+	static void FinishPendingBuilds();
+	static u32  GetPendingBuildCount();
 
 	explicit Program(const char* name = "");
 
-	void Update();
+	// Small and stable across rebuilds, unlike the GL name
+	u32 GetSortId() const
+	{
+		return m_sortId;
+	}
+
+	// True if the file is one of the shaders or any file they include
+	bool DependsOn(const std::string& filename) const;
+
+	// Polls the background compilation, false until a first version is linked
+	bool IsReady();
+	bool IsPending() const
+	{
+		return m_pendingId != 0;
+	}
+
 	void Bind();
-	void SetUniform(const char* name, int32_t value) const;
-	void SetUniform(const char* name, u32 value) const;
-	void SetUniform(const char* name, f32 value) const;
-	void SetUniform(const char* name, const glm::vec2& value) const;
-	void SetUniform(const char* name, const glm::vec3& value) const;
-	void SetUniform(const char* name, const glm::vec4& value) const;
-	void SetUniform(const char* name, const glm::mat2& value) const;
-	void SetUniform(const char* name, const glm::mat3& value) const;
-	void SetUniform(const char* name, const glm::mat4& value) const;
+	void SetUniform(UniformId id, int32_t value) const;
+	void SetUniform(UniformId id, u32 value) const;
+	void SetUniform(UniformId id, f32 value) const;
+	void SetUniform(UniformId id, const glm::vec2& value) const;
+	void SetUniform(UniformId id, const glm::vec3& value) const;
+	void SetUniform(UniformId id, const glm::vec4& value) const;
+	void SetUniform(UniformId id, const glm::mat2& value) const;
+	void SetUniform(UniformId id, const glm::mat3& value) const;
+	void SetUniform(UniformId id, const glm::mat4& value) const;
 
 private:
 	void  Build();
+	void  FinishBuild();
+	void  CancelBuild();
+	void  SetProgram(GLuint program);
 	void  GetUniformInfos();
-	GLint GetLocation(const char* name) const;
+	void  CheckUniformCollision(u32 slot, UniformId id) const;
+
+	GLint GetLocation(UniformId id) const
+	{
+		if (m_uniformTable.empty())
+		{
+			return -1;
+		}
+
+		// Open addressing with linear probing, the table is at most half full
+		for (u32 i = id.hash & m_uniformMask;; i = (i + 1) & m_uniformMask)
+		{
+			const UniformSlot& slot = m_uniformTable[i];
+
+			if (slot.hash == id.hash)
+			{
+#if _DEBUG
+				CheckUniformCollision(i, id);
+#endif
+				return slot.location;
+			}
+
+			if (slot.hash == 0)
+			{
+				return -1;
+			}
+		}
+	}
 
 private:
 	using Shader  = std::pair<std::string, GLenum>;
 	using Shaders = std::vector<Shader>;
 
-	using ShaderTime  = std::pair<std::string, std::filesystem::file_time_type>;
-	using ShaderTimes = std::vector<ShaderTime>;
-
 	std::string m_name = nullptr;
 
-	std::unordered_map<std::string, GLint> m_uniforms;
+	struct UniformSlot
+	{
+		u32   hash;
+		GLint location;
+	};
 
-	GLuint              m_id = 0;
+	std::vector<UniformSlot> m_uniformTable;
+	u32                      m_uniformMask = 0;
+
+#if _DEBUG
+	std::vector<std::string> m_uniformNames;
+#endif
+
+	GLuint              m_id     = 0;
+	u32                 m_sortId = 0;
 	std::vector<shader> m_shaders;
 	StringArray         m_defines;
+
+	std::vector<std::string> m_dependencies;
+
+	// Build in flight
+	GLuint              m_pendingId  = 0;
+	u64                 m_pendingKey = 0;
+	std::vector<GLuint> m_pendingShaders;
 };
@@ -1,5 +1,7 @@
 #include "render_primitives.h"
 
+#include "renderer/gl_state.h"
+
 #include "core/defines.h"
 
 #include <glad/glad.h>
@@ -65,7 +67,7 @@ void RenderCube()
 		glBindBuffer(GL_ARRAY_BUFFER, g_cubeVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 		// link vertex attributes
-		glBindVertexArray(g_cubeVAO);
+		GLState::BindVertexArray(g_cubeVAO);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*)0);
 		glEnableVertexAttribArray(1);
@@ -73,10 +75,8 @@ void RenderCube()
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*)(6 * sizeof(f32)));
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
 	}
 	// render Cube
-	glBindVertexArray(g_cubeVAO);
+	GLState::BindVertexArray(g_cubeVAO);
 	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "render_queue.h"
+
+#include "core/utils.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <utility>
+
+u32 QuantizeSortDepth(f32 distance)
+{
+	const f32 depth = log2f(1.0f + Max(distance, 0.0f)) * 64.0f;
+	return (u32)Min(depth, (f32)((1u << SortKeyDepthBits) - 1));
+}
+
+void RenderQueue::Clear()
+{
+	m_packets.clear();
+}
+
+void RenderQueue::Push(u64 key, u32 drawIndex)
+{
+	m_packets.push_back({key, drawIndex});
+}
+
+void RenderQueue::Sort()
+{
+	const u32 count = (u32)m_packets.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	m_scratch.resize(count);
+
+	// All histograms in a single pass over the keys
+	u32 histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+
+	for (const RenderPacket& packet : m_packets)
+	{
+		for (u32 digit = 0; digit < 8; ++digit)
+		{
+			++histograms[digit][(packet.key >> (digit * 8)) & 0xFF];
+		}
+	}
+
+	RenderPacket* src = m_packets.data();
+	RenderPacket* dst = m_scratch.data();
+
+	for (u32 digit = 0; digit < 8; ++digit)
+	{
+		u32* histogram = histograms[digit];
+
+		// Every key shares this byte, the pass would be a plain copy
+		if (histogram[(src[0].key >> (digit * 8)) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		u32 offset = 0;
+		for (u32 i = 0; i < 256; ++i)
+		{
+			const u32 bucketCount = histogram[i];
+			histogram[i]          = offset;
+			offset += bucketCount;
+		}
+
+		for (u32 i = 0; i < count; ++i)
+		{
+			dst[histogram[(src[i].key >> (digit * 8)) & 0xFF]++] = src[i];
+		}
+
+		std::swap(src, dst);
+	}
+
+	if (src != m_packets.data())
+	{
+		m_packets.swap(m_scratch);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <vector>
+
+// Sort key layout, most significant first:
+//   pass (4) | program (16) | material (20) | mesh (14) | depth (10)
+// so that sorting groups draws by the most expensive state changes first, then front to back.
+enum RenderPass
+{
+	RenderPass_Opaque = 0,
+};
+
+constexpr u32 SortKeyDepthBits    = 10;
+constexpr u32 SortKeyMeshBits     = 14;
+constexpr u32 SortKeyMaterialBits = 20;
+constexpr u32 SortKeyProgramBits  = 16;
+
+constexpr u64 MakeSortKey(u32 pass, u32 program, u32 material, u32 mesh, u32 depth)
+{
+	constexpr u32 meshShift     = SortKeyDepthBits;
+	constexpr u32 materialShift = meshShift + SortKeyMeshBits;
+	constexpr u32 programShift  = materialShift + SortKeyMaterialBits;
+	constexpr u32 passShift     = programShift + SortKeyProgramBits;
+
+	return (u64)pass << passShift | (u64)(program & ((1u << SortKeyProgramBits) - 1)) << programShift |
+	       (u64)(material & ((1u << SortKeyMaterialBits) - 1)) << materialShift | (u64)(mesh & ((1u << SortKeyMeshBits) - 1)) << meshShift |
+	       (u64)(depth & ((1u << SortKeyDepthBits) - 1));
+}
+
+// Quantized distance, finer close to the camera
+u32 QuantizeSortDepth(f32 distance);
+
+struct RenderPacket
+{
+	u64 key;
+	u32 drawIndex;
+};
+
+class RenderQueue
+{
+public:
+	void Clear();
+	void Push(u64 key, u32 drawIndex);
+
+	// LSD radix sort on the keys, stable
+	void Sort();
+
+	const std::vector<RenderPacket>& GetPackets() const
+	{
+		return m_packets;
+	}
+
+private:
+	std::vector<RenderPacket> m_packets;
+	std::vector<RenderPacket> m_scratch;
+};
@@ -0,0 +1,134 @@
+#include "render_target_pool.h"
+
+#include "renderer/frame_stats.h"
+
+#include <stdio.h>
+
+RenderTargetPool* RenderTargetPool::Get()
+{
+	static RenderTargetPool pool;
+	return &pool;
+}
+
+glm::uvec2 RenderTargetPool::GetSizeClass(const glm::vec2& size)
+{
+	const u32 width  = (u32)size.x > 0 ? (u32)size.x : 1;
+	const u32 height = (u32)size.y > 0 ? (u32)size.y : 1;
+
+	return glm::uvec2((width + Granularity - 1) / Granularity * Granularity, (height + Granularity - 1) / Granularity * Granularity);
+}
+
+GLuint RenderTargetPool::Acquire(const RenderTargetDesc& desc)
+{
+	for (Entry& entry : m_entries)
+	{
+		if (!entry.inUse && entry.desc == desc)
+		{
+			entry.inUse = true;
+			return entry.texture;
+		}
+	}
+
+	Entry entry = {
+	    .desc  = desc,
+	    .inUse = true,
+	};
+
+	if (desc.samples > 1)
+	{
+		glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &entry.texture);
+		glTextureStorage2DMultisample(entry.texture, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+	}
+	else
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.texture);
+		glTextureStorage2D(entry.texture, desc.levels, desc.format, desc.width, desc.height);
+	}
+
+	m_entries.push_back(entry);
+
+	m_memoryUsage += GetSize(desc);
+	++m_allocations;
+
+	return entry.texture;
+}
+
+void RenderTargetPool::Release(GLuint texture)
+{
+	for (Entry& entry : m_entries)
+	{
+		if (entry.texture == texture)
+		{
+			assert(entry.inUse);
+
+			entry.inUse        = false;
+			entry.releaseFrame = m_frame;
+			return;
+		}
+	}
+
+	fprintf(stderr, "Render target %u does not belong to the pool\n", texture);
+}
+
+void RenderTargetPool::Update()
+{
+	++m_frame;
+
+	for (u32 i = 0; i < m_entries.size();)
+	{
+		const Entry& entry = m_entries[i];
+
+		if (!entry.inUse && m_frame - entry.releaseFrame > MaxIdleFrames)
+		{
+			glDeleteTextures(1, &entry.texture);
+			m_memoryUsage -= GetSize(entry.desc);
+
+			m_entries[i] = m_entries.back();
+			m_entries.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	FrameStats* stats = FrameStats::Get();
+
+	stats->renderTargets.textures    = (u32)m_entries.size();
+	stats->renderTargets.allocations = m_allocations;
+	stats->renderTargets.memory      = m_memoryUsage / (1024.0 * 1024.0);
+}
+
+u64 RenderTargetPool::GetSize(const RenderTargetDesc& desc)
+{
+	u64 texelSize = 4;
+
+	switch (desc.format)
+	{
+		case GL_RGBA32F:
+			texelSize = 16;
+			break;
+
+		case GL_RGBA16F:
+		case GL_RG32F:
+			texelSize = 8;
+			break;
+
+		default:
+			break;
+	}
+
+	// Each mip level is a quarter of the previous one
+	u64 texels = 0;
+	u64 width  = desc.width;
+	u64 height = desc.height;
+
+	for (u32 level = 0; level < desc.levels; ++level)
+	{
+		texels += width * height;
+		width  = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return texels * texelSize * desc.samples;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct RenderTargetDesc
+{
+	GLenum format;
+	u32    width;
+	u32    height;
+	u32    samples = 1; // Multisampled texture above 1
+	u32    levels  = 1;
+
+	bool operator==(const RenderTargetDesc& other) const = default;
+};
+
+// Owns the textures the renderer draws into. Released textures are kept for a while, so that going
+// back to a previous size, or another user asking for the same desc, does not allocate.
+class RenderTargetPool
+{
+public:
+	// Sizes are rounded up to that many pixels, so that small resizes keep the same allocation
+	static constexpr u32 Granularity = 256;
+	// Released textures nobody asked for during that many frames are deleted
+	static constexpr u32 MaxIdleFrames = 120;
+
+	static RenderTargetPool* Get();
+
+	static glm::uvec2 GetSizeClass(const glm::vec2& size);
+
+	// A texture matching desc, recycled when one was released
+	GLuint Acquire(const RenderTargetDesc& desc);
+	void   Release(GLuint texture);
+
+	// Deletes the textures idle for too long, once per frame
+	void Update();
+
+private:
+	struct Entry
+	{
+		GLuint           texture;
+		RenderTargetDesc desc;
+		u64              releaseFrame;
+		bool             inUse;
+	};
+
+	static u64 GetSize(const RenderTargetDesc& desc);
+
+private:
+	std::vector<Entry> m_entries;
+
+	u64 m_frame       = 0;
+	u64 m_memoryUsage = 0;
+	u32 m_allocations = 0;
+};
@@ -2,10 +2,68 @@
 
 #include "renderer/render_primitives.h"
 #include "renderer/frame_stats.h"
+#include "renderer/dfggen.h"
+#include "renderer/gl_state.h"
+#include "renderer/texture.h"
 
+#include "core/jobs.h"
 #include "core/utils.h"
 
-extern std::vector<glm::vec3> PrecomputeDFG(u32 w, u32 h, u32 sampleCount); // 128, 128, 512
+#include <float.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+// Below that many models, testing every box with SIMD beats walking the BVH
+constexpr u32 HierarchicalCullingThreshold = 256;
+
+// Frames the viewport must stay in a smaller size class before the render targets shrink
+constexpr u32 RenderTargetShrinkDelay = 60;
+
+struct HDRFormatInfo
+{
+	GLenum      format;
+	const char* imageFormat; // Layout qualifier of the post-process images
+	const char* name;
+};
+
+global_variable const HDRFormatInfo g_hdrFormats[HDRFormat_Count] = {
+    {GL_R11F_G11F_B10F, "HDR_IMAGE_FORMAT r11f_g11f_b10f", "R11G11B10F"},
+    {GL_RGBA16F, "HDR_IMAGE_FORMAT rgba16f", "RGBA16F"},
+    {GL_RGBA32F, "HDR_IMAGE_FORMAT rgba32f", "RGBA32F"},
+};
+
+// Length of the Halton (2, 3) sequence jittering the projection with TAA
+constexpr u32 TAAJitterSamples = 8;
+// Share of the history in the antialiased color
+constexpr f32 TAAHistoryWeight = 0.9f;
+
+// Depth bias of the shadow casters, on top of the normal offset of pbr.frag.glsl
+constexpr f32 ShadowSlopeBias    = 2.0f;
+constexpr f32 ShadowConstantBias = 4.0f;
+
+// Software occlusion buffer width, its height follows the aspect ratio
+constexpr u32 OcclusionBufferWidth = 320;
+constexpr u32 MaxOccludersPerFrame = 32;
+// Relative to the scene radius, smaller occluders rarely hide anything
+constexpr f32 OccluderMinSceneFraction = 0.02f;
+
+// Radical inverse of index in the given base, in [0, 1)
+static f32 Halton(u32 index, u32 base)
+{
+	f32 result   = 0.0f;
+	f32 fraction = 1.0f;
+
+	for (; index > 0; index /= base)
+	{
+		fraction /= base;
+		result += fraction * (index % base);
+	}
+
+	return result;
+}
 
 void Renderer::Initialize(const glm::vec2& initialSize)
 {
@@ -17,25 +75,64 @@ void Renderer::Initialize(const glm::vec2& initialSize)
 
 	m_backgroundProgram = Program::MakeRender("background", "background.vert.glsl", "background.frag.glsl");
 
-	m_highpassProgram = Program::MakeCompute("highpass", "highpass_filter.comp.glsl");
-	m_blurXProgram    = Program::MakeCompute("blurX", "blur.comp.glsl", {"HORIZONTAL_BLUR"});
-	m_blurYProgram    = Program::MakeCompute("blurY", "blur.comp.glsl", {"VERTICAL_BLUR"});
-	m_upsampleProgram = Program::MakeCompute("upsample", "upsample.comp.glsl");
+	std::vector<const char*> alphaTestedDefines = {"ALPHA_TESTED"};
+	if (IsBindlessTextureSupported())
+	{
+		alphaTestedDefines.push_back("BINDLESS_MATERIALS");
+	}
+
+	m_depthProgram            = Program::MakeRender("depth", "depth.vert.glsl", "depth.frag.glsl");
+	m_alphaTestedDepthProgram = Program::MakeRender("depthAlphaTested", "depth.vert.glsl", "depth.frag.glsl", alphaTestedDefines);
+
+	alphaTestedDefines.push_back("SHADOW_CASTER");
+
+	m_shadowProgram            = Program::MakeRender("shadow", "depth.vert.glsl", "depth.frag.glsl", {"SHADOW_CASTER"});
+	m_alphaTestedShadowProgram = Program::MakeRender("shadowAlphaTested", "depth.vert.glsl", "depth.frag.glsl", alphaTestedDefines);
+
 	m_outputProgram   = Program::MakeCompute("compose", "compose.comp.glsl");
+	m_velocityProgram = Program::MakeCompute("taaVelocity", "taa.comp.glsl", {"VELOCITY"});
+
+	// Both the color and the depth are multisampled
+	GLint maxColorSamples = 1;
+	GLint maxDepthSamples = 1;
+	glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxColorSamples);
+	glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &maxDepthSamples);
+
+	m_maxSamples    = (u32)Min(maxColorSamples, maxDepthSamples);
+	m_targetFormat  = (HDRFormat)Clamp(hdrFormat, 0, HDRFormat_Count - 1);
+	m_targetSamples = taa ? 1 : Clamp((u32)msaaSamples, 1u, m_maxSamples);
+	m_targetTAA     = taa;
 
-	glCreateTextures(GL_TEXTURE_2D, 1, &m_environment.iblDFG);
+	SelectPostProcessPrograms(m_targetFormat);
 
-	// glTextureStorage2D(equirectangularTexture, levels, GL_RGB32F, w, h);
-	glTextureStorage2D(m_environment.iblDFG, 1, GL_RGB32F, 128, 128);
+	glCreateTextures(GL_TEXTURE_2D, 1, &m_iblDFG);
+
+	glTextureStorage2D(m_iblDFG, 1, GL_RG16F, DFGSize, DFGSize);
 
 	Timer timer;
-	glTextureSubImage2D(m_environment.iblDFG, 0, 0, 0, 128, 128, GL_RGB, GL_FLOAT, PrecomputeDFG(128, 128, 1024).data());
-	glTextureParameteri(m_environment.iblDFG, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(m_environment.iblDFG, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(m_environment.iblDFG, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTextureParameteri(m_environment.iblDFG, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+#if SPARK_BAKED_DFG
+	glTextureSubImage2D(m_iblDFG, 0, 0, 0, DFGSize, DFGSize, GL_RG, GL_HALF_FLOAT, g_bakedDFG);
+#else
+	const std::vector<u32> dfg = PrecomputeDFG(DFGSize, DFGSize, DFGSampleCount);
+	glTextureSubImage2D(m_iblDFG, 0, 0, 0, DFGSize, DFGSize, GL_RG, GL_HALF_FLOAT, dfg.data());
+#endif
+	glTextureParameteri(m_iblDFG, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_iblDFG, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_iblDFG, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(m_iblDFG, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	FrameStats::Get()->ibl.precomputeDFG = timer.Tick();
 
+	m_environments.Initialize(m_iblDFG);
+
+	m_lighting.Initialize();
+	m_shadowMaps.Initialize();
+
+	if (GPUScene::IsSupported())
+	{
+		m_gpuScene.Initialize();
+		m_depthPyramid.Initialize();
+	}
+
 	glCreateFramebuffers(2, m_fbos);
 
 	Resize(initialSize);
@@ -43,66 +140,518 @@ void Renderer::Initialize(const glm::vec2& initialSize)
 
 void Renderer::Resize(const glm::vec2& newSize)
 {
-	if (m_framebufferSize != newSize)
+	if (newSize != m_framebufferSize)
+	{
+		m_historyValid = false;
+	}
+
+	m_framebufferSize = newSize;
+
+	// Growing can not wait, shrinking is left to UpdateRenderTargets()
+	if (newSize.x > m_targetSize.x || newSize.y > m_targetSize.y)
+	{
+		AllocateRenderTargets(RenderTargetPool::GetSizeClass(newSize));
+	}
+
+	if (GPUScene::IsSupported())
+	{
+		m_depthPyramid.Resize(newSize, m_targetSize);
+	}
+}
+
+glm::vec2 Renderer::GetOutputUVScale() const
+{
+	return m_framebufferSize / glm::vec2(m_targetSize);
+}
+
+void Renderer::UpdateRenderTargets()
+{
+	const glm::uvec2 sizeClass = RenderTargetPool::GetSizeClass(m_framebufferSize);
+
+	const HDRFormat format  = (HDRFormat)Clamp(hdrFormat, 0, HDRFormat_Count - 1);
+	const u32       samples = taa ? 1 : Clamp((u32)msaaSamples, 1u, m_maxSamples);
+
+	// The previous format is kept until the post-process programs of the new one compiled
+	if ((format == m_targetFormat || SelectPostProcessPrograms(format)) && (format != m_targetFormat || samples != m_targetSamples || taa != m_targetTAA))
+	{
+		m_targetFormat  = format;
+		m_targetSamples = samples;
+		m_targetTAA     = taa;
+
+		AllocateRenderTargets(m_targetSize);
+	}
+
+	if (sizeClass == m_targetSize)
+	{
+		m_shrinkFrames = 0;
+	}
+	else if (++m_shrinkFrames >= RenderTargetShrinkDelay)
+	{
+		AllocateRenderTargets(sizeClass);
+
+		if (GPUScene::IsSupported())
+		{
+			m_depthPyramid.Resize(m_framebufferSize, m_targetSize);
+		}
+	}
+
+	RenderTargetPool::Get()->Update();
+}
+
+void Renderer::AllocateRenderTargets(const glm::uvec2& size)
+{
+	RenderTargetPool* pool = RenderTargetPool::Get();
+
+	if (m_targetSize != glm::uvec2(0))
+	{
+		pool->Release(msaaRenderTexture);
+		pool->Release(msaaDepthTexture);
+		pool->Release(outputTexture);
+	}
+
+	for (u32& history : m_historyTextures)
+	{
+		if (history != 0)
+		{
+			pool->Release(history);
+			history = 0;
+		}
+	}
+
+	m_targetSize   = size;
+	m_shrinkFrames = 0;
+
+	// MSAA color and depth, the depth pyramid samples the depth. Plain 2D textures with a single sample
+	msaaRenderTexture = pool->Acquire({.format = g_hdrFormats[m_targetFormat].format, .width = size.x, .height = size.y, .samples = m_targetSamples});
+	msaaDepthTexture  = pool->Acquire({.format = GL_DEPTH24_STENCIL8, .width = size.x, .height = size.y, .samples = m_targetSamples});
+
+	glNamedFramebufferTexture(m_msaaFB, GL_COLOR_ATTACHMENT0, msaaRenderTexture, 0);
+	glNamedFramebufferTexture(m_msaaFB, GL_DEPTH_STENCIL_ATTACHMENT, msaaDepthTexture, 0);
+
+	if (glCheckNamedFramebufferStatus(m_msaaFB, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		fprintf(stderr, "MSAA framebuffer incomplete\n");
+	}
+
+	// Read by ImGui after the frame, the resolve and the bloom are transients of the frame graph
+	outputTexture = pool->Acquire({.format = GL_RGBA8, .width = size.x, .height = size.y});
+
+	m_historyValid = false;
+
+	if (m_targetTAA)
+	{
+		for (u32& history : m_historyTextures)
+		{
+			history = pool->Acquire({.format = g_hdrFormats[m_targetFormat].format, .width = size.x, .height = size.y});
+
+			glTextureParameteri(history, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTextureParameteri(history, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTextureParameteri(history, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(history, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+	}
+}
+
+void Renderer::Shutdown()
+{
+	m_environments.Shutdown();
+
+	if (GPUScene::IsSupported())
+	{
+		m_gpuScene.Shutdown();
+	}
+}
+
+bool Renderer::SelectPostProcessPrograms(HDRFormat format)
+{
+	const HDRFormatInfo& info   = g_hdrFormats[format];
+	const std::string    suffix = std::string("_") + info.name;
+
+	Program* highpass = Program::MakeCompute(("highpass" + suffix).c_str(), "highpass_filter.comp.glsl", {info.imageFormat});
+	Program* blurX    = Program::MakeCompute(("blurX" + suffix).c_str(), "blur.comp.glsl", {"HORIZONTAL_BLUR", info.imageFormat});
+	Program* blurY    = Program::MakeCompute(("blurY" + suffix).c_str(), "blur.comp.glsl", {"VERTICAL_BLUR", info.imageFormat});
+	Program* upsample = Program::MakeCompute(("upsample" + suffix).c_str(), "upsample.comp.glsl", {info.imageFormat});
+	Program* taa      = Program::MakeCompute(("taa" + suffix).c_str(), "taa.comp.glsl", {info.imageFormat});
+
+	// Nothing to fall back to on the first call
+	const bool ready = blurX->IsReady() && blurY->IsReady() && upsample->IsReady() && taa->IsReady();
+	if (!ready && m_blurXProgram != nullptr)
+	{
+		return false;
+	}
+
+	m_highpassProgram = highpass;
+	m_blurXProgram    = blurX;
+	m_blurYProgram    = blurY;
+	m_upsampleProgram = upsample;
+	m_taaProgram      = taa;
+
+	return true;
+}
+
+void Renderer::OnSceneLoaded(const std::vector<Model>& models)
+{
+	m_sceneBounds.Resize((u32)models.size());
+
+	for (u32 i = 0; i < models.size(); ++i)
+	{
+		const Model& model = models[i];
+		m_sceneBounds.Set(i, model.mesh->boundsMin, model.mesh->boundsMax, model.worldTransform);
+	}
+
+	Timer timer;
+	m_bvh.Build(m_sceneBounds);
+	FrameStats::Get()->bvh.build = timer.Tick();
+	FrameStats::Get()->bvh.nodes = m_bvh.GetNodeCount();
+
+	UpdateSceneExtent();
+
+	const f32 minOccluderRadius = OccluderMinSceneFraction * 0.5f * glm::length(m_sceneMax - m_sceneMin);
+
+	m_occluders.clear();
+	for (u32 i = 0; i < models.size(); ++i)
 	{
-		if (glIsTexture(msaaRenderTexture))
+		if (!models[i].mesh->occluderIndices.empty() && glm::length(m_sceneBounds.GetExtent(i)) >= minOccluderRadius)
 		{
-			glDeleteTextures(1, &msaaRenderTexture);
-			glDeleteTextures(1, &resolveTexture);
-			glDeleteTextures(1, &outputTexture);
-			glDeleteTextures(1, bloomTextures);
-			glDeleteTextures(1, &averageLuminanceTexture);
-			glDeleteRenderbuffers(1, &msaaDepthRenderBuffer);
+			m_occluders.push_back(i);
 		}
+	}
+
+	std::unordered_map<const Material*, u32> materialIndices;
 
-		// Create MSAA texture and attach it to FBO
-		glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &msaaRenderTexture);
-		glTextureStorage2DMultisample(msaaRenderTexture, 4, GL_RGBA32F, newSize.x, newSize.y, GL_TRUE);
-		glNamedFramebufferTexture(m_msaaFB, GL_COLOR_ATTACHMENT0, msaaRenderTexture, 0);
+	m_materials.clear();
+	m_modelMaterials.resize(models.size());
 
-		// Create MSAA DS rendertarget and attach it to FBO
-		glCreateRenderbuffers(1, &msaaDepthRenderBuffer);
-		glNamedRenderbufferStorageMultisample(msaaDepthRenderBuffer, 4, GL_DEPTH24_STENCIL8, newSize.x, newSize.y);
-		glNamedFramebufferRenderbuffer(m_msaaFB, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, msaaDepthRenderBuffer);
+	m_gpuSceneAvailable = GPUScene::IsSupported();
 
-		if (glCheckNamedFramebufferStatus(m_msaaFB, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	for (u32 i = 0; i < models.size(); ++i)
+	{
+		auto [it, inserted] = materialIndices.try_emplace(models[i].material, (u32)m_materials.size());
+		if (inserted)
 		{
-			fprintf(stderr, "MSAA framebuffer incomplete\n");
+			m_materials.push_back(models[i].material);
 		}
 
-		glCreateTextures(GL_TEXTURE_2D, 1, &resolveTexture);
-		glTextureStorage2D(resolveTexture, 1, GL_RGBA32F, newSize.x, newSize.y);
-		glNamedFramebufferTexture(m_resolveFB, GL_COLOR_ATTACHMENT0, resolveTexture, 0);
-		glTextureParameteri(resolveTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTextureParameteri(resolveTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		m_modelMaterials[i] = it->second;
+
+		// Multi-draws can only reach the shared buffers
+		m_gpuSceneAvailable &= models[i].mesh->vao == GeometryPool::Get()->GetVertexArray();
+	}
+
+	if (m_gpuSceneAvailable)
+	{
+		m_gpuScene.Build(models, m_modelMaterials, m_materials, m_sceneBounds);
+	}
+
+	m_shadowMaps.Invalidate();
+}
+
+void Renderer::OnTransformsChanged(const std::vector<Model>& models)
+{
+	for (u32 i = 0; i < models.size(); ++i)
+	{
+		const Model& model = models[i];
+		m_sceneBounds.Set(i, model.mesh->boundsMin, model.mesh->boundsMax, model.worldTransform);
+	}
+
+	Timer timer;
+	m_bvh.Refit(m_sceneBounds);
+	FrameStats::Get()->bvh.refit = timer.Tick();
+
+	UpdateSceneExtent();
+
+	if (m_gpuSceneAvailable)
+	{
+		m_gpuScene.UpdateTransforms(models, m_sceneBounds);
+	}
+
+	// The cached cascades assume static casters
+	m_shadowMaps.Invalidate();
+}
+
+void Renderer::UpdateSceneExtent()
+{
+	glm::vec3 sceneMin = glm::vec3(FLT_MAX);
+	glm::vec3 sceneMax = glm::vec3(-FLT_MAX);
+
+	for (u32 i = 0; i < m_sceneBounds.GetCount(); ++i)
+	{
+		sceneMin = glm::min(sceneMin, m_sceneBounds.GetCenter(i) - m_sceneBounds.GetExtent(i));
+		sceneMax = glm::max(sceneMax, m_sceneBounds.GetCenter(i) + m_sceneBounds.GetExtent(i));
+	}
+
+	m_sceneMin = m_sceneBounds.GetCount() > 0 ? sceneMin : glm::vec3(0.0f);
+	m_sceneMax = m_sceneBounds.GetCount() > 0 ? sceneMax : glm::vec3(0.0f);
+}
+
+void Renderer::BeginDepthPrepass()
+{
+	GLState::SetColorMask(false);
+	GLState::SetDepthMask(true);
+	GLState::SetDepthFunc(GL_LEQUAL);
+}
+
+void Renderer::BeginShading(bool afterPrepass)
+{
+	GLState::SetColorMask(true);
 
-		if (glCheckNamedFramebufferStatus(m_resolveFB, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	// The pre-pass already wrote the final depth, only the fragments that produced it pass
+	GLState::SetDepthMask(!afterPrepass);
+	GLState::SetDepthFunc(afterPrepass ? GL_EQUAL : GL_LEQUAL);
+}
+
+void Renderer::DrawRenderQueue(const std::vector<Model>& models, bool depthOnly)
+{
+	FrameStats* stats = FrameStats::Get();
+
+	const Program*  currentProgram  = nullptr;
+	const Material* currentMaterial = nullptr;
+	const Mesh*     currentMesh     = nullptr;
+
+	// Only emit the state that differs from the previous packet
+	for (const RenderPacket& packet : m_renderQueue.GetPackets())
+	{
+		const Model& model       = models[m_visibleModels[packet.drawIndex]];
+		const bool   alphaTested = model.material->IsAlphaTested();
+
+		Program* program = model.material->GetProgram();
+		if (depthOnly)
 		{
-			fprintf(stderr, "Resolve framebuffer incomplete\n");
+			program = alphaTested ? m_alphaTestedDepthProgram : m_depthProgram;
 		}
 
-		glCreateTextures(GL_TEXTURE_2D, 1, &outputTexture);
-		glTextureStorage2D(outputTexture, 1, GL_RGBA8, newSize.x, newSize.y);
+		if (program != currentProgram)
+		{
+			program->Bind();
+			currentProgram = program;
+			++stats->frame.programChanges;
+		}
 
-		i32 mipCount = log2(Min(newSize.x, newSize.y)) - 1;
-		glCreateTextures(GL_TEXTURE_2D, 2, bloomTextures);
-		glTextureStorage2D(bloomTextures[0], mipCount, GL_RGBA32F, newSize.x * 0.5, newSize.y * 0.5);
-		glTextureStorage2D(bloomTextures[1], mipCount, GL_RGBA32F, newSize.x * 0.5, newSize.y * 0.5);
+		// The depth-only pass only samples the albedo of alpha tested materials
+		if (model.material != currentMaterial && (!depthOnly || alphaTested))
+		{
+			model.material->Bind();
+			currentMaterial = model.material;
+			++stats->frame.materialChanges;
+		}
 
-		glTextureParameteri(bloomTextures[0], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTextureParameteri(bloomTextures[0], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTextureParameteri(bloomTextures[0], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTextureParameteri(bloomTextures[0], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		if (model.mesh != currentMesh)
+		{
+			if (depthOnly && !alphaTested)
+				model.mesh->BindDepth();
+			else
+				model.mesh->Bind();
 
-		glTextureParameteri(bloomTextures[1], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTextureParameteri(bloomTextures[1], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTextureParameteri(bloomTextures[1], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTextureParameteri(bloomTextures[1], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			currentMesh = model.mesh;
+			++stats->frame.meshChanges;
+		}
 
-		glCreateTextures(GL_TEXTURE_2D, 1, &averageLuminanceTexture);
+		// Transforms and material indices are read from the draw data at drawIndex
+		model.mesh->DrawWithBaseInstance(packet.drawIndex);
+	}
+}
+
+u32 Renderer::DrawGPUScene(CullPhase phase, bool prepass)
+{
+	u32 drawCalls = 0;
 
-		m_framebufferSize = newSize;
+	if (prepass)
+	{
+		Timer prepassTimer;
+		BeginDepthPrepass();
+		drawCalls += m_gpuScene.DrawDepth(phase, m_depthProgram, m_alphaTestedDepthProgram);
+		FrameStats::Get()->frame.zPrepass += prepassTimer.Tick();
 	}
+
+	BeginShading(prepass);
+	drawCalls += m_gpuScene.Draw(phase);
+
+	return drawCalls;
+}
+
+void Renderer::CullModels(const Frustum& frustum, std::vector<u8>* visibility) const
+{
+	if (m_sceneBounds.GetCount() >= HierarchicalCullingThreshold)
+	{
+		m_bvh.Cull(frustum, visibility);
+	}
+	else
+	{
+		m_sceneBounds.Cull(frustum, visibility);
+	}
+}
+
+void Renderer::CullShadowCasters(const CameraInfos& camera, const std::vector<Model>& models)
+{
+	m_shadowCasters.clear();
+
+	m_shadowMaps.Update(camera.view, camera.proj, lightDirection, m_sceneMin, m_sceneMax);
+
+	for (u32 cascade = 0; cascade < ShadowCascadeCount; ++cascade)
+	{
+		m_shadowCasterCounts[cascade] = 0;
+
+		if (!m_shadowMaps.IsDirty(cascade))
+		{
+			continue;
+		}
+
+		// The near plane of the cascade reaches the scene bounds, so every caster is kept
+		CullModels(m_shadowMaps.GetFrustum(cascade), &m_shadowVisibility);
+
+		for (u32 i = 0; i < models.size(); ++i)
+		{
+			if (m_shadowVisibility[i])
+			{
+				m_shadowCasters.push_back(i);
+				++m_shadowCasterCounts[cascade];
+			}
+		}
+	}
+}
+
+void Renderer::RenderShadows(const std::vector<Model>& models, u32 firstDraw)
+{
+	FrameStats* stats = FrameStats::Get();
+
+	GLState::SetColorMask(false);
+	GLState::SetDepthTest(true);
+	GLState::SetDepthMask(true);
+	GLState::SetDepthFunc(GL_LEQUAL);
+
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(ShadowSlopeBias, ShadowConstantBias);
+
+	u32 drawIndex = firstDraw;
+
+	for (u32 cascade = 0; cascade < ShadowCascadeCount; ++cascade)
+	{
+		if (!m_shadowMaps.IsDirty(cascade))
+		{
+			continue;
+		}
+
+		m_shadowMaps.BeginCascade(cascade);
+		++stats->frame.shadowCascades;
+
+		m_alphaTestedShadowProgram->Bind();
+		m_alphaTestedShadowProgram->SetUniform(UNIFORM("viewProj"), m_shadowMaps.GetViewProj(cascade));
+		m_shadowProgram->Bind();
+		m_shadowProgram->SetUniform(UNIFORM("viewProj"), m_shadowMaps.GetViewProj(cascade));
+
+		const Program*  currentProgram  = m_shadowProgram;
+		const Material* currentMaterial = nullptr;
+		const Mesh*     currentMesh     = nullptr;
+
+		for (u32 i = 0; i < m_shadowCasterCounts[cascade]; ++i, ++drawIndex)
+		{
+			const Model& model       = models[m_shadowCasters[drawIndex - firstDraw]];
+			const bool   alphaTested = model.material->IsAlphaTested();
+
+			Program* program = alphaTested ? m_alphaTestedShadowProgram : m_shadowProgram;
+			if (program != currentProgram)
+			{
+				program->Bind();
+				currentProgram = program;
+			}
+
+			if (alphaTested && model.material != currentMaterial)
+			{
+				model.material->Bind();
+				currentMaterial = model.material;
+			}
+
+			if (model.mesh != currentMesh)
+			{
+				if (alphaTested)
+					model.mesh->Bind();
+				else
+					model.mesh->BindDepth();
+
+				currentMesh = model.mesh;
+			}
+
+			model.mesh->DrawWithBaseInstance(drawIndex);
+		}
+
+		stats->frame.shadowDraws += m_shadowCasterCounts[cascade];
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+}
+
+void Renderer::CullOccluded(const CameraInfos& camera, const std::vector<Model>& models, const glm::mat4& viewProj)
+{
+	m_frameOccluders.clear();
+
+	for (u32 index : m_occluders)
+	{
+		if (m_visibility[index])
+		{
+			const f32 radius   = glm::length(m_sceneBounds.GetExtent(index));
+			const f32 distance = glm::length(m_sceneBounds.GetCenter(index) - camera.position);
+
+			m_frameOccluders.push_back({radius / Max(distance, 1e-3f), index});
+		}
+	}
+
+	if (m_frameOccluders.empty())
+	{
+		return;
+	}
+
+	// The closest and largest occluders hide the most
+	if (m_frameOccluders.size() > MaxOccludersPerFrame)
+	{
+		std::nth_element(m_frameOccluders.begin(), m_frameOccluders.begin() + MaxOccludersPerFrame, m_frameOccluders.end(), std::greater<>());
+		m_frameOccluders.resize(MaxOccludersPerFrame);
+	}
+
+	const u32 height = Max((u32)(OcclusionBufferWidth * m_framebufferSize.y / m_framebufferSize.x), OcclusionBuffer::TileHeight);
+
+	m_occlusionBuffer.Begin(viewProj, OcclusionBufferWidth, height);
+
+	for (const auto& [size, index] : m_frameOccluders)
+	{
+		const Mesh* mesh = models[index].mesh;
+		m_occlusionBuffer.AddOccluder(mesh->occluderPositions, mesh->occluderIndices, models[index].worldTransform);
+	}
+
+	m_occlusionBuffer.Rasterize();
+
+	std::atomic<u32> occluded = 0;
+
+	Jobs::ParallelFor((u32)models.size(), 256, [&](u32 begin, u32 end) {
+		u32 count = 0;
+
+		for (u32 i = begin; i < end; ++i)
+		{
+			if (m_visibility[i] && m_occlusionBuffer.IsOccluded(m_sceneBounds.GetCenter(i), m_sceneBounds.GetExtent(i)))
+			{
+				m_visibility[i] = 0;
+				++count;
+			}
+		}
+
+		occluded += count;
+	});
+
+	FrameStats* stats = FrameStats::Get();
+
+	stats->frame.occludedModels    = occluded;
+	stats->frame.occluders         = (u32)m_frameOccluders.size();
+	stats->frame.occluderTriangles = m_occlusionBuffer.GetTriangleCount();
+}
+
+bool Renderer::IsGPUDriven() const
+{
+	return gpuDriven && m_gpuSceneAvailable;
+}
+
+i32 Renderer::Pick(const glm::vec3& origin, const glm::vec3& direction) const
+{
+	f32 distance;
+	return m_bvh.Raycast(origin, direction, &distance);
 }
 
 void Renderer::Render(const CameraInfos& camera, const std::vector<Model>& models)
@@ -111,54 +660,284 @@ void Renderer::Render(const CameraInfos& camera, const std::vector<Model>& model
 	Timer       timer;
 	Timer       frameTimer;
 
+	// ImGui and the driver may have touched anything since the last frame
+	GLState::Invalidate();
+
+	UpdateRenderTargets();
+
 	Program::UpdateAllPrograms();
 	stats->frame.updatePrograms = timer.Tick();
 
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_msaaFB);
+	assert(m_sceneBounds.GetCount() == models.size());
+
+	const Frustum frustum   = MakeFrustum(camera.proj * camera.view);
+	const bool    gpuDriven = IsGPUDriven();
+
+	m_visibleModels.clear();
+
+	// The GPU path culls in the compute pass instead
+	if (!gpuDriven)
+	{
+		CullModels(frustum, &m_visibility);
+
+		stats->frame.occludedModels    = 0;
+		stats->frame.occluders         = 0;
+		stats->frame.occluderTriangles = 0;
+
+		stats->frame.softwareOcclusion = 0.0;
+
+		if (softwareOcclusion && !m_occluders.empty())
+		{
+			Timer occlusionTimer;
+			CullOccluded(camera, models, camera.proj * camera.view);
+			stats->frame.softwareOcclusion = occlusionTimer.Tick();
+		}
+
+		for (u32 i = 0; i < models.size(); ++i)
+		{
+			if (m_visibility[i])
+			{
+				m_visibleModels.push_back(i);
+			}
+		}
+
+		stats->frame.visibleModels = (u32)m_visibleModels.size();
+		stats->frame.culledModels  = (u32)models.size() - (u32)m_visibleModels.size();
+	}
+
+	const u32 drawCount = (u32)m_visibleModels.size();
+
+	stats->frame.culling = timer.Tick();
+
+	Timer shadowTimer;
+
+	// Only the cascades whose cached map went stale get casters
+	const bool castShadows = shadows && lightIntensity > 0.0f && m_shadowProgram->IsReady() && m_alphaTestedShadowProgram->IsReady();
+
+	m_shadowCasters.clear();
+
+	if (castShadows)
+	{
+		CullShadowCasters(camera, models);
+	}
+
+	const u32 shadowDrawCount = (u32)m_shadowCasters.size();
+
+	stats->frame.shadows = shadowTimer.Tick();
+
+	m_environments.Update();
+	Environment* env = GetEnvironment();
+
+	// Sub-pixel offset of the whole image, the TAA pass accumulates the offsets over the frames
+	glm::mat4 proj   = camera.proj;
+	glm::vec2 jitter = glm::vec2(0.0f);
+
+	if (m_targetTAA)
+	{
+		const u32 sample = m_taaFrame++ % TAAJitterSamples + 1;
+
+		jitter = glm::vec2(Halton(sample, 2), Halton(sample, 3)) - 0.5f;
+		proj[2][0] += jitter.x * 2.0f / m_framebufferSize.x;
+		proj[2][1] += jitter.y * 2.0f / m_framebufferSize.y;
+	}
+
+	RenderContext context = {
+	    .eyePosition    = camera.position,
+	    .view           = camera.view,
+	    .proj           = proj,
+	    .lightDirection = glm::normalize(lightDirection),
+	    .env            = env,
+	};
+
+	FrameData frameData = {
+	    .view           = context.view,
+	    .proj           = context.proj,
+	    .eyePosition    = context.eyePosition,
+	    .lightDirection = context.lightDirection,
+	    .lightColor     = glm::vec4(lightColor * lightIntensity, 0.0f),
+	};
+
+	for (u32 i = 0; i < 6; ++i)
+	{
+		frameData.frustumPlanes[i] = frustum.planes[i];
+	}
+
+	m_lighting.Update(lights, proj, m_framebufferSize, &frameData);
+
+	if (castShadows)
+	{
+		m_shadowMaps.WriteFrameData(&frameData);
+	}
+
+	// A variant may have been enabled in the material editor
+	if (gpuDriven && m_gpuScene.IsOutdated(m_materials))
+	{
+		m_gpuScene.Build(models, m_modelMaterials, m_materials, m_sceneBounds);
+	}
+
+	// The casters are drawn from the draw data following the camera draws
+	m_frameData.Begin(frameData, drawCount + shadowDrawCount, (u32)m_materials.size());
+
+	MaterialData* materials = m_frameData.GetMaterialData();
+	for (u32 i = 0; i < m_materials.size(); ++i)
+	{
+		m_materials[i]->WriteMaterialData(&materials[i]);
+	}
+
+	DrawData* draws = m_frameData.GetDrawData();
+
+	m_renderQueue.Clear();
+
+	for (u32 i = 0; i < drawCount; ++i)
+	{
+		const u32    modelIndex = m_visibleModels[i];
+		const Model& model      = models[modelIndex];
+
+		draws[i].model         = model.worldTransform;
+		draws[i].normalMatrix  = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model.worldTransform))));
+		draws[i].materialIndex = m_modelMaterials[modelIndex];
+
+		const f32 distance = glm::length(m_sceneBounds.GetCenter(modelIndex) - camera.position);
+		const u32 program  = model.material->GetProgram()->GetSortId();
+		const u32 material = model.material->GetSortId();
+
+		m_renderQueue.Push(MakeSortKey(RenderPass_Opaque, program, material, model.mesh->vao, QuantizeSortDepth(distance)), i);
+	}
+
+	m_renderQueue.Sort();
+
+	// The depth shaders do not read the normal matrix
+	for (u32 i = 0; i < shadowDrawCount; ++i)
+	{
+		const u32 modelIndex = m_shadowCasters[i];
+
+		draws[drawCount + i].model         = models[modelIndex].worldTransform;
+		draws[drawCount + i].materialIndex = m_modelMaterials[modelIndex];
+	}
+
+	m_frameData.Bind();
+
+	stats->frame.shadowCascades = 0;
+	stats->frame.shadowDraws    = 0;
+
+	if (castShadows)
+	{
+		shadowTimer.Tick();
+		RenderShadows(models, drawCount);
+		stats->frame.shadows += shadowTimer.Tick();
+	}
+
+	Timer lightTimer;
+	m_lighting.Build();
+	stats->frame.lightCulling = lightTimer.Tick();
+	stats->frame.lights       = (u32)lights.size();
+
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_msaaFB);
 
 	glViewport(0, 0, m_framebufferSize.x, m_framebufferSize.y);
 
+	// The shadow pass may have left the depth writes or the color writes off
+	GLState::SetDepthTest(true);
+	GLState::SetDepthFunc(GL_LEQUAL);
+	GLState::SetDepthMask(true);
+	GLState::SetColorMask(true);
+
 	glClearDepth(1.0f);
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
+	// Shared by every material
+	GLState::BindTextureUnit(TextureUnit_Irradiance, env->irradianceMap);
+	GLState::BindTextureUnit(TextureUnit_Radiance, env->radianceMap);
+	GLState::BindTextureUnit(TextureUnit_DFG, env->iblDFG);
+	GLState::BindTextureUnit(TextureUnit_Shadow, m_shadowMaps.GetTexture());
 
-	RenderContext context = {
-	    .eyePosition = camera.position,
-	    .view        = camera.view,
-	    .proj        = camera.proj,
-	    .env         = GetEnvironment(),
-	};
+	stats->frame.programChanges  = 0;
+	stats->frame.materialChanges = 0;
+	stats->frame.meshChanges     = 0;
+	stats->frame.zPrepass        = 0.0;
+
+	// Lays down the depth first, so that the shading pass only shades the visible fragments
+	const bool prepass = depthPrepass && m_depthProgram->IsReady() && m_alphaTestedDepthProgram->IsReady();
+
+	if (gpuDriven)
+	{
+		m_gpuScene.BeginFrame();
+
+		// One multi-draw per program, the draw and material data are indexed from the base instance
+		if (occlusionCulling)
+		{
+			m_gpuScene.Cull(CullPhase_Early);
+			stats->frame.drawCalls = DrawGPUScene(CullPhase_Early, prepass);
+
+			Timer pyramidTimer;
+			m_depthPyramid.Build(msaaDepthTexture, m_targetSamples);
+			stats->frame.depthPyramid = pyramidTimer.Tick();
 
-	for (auto&& model : models)
+			m_gpuScene.Cull(CullPhase_Late, &m_depthPyramid);
+			stats->frame.drawCalls += DrawGPUScene(CullPhase_Late, prepass);
+		}
+		else
+		{
+			m_gpuScene.Cull(CullPhase_All);
+			stats->frame.drawCalls = DrawGPUScene(CullPhase_All, prepass);
+		}
+
+		m_gpuScene.EndFrame();
+
+		const CullStatistics& culling = m_gpuScene.GetStatistics();
+
+		stats->frame.visibleModels  = culling.earlyDraws + culling.lateDraws;
+		stats->frame.culledModels   = culling.frustumCulled + culling.occlusionCulled;
+		stats->frame.occludedModels = culling.occlusionCulled;
+		stats->frame.earlyDraws     = culling.earlyDraws;
+		stats->frame.lateDraws      = culling.lateDraws;
+		stats->frame.programChanges = stats->frame.drawCalls;
+	}
+	else
 	{
-		model.Draw(&context);
+		if (prepass)
+		{
+			Timer prepassTimer;
+			BeginDepthPrepass();
+			DrawRenderQueue(models, true);
+			stats->frame.zPrepass = prepassTimer.Tick();
+		}
+
+		BeginShading(prepass);
+		DrawRenderQueue(models, false);
+
+		stats->frame.drawCalls = prepass ? 2 * drawCount : drawCount;
 	}
 
+	// The background and the next clear expect the default depth state
+	GLState::SetDepthFunc(GL_LEQUAL);
+	GLState::SetDepthMask(true);
+
+	m_frameData.End();
+
 	stats->frame.renderModels = timer.Tick();
 
 	if (backgroundType != BackgroundType_None)
 	{
 		m_backgroundProgram->Bind();
-		m_backgroundProgram->SetUniform("envmap", 0);
-		m_backgroundProgram->SetUniform("miplevel", backgroundType == BackgroundType_Radiance ? backgroundMipLevel : 0);
-		m_backgroundProgram->SetUniform("view", context.view);
-		m_backgroundProgram->SetUniform("proj", context.proj);
+		m_backgroundProgram->SetUniform(UNIFORM("envmap"), 0);
+		m_backgroundProgram->SetUniform(UNIFORM("miplevel"), backgroundType == BackgroundType_Radiance ? backgroundMipLevel : 0);
+		m_backgroundProgram->SetUniform(UNIFORM("view"), context.view);
+		m_backgroundProgram->SetUniform(UNIFORM("proj"), context.proj);
 
 		switch (backgroundType)
 		{
 			case BackgroundType_Cubemap:
-				glBindTextureUnit(0, m_environment.envMap);
+				GLState::BindTextureUnit(0, env->envMap);
 				break;
 
 			case BackgroundType_Radiance:
-				glBindTextureUnit(0, m_environment.radianceMap);
+				GLState::BindTextureUnit(0, env->radianceMap);
 				break;
 
 			case BackgroundType_Irradiance:
-				glBindTextureUnit(0, m_environment.irradianceMap);
+				GLState::BindTextureUnit(0, env->irradianceMap);
 				break;
 		}
 
@@ -167,121 +946,224 @@ void Renderer::Render(const CameraInfos& camera, const std::vector<Model>& model
 
 	stats->frame.background = timer.Tick();
 
-	glBlitNamedFramebuffer(m_msaaFB,
-	                       m_resolveFB,
-	                       0,
-	                       0,
-	                       m_framebufferSize.x,
-	                       m_framebufferSize.y,
-	                       0,
-	                       0,
-	                       m_framebufferSize.x,
-	                       m_framebufferSize.y,
-	                       GL_COLOR_BUFFER_BIT,
-	                       GL_NEAREST);
+	// Post-process chain, declared every frame so that the graph drops what is disabled
+	m_frameGraph.Reset();
 
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	const GLenum colorFormat = g_hdrFormats[m_targetFormat].format;
 
-	stats->frame.resolveMSAA = timer.Tick();
+	const RenderTargetDesc resolvedDesc = {.format = colorFormat, .width = m_targetSize.x, .height = m_targetSize.y};
+	const RenderTargetDesc bloomDesc    = {
+        .format = colorFormat,
+        .width  = m_targetSize.x / 2,
+        .height = m_targetSize.y / 2,
+        .levels = (u32)log2(Min(m_targetSize.x, m_targetSize.y)) - 1,
+    };
 
-	glm::vec2 size = m_framebufferSize / 2.0f;
+	// A single sample needs no resolve, the post-process reads the scene color directly
+	const bool multisampled = m_targetSamples > 1;
 
-	// Zero buffer
-	// std::vector<u8> zeros(m_framebufferSize.x * m_framebufferSize.y * sizeof(f32), 0);
-	// for (i32 i = 0; i < bloomWidth; ++i, size /= 2.0f)
-	// {
-	// 	glClearTexSubImage(bloomTextures[0], i, 0, 0, 0, size.x, size.y, 1, GL_RGBA, GL_FLOAT, zeros.data());
-	// 	glClearTexSubImage(bloomTextures[1], i, 0, 0, 0, size.x, size.y, 1, GL_RGBA, GL_FLOAT, zeros.data());
-	// }
+	const FrameGraphResource sceneColor = m_frameGraph.Import("SceneColor", msaaRenderTexture);
+	const FrameGraphResource output     = m_frameGraph.Import("Output", outputTexture);
+	const FrameGraphResource resolved   = multisampled ? m_frameGraph.Create("Resolved", resolvedDesc) : sceneColor;
+	const FrameGraphResource bloom0     = m_frameGraph.Create("Bloom0", bloomDesc);
+	const FrameGraphResource bloom1     = m_frameGraph.Create("Bloom1", bloomDesc);
 
-	// size = m_framebufferSize / 2.0f;
+	stats->frame.resolveMSAA          = 0.0;
+	stats->frame.highpassAndLuminance = 0.0;
+	stats->frame.bloomDownsample      = 0.0;
+	stats->frame.bloomUpsample        = 0.0;
 
-	// Highpass + downsample
-	// m_highpassProgram->Bind();
-	// m_highpassProgram->SetUniform("viewportSize", m_bloomBufferSize);
-	// m_highpassProgram->SetUniform("threshold", bloomThreshold);
+	if (multisampled)
+	{
+		m_frameGraph.AddPass("ResolveMSAA", {{sceneColor, ResourceAccess_Framebuffer}}, {{resolved, ResourceAccess_Framebuffer}}, [=, this]() {
+			Timer passTimer;
+
+			glNamedFramebufferTexture(m_resolveFB, GL_COLOR_ATTACHMENT0, m_frameGraph.GetTexture(resolved), 0);
+			glBlitNamedFramebuffer(m_msaaFB,
+			                       m_resolveFB,
+			                       0,
+			                       0,
+			                       m_framebufferSize.x,
+			                       m_framebufferSize.y,
+			                       0,
+			                       0,
+			                       m_framebufferSize.x,
+			                       m_framebufferSize.y,
+			                       GL_COLOR_BUFFER_BIT,
+			                       GL_NEAREST);
+
+			GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+			stats->frame.resolveMSAA = passTimer.Tick();
+		});
+	}
 
-	// glBindImageTexture(0, resolveTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-	// glBindImageTexture(1, bloomTextures[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-	// glDispatchCompute(ceil(m_bloomBufferSize.x / 32), ceil(m_bloomBufferSize.y / 32), 1);
-	stats->frame.highpassAndLuminance = timer.Tick();
+	// What the bloom and the compose read
+	FrameGraphResource hdrColor = resolved;
 
-	// size = m_framebufferSize / 2.0f;
+	stats->frame.taa = 0.0;
 
-	Timer bloomTimer;
+	if (m_targetTAA)
+	{
+		const RenderTargetDesc velocityDesc = {.format = GL_RG16F, .width = m_targetSize.x, .height = m_targetSize.y};
 
-	// Init loop
-	m_blurXProgram->Bind();
-	glBindImageTexture(0, resolveTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(1, bloomTextures[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-	glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		const FrameGraphResource sceneDepth  = m_frameGraph.Import("SceneDepth", msaaDepthTexture);
+		const FrameGraphResource velocity    = m_frameGraph.Create("Velocity", velocityDesc);
+		const FrameGraphResource history     = m_frameGraph.Import("History", m_historyTextures[m_historyIndex ^ 1]);
+		const FrameGraphResource antialiased = m_frameGraph.Import("Antialiased", m_historyTextures[m_historyIndex]);
 
-	m_blurYProgram->Bind();
-	glBindImageTexture(0, bloomTextures[0], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(1, bloomTextures[1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-	glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		const glm::mat4 viewProj         = camera.proj * camera.view;
+		const glm::mat4 previousViewProj = m_historyValid ? m_previousViewProj : viewProj;
+		const f32       historyWeight    = m_historyValid ? TAAHistoryWeight : 0.0f;
 
-	size /= 2.0;
+		m_frameGraph.AddPass("Velocity", {{sceneDepth, ResourceAccess_Sampled}}, {{velocity, ResourceAccess_ImageStore}}, [=, this]() {
+			Timer passTimer;
 
-	// And start it
-	for (int i = 1; i < bloomWidth; ++i, size /= 2.0)
-	{
-		m_blurXProgram->Bind();
-		glBindImageTexture(0, bloomTextures[1], i - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-		glBindImageTexture(1, bloomTextures[0], i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-		glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			m_velocityProgram->Bind();
+			m_velocityProgram->SetUniform(UNIFORM("viewportSize"), m_framebufferSize);
+			m_velocityProgram->SetUniform(UNIFORM("inverseViewProj"), glm::inverse(proj * camera.view));
+			m_velocityProgram->SetUniform(UNIFORM("viewProj"), viewProj);
+			m_velocityProgram->SetUniform(UNIFORM("previousViewProj"), previousViewProj);
+
+			GLState::BindImageTexture(0, m_frameGraph.GetTexture(velocity), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+			GLState::BindTextureUnit(1, m_frameGraph.GetTexture(sceneDepth));
+			glDispatchCompute(ceil(m_framebufferSize.x / 16), ceil(m_framebufferSize.y / 16), 1);
+
+			stats->frame.taa += passTimer.Tick();
+		});
+
+		m_frameGraph.AddPass("TAA",
+		                     {{resolved, ResourceAccess_Sampled}, {history, ResourceAccess_Sampled}, {velocity, ResourceAccess_Sampled}},
+		                     {{antialiased, ResourceAccess_ImageStore}},
+		                     [=, this]() {
+			                     Timer passTimer;
+
+			                     m_taaProgram->Bind();
+			                     m_taaProgram->SetUniform(UNIFORM("viewportSize"), m_framebufferSize);
+			                     m_taaProgram->SetUniform(UNIFORM("targetSize"), glm::vec2(m_targetSize));
+			                     m_taaProgram->SetUniform(UNIFORM("historyWeight"), historyWeight);
+
+			                     GLState::BindImageTexture(0, m_frameGraph.GetTexture(antialiased), 0, GL_FALSE, 0, GL_WRITE_ONLY, colorFormat);
+			                     GLState::BindTextureUnit(1, m_frameGraph.GetTexture(resolved));
+			                     GLState::BindTextureUnit(2, m_frameGraph.GetTexture(history));
+			                     GLState::BindTextureUnit(3, m_frameGraph.GetTexture(velocity));
+			                     glDispatchCompute(ceil(m_framebufferSize.x / 16), ceil(m_framebufferSize.y / 16), 1);
+
+			                     stats->frame.taa += passTimer.Tick();
+		                     });
 
-		m_blurYProgram->Bind();
-		glBindImageTexture(0, bloomTextures[0], i, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-		glBindImageTexture(1, bloomTextures[1], i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-		glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		// Read as the history by the next frame
+		m_frameGraph.Export(antialiased, ResourceAccess_Sampled);
+
+		hdrColor           = antialiased;
+		m_historyValid     = true;
+		m_previousViewProj = viewProj;
+
+		m_historyIndex ^= 1;
 	}
 
-	stats->frame.bloomDownsample = timer.Tick();
+	// One pass per dispatch, the graph puts the barriers between them. Every pass only reads the used part of its input
+	const auto addBlurPass = [&](const char* name, Program* program, FrameGraphResource input, i32 inputLevel, glm::vec2 inputSize, FrameGraphResource target, i32 level, glm::vec2 size) {
+		m_frameGraph.AddPass(name, {{input, ResourceAccess_ImageLoad}}, {{target, ResourceAccess_ImageStore}}, [=, this]() {
+			Timer passTimer;
+
+			program->Bind();
+			program->SetUniform(UNIFORM("inputSize"), inputSize);
+			GLState::BindImageTexture(0, m_frameGraph.GetTexture(input), inputLevel, GL_FALSE, 0, GL_READ_ONLY, colorFormat);
+			GLState::BindImageTexture(1, m_frameGraph.GetTexture(target), level, GL_FALSE, 0, GL_WRITE_ONLY, colorFormat);
+			glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
+
+			stats->frame.bloomDownsample += passTimer.Tick();
+		});
+	};
+
+	const auto addUpsamplePass = [&](FrameGraphResource lowRes, i32 lowResLevel, FrameGraphResource highRes, i32 highResLevel, i32 level, glm::vec2 lowResSize) {
+		m_frameGraph.AddPass("BloomUpsample",
+		                     {{lowRes, ResourceAccess_ImageLoad}, {highRes, ResourceAccess_ImageLoad}},
+		                     {{bloom0, ResourceAccess_ImageStore}},
+		                     [=, this]() {
+			                     Timer passTimer;
+
+			                     m_upsampleProgram->Bind();
+			                     m_upsampleProgram->SetUniform(UNIFORM("lowResSize"), lowResSize);
+			                     GLState::BindImageTexture(0, m_frameGraph.GetTexture(lowRes), lowResLevel, GL_FALSE, 0, GL_READ_ONLY, colorFormat);
+			                     GLState::BindImageTexture(1, m_frameGraph.GetTexture(highRes), highResLevel, GL_FALSE, 0, GL_READ_ONLY, colorFormat);
+			                     GLState::BindImageTexture(2, m_frameGraph.GetTexture(bloom0), level, GL_FALSE, 0, GL_WRITE_ONLY, colorFormat);
+			                     glDispatchCompute(ceil(lowResSize.x / 32), ceil(lowResSize.y / 32), 1);
+
+			                     stats->frame.bloomUpsample += passTimer.Tick();
+		                     });
+	};
+
+	// The upsampling needs two levels at least
+	const i32 bloomLevels = Clamp(bloomWidth, 2, (i32)bloomDesc.levels);
 
-	// And upsample.
-	// Init pass
-	size *= 2.0;
-	m_upsampleProgram->Bind();
+	glm::vec2 size = m_framebufferSize / 2.0f;
 
-	glBindImageTexture(0, bloomTextures[1], bloomWidth - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(1, bloomTextures[1], bloomWidth - 2, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(2, bloomTextures[0], bloomWidth - 2, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-	glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	// Downsample and blur, alternating between the two textures
+	addBlurPass("BloomBlurX", m_blurXProgram, hdrColor, 0, m_framebufferSize, bloom0, 0, size);
+	addBlurPass("BloomBlurY", m_blurYProgram, bloom0, 0, size, bloom1, 0, size);
 
-	size *= 2.0;
-	for (int i = bloomWidth - 3; i >= 0; --i, size *= 2)
+	for (i32 i = 1; i < bloomLevels; ++i)
 	{
-		glBindImageTexture(0, bloomTextures[0], i + 1, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-		glBindImageTexture(1, bloomTextures[1], i, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-		glBindImageTexture(2, bloomTextures[0], i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-		glDispatchCompute(ceil(size.x / 32), ceil(size.y / 32), 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		size /= 2.0f;
+
+		addBlurPass("BloomBlurX", m_blurXProgram, bloom1, i - 1, size * 2.0f, bloom0, i, size);
+		addBlurPass("BloomBlurY", m_blurYProgram, bloom0, i, size, bloom1, i, size);
 	}
 
-	stats->frame.bloomUpsample = timer.Tick();
-	stats->frame.bloomTotal    = bloomTimer.Tick();
+	// And upsample, accumulating in the first texture
+	addUpsamplePass(bloom1, bloomLevels - 1, bloom1, bloomLevels - 2, bloomLevels - 2, size);
 
-	// Final render
-	m_outputProgram->Bind();
-	m_outputProgram->SetUniform("viewportSize", m_framebufferSize);
-	m_outputProgram->SetUniform("bloomAmount", bloomAmount);
+	for (i32 i = bloomLevels - 3; i >= 0; --i)
+	{
+		size *= 2.0f;
+		addUpsamplePass(bloom0, i + 1, bloom1, i, i, size);
+	}
 
-	glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
-	glBindTextureUnit(1, resolveTexture);
-	glBindTextureUnit(2, bloomTextures[0]);
-	glBindTextureUnit(3, bloomTextures[1]);
+	std::vector<FrameGraphUse> composeReads = {{hdrColor, ResourceAccess_Sampled}};
+	if (bloom)
+	{
+		composeReads.push_back({bloom0, ResourceAccess_Sampled});
+	}
+
+	m_frameGraph.AddPass("Compose", std::move(composeReads), {{output, ResourceAccess_ImageStore}}, [=, this]() {
+		Timer passTimer;
+
+		m_outputProgram->Bind();
+		m_outputProgram->SetUniform(UNIFORM("viewportSize"), m_framebufferSize);
+		m_outputProgram->SetUniform(UNIFORM("bloomAmount"), bloomAmount);
+		m_outputProgram->SetUniform(UNIFORM("bloomEnabled"), (i32)bloom);
+
+		GLState::BindImageTexture(0, m_frameGraph.GetTexture(output), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+		GLState::BindTextureUnit(1, m_frameGraph.GetTexture(hdrColor));
+
+		if (bloom)
+		{
+			const GLuint bloomTexture = m_frameGraph.GetTexture(bloom0);
+
+			glTextureParameteri(bloomTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTextureParameteri(bloomTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTextureParameteri(bloomTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+			glTextureParameteri(bloomTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			GLState::BindTextureUnit(2, bloomTexture);
+		}
+
+		glDispatchCompute(ceil(m_framebufferSize.x / 32), ceil(m_framebufferSize.y / 32), 1);
+
+		stats->frame.finalCompositing = passTimer.Tick();
+	});
+
+	// Displayed by ImGui
+	m_frameGraph.Export(output, ResourceAccess_Sampled);
 
-	glDispatchCompute(m_framebufferSize.x / 32, m_framebufferSize.y / 32, 1);
+	m_frameGraph.Compile();
+	m_frameGraph.Execute();
 
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	stats->frame.bloomTotal = stats->frame.bloomDownsample + stats->frame.bloomUpsample;
 
-	stats->frame.finalCompositing = timer.Tick();
+	stats->frame.glCallsIssued    = GLState::GetIssuedCount();
+	stats->frame.glCallsElided    = GLState::GetElidedCount();
 	stats->renderTotal            = frameTimer.Tick();
 }
 
@@ -346,6 +1228,7 @@ Mesh::Mesh(const VertexDataInfos& vertexDataInfos, const IndexDataInfos& indexDa
 	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
 
 	glCreateVertexArrays(1, &vao);
+	depthVao = vao;
 
 	const GLsizeiptr alignedIndexSize = AlignedSize(indexDataInfos.bufferSize, alignment);
 
@@ -453,34 +1336,35 @@ void Mesh::SetLayout(const Layout& layout, const std::vector<GLsizeiptr>& offset
 	}
 }
 
-void Mesh::Draw() const
+const void* Mesh::GetIndexOffset() const
 {
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
-	glDrawElements(GL_TRIANGLES, indexCount, indexType, nullptr);
+	const u32 indexSize = indexType == GL_UNSIGNED_INT ? 4 : (indexType == GL_UNSIGNED_SHORT ? 2 : 1);
+	return (const void*)((uintptr_t)firstIndex * indexSize);
 }
 
-void Mesh::DrawInstanced(u32 instanceCount) const
+void Mesh::Draw() const
 {
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
-	glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, nullptr, instanceCount);
+	GLState::BindVertexArray(vao);
+	glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, GetIndexOffset(), baseVertex);
 }
 
-void Model::Draw(RenderContext* context) const
+void Mesh::Bind() const
 {
-	context->model = worldTransform;
-
-	Program* program = material->GetProgram();
-
-	program->Bind();
+	GLState::BindVertexArray(vao);
+}
 
-	program->SetUniform("u_eye", context->eyePosition);
-	program->SetUniform("u_model", context->model);
-	program->SetUniform("u_view", context->view);
-	program->SetUniform("u_proj", context->proj);
+void Mesh::BindDepth() const
+{
+	GLState::BindVertexArray(depthVao);
+}
 
-	material->Bind(program, context->env);
+void Mesh::DrawWithBaseInstance(u32 baseInstance) const
+{
+	glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, indexCount, indexType, GetIndexOffset(), 1, baseVertex, baseInstance);
+}
 
-	mesh->Draw();
+void Mesh::DrawInstanced(u32 instanceCount) const
+{
+	GLState::BindVertexArray(vao);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, GetIndexOffset(), instanceCount, baseVertex);
 }
@@ -1,14 +1,28 @@
 #pragma once
 
+#include "renderer/bvh.h"
+#include "renderer/clustered_lighting.h"
+#include "renderer/culling.h"
+#include "renderer/depth_pyramid.h"
 #include "renderer/environment.h"
+#include "renderer/environment_library.h"
+#include "renderer/frame_data.h"
+#include "renderer/frame_graph.h"
+#include "renderer/geometry_pool.h"
+#include "renderer/gpu_scene.h"
 #include "renderer/material.h"
+#include "renderer/occlusion_buffer.h"
 #include "renderer/program.h"
+#include "renderer/render_queue.h"
+#include "renderer/render_target_pool.h"
+#include "renderer/shadow_maps.h"
 
 #include "core/defines.h"
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <utility>
 #include <vector>
 
 enum DataType
@@ -81,20 +95,28 @@ struct IndexDataInfos
 	const GLubyte* data;
 };
 
-struct Vertex
-{
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 texcoord;
-};
-
 struct Mesh
 {
 	GLuint  vao, buffer;
+	GLuint  depthVao; // Positions only when the mesh lives in the GeometryPool, vao otherwise
 	GLsizei indexCount;
 	GLsizei vertexCount;
 	GLenum  indexType;
 
+	// Where the indices start in the buffer, and the offset added to them
+	u32 firstIndex = 0;
+	i32 baseVertex = 0;
+
+	// Object space bounds, filled by the importer
+	glm::vec3 boundsMin    = glm::vec3(0.0f);
+	glm::vec3 boundsMax    = glm::vec3(0.0f);
+	glm::vec3 sphereCenter = glm::vec3(0.0f);
+	f32       sphereRadius = 0.0f;
+
+	// CPU copy rasterized by the OcclusionBuffer, empty unless the importer picked the mesh as an occluder
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<u32>       occluderIndices;
+
 	Mesh();
 	Mesh(const std::vector<Vertex>& vertices, const std::vector<GLushort>& indices);
 	Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
@@ -104,44 +126,44 @@ struct Mesh
 
 	void SetLayout(const Layout& layout, const std::vector<GLsizeiptr>& offsets);
 
+	// Stores the mesh in the shared GeometryPool, with 32 bit indices
 	template <typename IndexType>
 	void SetData(const std::vector<Vertex>& vertices, const std::vector<IndexType>& indices)
 	{
-		GLint alignment = GL_NONE;
-		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
-
-		glCreateVertexArrays(1, &vao);
-
-		const GLsizeiptr indexSize        = indices.size() * sizeof(IndexType);
-		const GLsizeiptr alignedIndexSize = AlignedSize(indexSize, alignment);
-
-		const GLsizeiptr vertexSize        = vertices.size() * sizeof(Vertex);
-		const GLsizeiptr alignedVertexSize = AlignedSize(vertexSize, alignment);
-
-		glCreateBuffers(1, &buffer);
-		glNamedBufferStorage(buffer, alignedIndexSize + alignedVertexSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
-
-		glNamedBufferSubData(buffer, 0, indexSize, indices.data());
-		glNamedBufferSubData(buffer, alignedIndexSize, vertexSize, vertices.data());
-
-		glVertexArrayVertexBuffer(vao, 0, buffer, alignedIndexSize, sizeof(Vertex));
-		glVertexArrayElementBuffer(vao, buffer);
-
-		static const Layout layout = {{BindingPoint_Position, DataType_Float, ElementType_Vec3},
-		                              {BindingPoint_Normal, DataType_Float, ElementType_Vec3},
-		                              {BindingPoint_Texcoord0, DataType_Float, ElementType_Vec2}};
-
-		SetLayout(layout, {offsetof(Vertex, position), offsetof(Vertex, normal), offsetof(Vertex, texcoord)});
+		GeometryRange range;
+
+		if constexpr (sizeof(IndexType) == sizeof(u32))
+		{
+			range = GeometryPool::Get()->Add(vertices.data(), (u32)vertices.size(), indices.data(), (u32)indices.size());
+		}
+		else
+		{
+			const std::vector<u32> wideIndices(indices.begin(), indices.end());
+			range = GeometryPool::Get()->Add(vertices.data(), (u32)vertices.size(), wideIndices.data(), (u32)wideIndices.size());
+		}
+
+		vao        = GeometryPool::Get()->GetVertexArray();
+		depthVao   = GeometryPool::Get()->GetDepthVertexArray();
+		buffer     = 0;
+		indexType  = GL_UNSIGNED_INT;
+		firstIndex = range.firstIndex;
+		baseVertex = range.baseVertex;
 	}
 
+	const void* GetIndexOffset() const;
+
 	void Draw() const;
+	void Bind() const;
+	void BindDepth() const;
+	// Expects the mesh to be bound
+	void DrawWithBaseInstance(u32 baseInstance) const;
 	void DrawInstanced(u32 instanceCount) const;
 };
 
 struct RenderContext
 {
 	glm::vec3 eyePosition;
-	glm::mat4 model, view, proj;
+	glm::mat4 view, proj;
 
 	glm::vec3 lightDirection;
 
@@ -154,8 +176,6 @@ struct Model
 	Mesh*     mesh;
 
 	glm::mat4 worldTransform;
-
-	void Draw(RenderContext* context) const;
 };
 
 struct CameraInfos
@@ -173,40 +193,140 @@ enum BackgroundType
 	BackgroundType_Irradiance = 3,
 };
 
+// Format of the scene color and of the post-process chain
+enum HDRFormat
+{
+	HDRFormat_R11G11B10F = 0, // No alpha, the blending never reads the destination alpha
+	HDRFormat_RGBA16F    = 1,
+	HDRFormat_RGBA32F    = 2,
+	HDRFormat_Count,
+};
+
 class Renderer
 {
 public:
 	void Initialize(const glm::vec2& initSize);
+	// Frees what outlives a frame, before the GL context goes away
+	void Shutdown();
 	void Render(const CameraInfos& camera, const std::vector<Model>& models);
 
+	// Rebuilds the world bounds used for culling, models must not change until the next call
+	void OnSceneLoaded(const std::vector<Model>& models);
+	// Refits the bounds after model transforms changed
+	void OnTransformsChanged(const std::vector<Model>& models);
+
+	// True when the opaque pass is culled and submitted on the GPU
+	bool IsGPUDriven() const;
+
+	// World bounds of the models given to OnSceneLoaded()
+	void GetSceneBounds(glm::vec3* boundsMin, glm::vec3* boundsMax) const
+	{
+		*boundsMin = m_sceneMin;
+		*boundsMax = m_sceneMax;
+	}
+
+	// Index of the closest model whose bounds the ray hits, -1 if none
+	i32 Pick(const glm::vec3& origin, const glm::vec3& direction) const;
+
+	// The render targets are only reallocated when the size leaves their size class, see UpdateRenderTargets()
 	void Resize(const glm::vec2& newSize);
 
+	// Part of the render targets holding the image, the targets may be larger than the viewport
+	glm::vec2 GetOutputUVScale() const;
+
 	Environment* GetEnvironment()
 	{
-		return &m_environment;
+		return m_environments.GetCurrent();
+	}
+
+	EnvironmentLibrary* GetEnvironmentLibrary()
+	{
+		return &m_environments;
 	}
 
 public:
 	i32 backgroundType     = BackgroundType_Cubemap;
 	i32 backgroundMipLevel = 0;
 
-	f32 bloomThreshold = 1.0f;
-	i32 bloomWidth     = 4;
-	f32 bloomAmount    = 1.0f;
+	// Only effective when GPUScene is supported and every mesh lives in the GeometryPool
+	bool gpuDriven = true;
+	// Two-phase occlusion culling against a depth pyramid, GPU-driven path only
+	bool occlusionCulling = true;
+	// Occluders rasterized on the CPU, CPU path only
+	bool softwareOcclusion = true;
+	// Depth-only pass before shading with GL_EQUAL
+	bool depthPrepass = true;
+
+	// Directional light, lightDirection is the direction it travels along
+	glm::vec3 lightDirection = glm::vec3(-0.4f, -1.0f, -0.3f);
+	glm::vec3 lightColor     = glm::vec3(1.0f);
+	f32       lightIntensity = 3.0f;
+	// Cascaded shadow maps of the directional light, cached while the light and the scene stay put
+	bool shadows = true;
+
+	std::vector<Light> lights;
+
+	i32 hdrFormat   = HDRFormat_R11G11B10F;
+	i32 msaaSamples = 4; // 1, 2, 4 or 8, clamped to what the driver supports
+	// Temporal anti-aliasing, replaces MSAA and renders single sample targets
+	bool taa = false;
+
+	bool bloom          = true;
+	f32  bloomThreshold = 1.0f;
+	i32  bloomWidth     = 4;
+	f32  bloomAmount    = 1.0f;
 
 	u32 msaaRenderTexture;
-	u32 resolveTexture;
-	u32 msaaDepthRenderBuffer;
-
-	// Post-process textures
-	u32 bloomTextures[2];
-	u32 averageLuminanceTexture;
+	u32 msaaDepthTexture;
 
 	// Final render texture
 	u32 outputTexture;
 
 private:
-	glm::vec2 m_framebufferSize;
+	// Shrinks the targets once the viewport stayed in a smaller size class for a while
+	void UpdateRenderTargets();
+	// Gives the current targets back to the pool and acquires targets of the given size
+	void AllocateRenderTargets(const glm::uvec2& size);
+	// Post-process programs specialized for the format, false while they are still compiling
+	bool SelectPostProcessPrograms(HDRFormat format);
+
+	// Union of the world bounds, m_sceneMin and m_sceneMax
+	void UpdateSceneExtent();
+
+	void BeginDepthPrepass();
+	void BeginShading(bool afterPrepass);
+
+	// Submits the sorted render queue, with the depth programs when depthOnly is set
+	void DrawRenderQueue(const std::vector<Model>& models, bool depthOnly);
+	// Draws what the phase kept, pre-pass included, returns the number of draw calls
+	u32 DrawGPUScene(CullPhase phase, bool prepass);
+
+	// Frustum culling of the scene bounds, through the BVH for large scenes
+	void CullModels(const Frustum& frustum, std::vector<u8>* visibility) const;
+
+	// Gathers the casters of the cascades that have to be rendered again
+	void CullShadowCasters(const CameraInfos& camera, const std::vector<Model>& models);
+	// Expects the draw data of the casters to start at firstDraw
+	void RenderShadows(const std::vector<Model>& models, u32 firstDraw);
+
+	// Rasterizes the largest visible occluders and hides the models behind them from m_visibility
+	void CullOccluded(const CameraInfos& camera, const std::vector<Model>& models, const glm::mat4& viewProj);
+
+private:
+	glm::vec2  m_framebufferSize;             // Viewport, rendered in the bottom left corner of the targets
+	glm::uvec2 m_targetSize   = glm::uvec2(0); // Allocated size of the targets
+	u32        m_shrinkFrames = 0;
+	HDRFormat  m_targetFormat;
+	u32        m_targetSamples;
+	bool       m_targetTAA;
+	u32        m_maxSamples;
+
+	// Antialiased output of the previous and the current frame, only allocated with TAA
+	u32       m_historyTextures[2] = {0, 0};
+	u32       m_historyIndex       = 0;
+	bool      m_historyValid       = false;
+	u32       m_taaFrame           = 0;
+	glm::mat4 m_previousViewProj   = glm::mat4(1.0f); // Without jitter
 
 	u32 m_fbos[2];
 
@@ -215,12 +335,51 @@ private:
 
 	Program* m_backgroundProgram;
 
-	// Post-process compute shaders
-	Program* m_highpassProgram;
-	Program* m_blurXProgram;
-	Program* m_blurYProgram;
-	Program* m_upsampleProgram;
-	Program* m_outputProgram;
+	Program* m_depthProgram;
+	Program* m_alphaTestedDepthProgram;
+	Program* m_shadowProgram;
+	Program* m_alphaTestedShadowProgram;
 
-	Environment m_environment;
+	// Post-process compute shaders
+	Program* m_highpassProgram = nullptr;
+	Program* m_blurXProgram    = nullptr;
+	Program* m_blurYProgram    = nullptr;
+	Program* m_upsampleProgram = nullptr;
+	Program* m_outputProgram   = nullptr;
+	Program* m_taaProgram      = nullptr;
+	Program* m_velocityProgram = nullptr;
+
+	u32                m_iblDFG;
+	EnvironmentLibrary m_environments;
+
+	FrameDataBuffer m_frameData;
+	RenderQueue     m_renderQueue;
+
+	SceneBounds      m_sceneBounds;
+	glm::vec3        m_sceneMin = glm::vec3(0.0f);
+	glm::vec3        m_sceneMax = glm::vec3(0.0f);
+	BVH              m_bvh;
+	std::vector<u8>  m_visibility;
+	std::vector<u32> m_visibleModels; // Model index of each draw
+
+	ClusteredLighting m_lighting;
+
+	// Post-process passes, recorded every frame
+	FrameGraph m_frameGraph;
+
+	ShadowMaps       m_shadowMaps;
+	std::vector<u8>  m_shadowVisibility;
+	std::vector<u32> m_shadowCasters;                         // Model index of each caster, cascade after cascade
+	u32              m_shadowCasterCounts[ShadowCascadeCount]; // 0 for the cached cascades
+
+	OcclusionBuffer                  m_occlusionBuffer;
+	std::vector<u32>                 m_occluders;      // Models large enough to be occluders
+	std::vector<std::pair<f32, u32>> m_frameOccluders; // Angular size and model index
+
+	std::vector<Material*> m_materials;      // Unique materials of the scene
+	std::vector<u32>       m_modelMaterials; // Index in m_materials of each model
+
+	GPUScene     m_gpuScene;
+	bool         m_gpuSceneAvailable = false;
+	DepthPyramid m_depthPyramid;
 };
@@ -0,0 +1,256 @@
+#include "shader_preprocessor.h"
+
+#include "core/hash.h"
+
+#include <algorithm>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
+struct ShaderFile
+{
+	std::string filename;
+	std::string content;
+	bool        loaded = false;
+	bool        exists = false;
+};
+
+// Ids are stable for the whole run, only the contents get invalidated.
+// A deque keeps references valid while includes add new files.
+[[clang::no_destroy]] global_variable std::deque<ShaderFile> g_shaderFiles;
+[[clang::no_destroy]] global_variable std::unordered_map<std::string, u32> g_shaderFileIds;
+
+static u32 GetShaderFileId(const std::string& filename)
+{
+	auto it = g_shaderFileIds.find(filename);
+	if (it != g_shaderFileIds.end())
+	{
+		return it->second;
+	}
+
+	const u32 id = (u32)g_shaderFiles.size();
+	g_shaderFiles.push_back({.filename = filename});
+	g_shaderFileIds.emplace(filename, id);
+
+	return id;
+}
+
+static const ShaderFile& LoadShaderFile(u32 fileId)
+{
+	ShaderFile& file = g_shaderFiles[fileId];
+
+	if (!file.loaded)
+	{
+		file.loaded = true;
+		file.exists = false;
+		file.content.clear();
+
+		if (FILE* f = fopen(file.filename.c_str(), "rb"))
+		{
+			fseek(f, 0, SEEK_END);
+			const long size = ftell(f);
+			rewind(f);
+
+			file.content.resize(size);
+			file.content.resize(fread(file.content.data(), 1, size, f));
+			file.exists = true;
+
+			fclose(f);
+		}
+	}
+
+	return file;
+}
+
+static std::string_view TrimLeft(std::string_view str)
+{
+	while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+	{
+		str.remove_prefix(1);
+	}
+	return str;
+}
+
+// Returns the included path if the line is an #include directive
+static bool ParseInclude(std::string_view line, std::string_view* path)
+{
+	line = TrimLeft(line);
+	if (!line.starts_with('#'))
+	{
+		return false;
+	}
+
+	line = TrimLeft(line.substr(1));
+	if (!line.starts_with("include"))
+	{
+		return false;
+	}
+
+	const size_t begin = line.find_first_of("\"<");
+	const size_t end   = line.find_last_of("\">");
+
+	if (begin == std::string_view::npos || end == std::string_view::npos || end <= begin)
+	{
+		return false;
+	}
+
+	*path = line.substr(begin + 1, end - begin - 1);
+	return true;
+}
+
+static void AppendLine(std::string* output, u32 line, u32 fileId)
+{
+	char directive[32];
+	snprintf(directive, sizeof(directive), "#line %u %u\n", line, fileId);
+	output->append(directive);
+}
+
+static void Expand(u32 fileId, std::vector<u32>* files, std::string* output)
+{
+	const ShaderFile& file = LoadShaderFile(fileId);
+
+	const std::string directory = file.filename.substr(0, file.filename.find_last_of("/\\") + 1);
+
+	std::string_view content = file.content;
+
+	AppendLine(output, 1, fileId);
+
+	u32 lineNumber = 1;
+
+	while (!content.empty())
+	{
+		const size_t     eol  = content.find('\n');
+		std::string_view line = content.substr(0, eol);
+		content.remove_prefix(eol == std::string_view::npos ? content.size() : eol + 1);
+
+		std::string_view includePath;
+		if (ParseInclude(line, &includePath))
+		{
+			const u32 includeId = GetShaderFileId(directory + std::string(includePath));
+
+			// Acts as #pragma once, which also breaks include cycles
+			if (std::find(files->begin(), files->end(), includeId) == files->end())
+			{
+				files->push_back(includeId);
+
+				if (LoadShaderFile(includeId).exists)
+				{
+					Expand(includeId, files, output);
+				}
+				else
+				{
+					fprintf(stderr, "%s(%u): Could not find include %s\n", file.filename.c_str(), lineNumber, g_shaderFiles[includeId].filename.c_str());
+				}
+
+				AppendLine(output, lineNumber + 1, fileId);
+			}
+			else
+			{
+				output->push_back('\n');
+			}
+		}
+		else
+		{
+			output->append(line);
+			output->push_back('\n');
+		}
+
+		++lineNumber;
+	}
+}
+
+bool PreprocessShader(const char* filename, const std::vector<const char*>& defines, PreprocessedShader* result)
+{
+	const u32 fileId = GetShaderFileId(filename);
+
+	result->source.clear();
+	result->files.clear();
+	result->files.push_back(fileId);
+	result->hash = 0;
+
+	const ShaderFile& file = LoadShaderFile(fileId);
+	if (!file.exists || file.content.empty())
+	{
+		return false;
+	}
+
+	result->source.reserve(file.content.size() * 2);
+	result->source.append("#version 450\n");
+
+	for (const char* define : defines)
+	{
+		result->source.append("#define ");
+		result->source.append(define);
+		result->source.push_back('\n');
+	}
+
+	Expand(fileId, &result->files, &result->source);
+
+	result->hash = HashString(result->source);
+
+	return true;
+}
+
+const std::string& GetShaderFilename(u32 fileId)
+{
+	return g_shaderFiles[fileId].filename;
+}
+
+void InvalidateShaderFile(const std::string& filename)
+{
+	auto it = g_shaderFileIds.find(filename);
+	if (it != g_shaderFileIds.end())
+	{
+		g_shaderFiles[it->second].loaded = false;
+	}
+}
+
+std::string RemapShaderLog(const char* log)
+{
+	// Drivers report locations as "id(line)" (NVIDIA) or "id:line" (AMD, Intel, Mesa),
+	// at the start of a line or after an "ERROR: " / "WARNING: " prefix
+	std::string result;
+
+	std::string_view remaining = log;
+
+	while (!remaining.empty())
+	{
+		const size_t     eol  = remaining.find('\n');
+		std::string_view line = remaining.substr(0, eol == std::string_view::npos ? remaining.size() : eol + 1);
+		remaining.remove_prefix(line.size());
+
+		size_t start = 0;
+		for (std::string_view prefix : {"ERROR: ", "WARNING: "})
+		{
+			if (line.starts_with(prefix))
+			{
+				start = prefix.size();
+			}
+		}
+
+		size_t end = start;
+		while (end < line.size() && line[end] >= '0' && line[end] <= '9')
+		{
+			++end;
+		}
+
+		u32 fileId = 0;
+		for (size_t i = start; i < end; ++i)
+		{
+			fileId = fileId * 10 + (line[i] - '0');
+		}
+
+		if (end > start && end < line.size() && (line[end] == '(' || line[end] == ':') && fileId < g_shaderFiles.size())
+		{
+			result.append(line.substr(0, start));
+			result.append(g_shaderFiles[fileId].filename);
+			result.append(line.substr(end));
+		}
+		else
+		{
+			result.append(line);
+		}
+	}
+
+	return result;
+}
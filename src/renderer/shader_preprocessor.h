@@ -0,0 +1,27 @@
+#pragma once
+
+#include "core/defines.h"
+
+#include <string>
+#include <vector>
+
+// Expands #include directives of GLSL sources.
+// Files are read once and interned, each one gets an id that is used as the source string number of the
+// #line directives, so that compiler logs can be mapped back to file names with RemapShaderLog().
+
+struct PreprocessedShader
+{
+	std::string      source;
+	u64              hash = 0; // Of the expanded source
+	std::vector<u32> files;    // The shader itself, then every included file
+};
+
+bool PreprocessShader(const char* filename, const std::vector<const char*>& defines, PreprocessedShader* result);
+
+const std::string& GetShaderFilename(u32 fileId);
+
+// Drops the cached content of a file that changed on disk
+void InvalidateShaderFile(const std::string& filename);
+
+// Replaces the source string numbers of a compiler log with the matching file names
+std::string RemapShaderLog(const char* log);
@@ -0,0 +1,182 @@
+#include "shadow_maps.h"
+
+#include "renderer/gl_state.h"
+
+#include "core/utils.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <float.h>
+#include <math.h>
+
+// Blend between uniform and logarithmic splits, 1 is fully logarithmic
+constexpr f32 CascadeSplitLambda = 0.8f;
+// Extra coverage around the slice, the camera can move that much before the map is rendered again
+constexpr f32 CascadeCacheMargin = 0.25f;
+// The slice radius is rounded up to quarter octaves, so that zooming does not change it every frame
+constexpr f32 CascadeRadiusSteps = 4.0f;
+// Below that cosine between the old and the new light direction, every cascade is rendered again
+constexpr f32 LightDirectionTolerance = 0.99999f;
+
+void ShadowMaps::Initialize()
+{
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &m_texture);
+	glTextureStorage3D(m_texture, 1, GL_DEPTH_COMPONENT32F, Resolution, Resolution, ShadowCascadeCount);
+	glTextureParameteri(m_texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(m_texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(m_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Hardware 2x2 PCF on top of the taps of pbr.frag.glsl
+	glTextureParameteri(m_texture, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTextureParameteri(m_texture, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	glCreateFramebuffers(1, &m_framebuffer);
+	glNamedFramebufferDrawBuffer(m_framebuffer, GL_NONE);
+	glNamedFramebufferReadBuffer(m_framebuffer, GL_NONE);
+}
+
+void ShadowMaps::Update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDirection, const glm::vec3& sceneMin, const glm::vec3& sceneMax)
+{
+	const glm::vec3 direction = glm::normalize(lightDirection);
+
+	if (glm::dot(direction, m_lightDirection) < LightDirectionTolerance)
+	{
+		m_lightDirection = direction;
+		Invalidate();
+	}
+
+	const glm::vec3 up        = fabsf(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), m_lightDirection, up);
+
+	// Every caster of the scene fits between the near and far planes
+	f32 minZ = FLT_MAX;
+	f32 maxZ = -FLT_MAX;
+
+	for (u32 i = 0; i < 8; ++i)
+	{
+		const glm::vec3 corner((i & 1) ? sceneMax.x : sceneMin.x, (i & 2) ? sceneMax.y : sceneMin.y, (i & 4) ? sceneMax.z : sceneMin.z);
+		const f32       z = (lightView * glm::vec4(corner, 1.0f)).z;
+
+		minZ = Min(minZ, z);
+		maxZ = Max(maxZ, z);
+	}
+
+	const f32       depthPadding = 0.01f * (maxZ - minZ) + 1e-3f;
+	const glm::vec2 depthRange(-maxZ - depthPadding, -minZ + depthPadding);
+
+	if (depthRange != m_depthRange)
+	{
+		m_depthRange = depthRange;
+		Invalidate();
+	}
+
+	const glm::mat4 inverseView = glm::inverse(view);
+	const glm::vec3 eye         = glm::vec3(inverseView[3]);
+
+	// Planes of a GL perspective projection, the shadows stop where the scene does
+	const f32 nearPlane   = proj[3][2] / (proj[2][2] - 1.0f);
+	const f32 farPlane    = proj[3][2] / (proj[2][2] + 1.0f);
+	const f32 sceneRadius = 0.5f * glm::length(sceneMax - sceneMin);
+	const f32 shadowFar   = Max(Min(farPlane, glm::length(0.5f * (sceneMin + sceneMax) - eye) + sceneRadius), 2.0f * nearPlane);
+
+	const f32 tanHalfX = 1.0f / proj[0][0];
+	const f32 tanHalfY = 1.0f / proj[1][1];
+
+	f32 splitNear = nearPlane;
+
+	for (u32 i = 0; i < ShadowCascadeCount; ++i)
+	{
+		Cascade& cascade = m_cascades[i];
+
+		const f32 t           = (f32)(i + 1) / ShadowCascadeCount;
+		const f32 uniform     = nearPlane + (shadowFar - nearPlane) * t;
+		const f32 logarithmic = nearPlane * powf(shadowFar / nearPlane, t);
+		const f32 splitFar    = uniform + (logarithmic - uniform) * CascadeSplitLambda;
+
+		glm::vec3 corners[8];
+		glm::vec3 center = glm::vec3(0.0f);
+
+		for (u32 c = 0; c < 8; ++c)
+		{
+			const f32 depth = (c & 4) ? splitFar : splitNear;
+			const f32 x     = (c & 1) ? tanHalfX : -tanHalfX;
+			const f32 y     = (c & 2) ? tanHalfY : -tanHalfY;
+
+			corners[c] = glm::vec3(inverseView * glm::vec4(x * depth, y * depth, -depth, 1.0f));
+			center += corners[c] * 0.125f;
+		}
+
+		f32 sliceRadius = 0.0f;
+		for (u32 c = 0; c < 8; ++c)
+		{
+			sliceRadius = Max(sliceRadius, glm::length(corners[c] - center));
+		}
+
+		const f32 radius    = exp2f(ceilf(log2f(sliceRadius) * CascadeRadiusSteps) / CascadeRadiusSteps) * (1.0f + CascadeCacheMargin);
+		const f32 texelSize = 2.0f * radius / Resolution;
+
+		const glm::vec2 lightCenter = glm::vec2(lightView * glm::vec4(center, 1.0f));
+		const glm::vec2 offset      = glm::abs(lightCenter - cascade.center);
+		const f32       slack       = radius - sliceRadius - texelSize;
+
+		cascade.splitDepth = splitFar;
+		splitNear          = splitFar;
+
+		// The cached map still covers the whole slice
+		if (!cascade.dirty && cascade.radius == radius && offset.x <= slack && offset.y <= slack)
+		{
+			continue;
+		}
+
+		// Moving by whole texels keeps the rasterization of static casters identical
+		cascade.center = glm::floor(lightCenter / texelSize) * texelSize;
+		cascade.radius = radius;
+		cascade.dirty  = true;
+
+		const glm::mat4 lightProj = glm::ortho(cascade.center.x - radius,
+		                                       cascade.center.x + radius,
+		                                       cascade.center.y - radius,
+		                                       cascade.center.y + radius,
+		                                       m_depthRange.x,
+		                                       m_depthRange.y);
+
+		cascade.viewProj = lightProj * lightView;
+		cascade.frustum  = MakeFrustum(cascade.viewProj);
+	}
+}
+
+void ShadowMaps::Invalidate()
+{
+	for (Cascade& cascade : m_cascades)
+	{
+		cascade.dirty = true;
+	}
+}
+
+void ShadowMaps::BeginCascade(u32 cascade)
+{
+	glNamedFramebufferTextureLayer(m_framebuffer, GL_DEPTH_ATTACHMENT, m_texture, 0, cascade);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+
+	glViewport(0, 0, Resolution, Resolution);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	m_cascades[cascade].dirty = false;
+}
+
+void ShadowMaps::WriteFrameData(FrameData* frameData) const
+{
+	// From clip space to texture coordinates and depth
+	const glm::mat4 bias = glm::mat4(0.5f, 0.0f, 0.0f, 0.0f, //
+	                                 0.0f, 0.5f, 0.0f, 0.0f, //
+	                                 0.0f, 0.0f, 0.5f, 0.0f, //
+	                                 0.5f, 0.5f, 0.5f, 1.0f);
+
+	for (u32 i = 0; i < ShadowCascadeCount; ++i)
+	{
+		frameData->shadowMatrices[i]  = bias * m_cascades[i].viewProj;
+		frameData->shadowSplits[i]    = m_cascades[i].splitDepth;
+		frameData->shadowTexelSize[i] = 2.0f * m_cascades[i].radius / Resolution;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "renderer/culling.h"
+#include "renderer/frame_data.h"
+
+#include "core/defines.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Cascaded shadow maps of the directional light, one layer of a depth array per cascade.
+// Each cascade covers the bounding sphere of its slice of the view frustum with some margin,
+// snapped to its texels so that the shadows do not shimmer. A cascade keeps its map as long
+// as the light stays put and its slice stays inside the area it covers, the scene being static.
+class ShadowMaps
+{
+public:
+	static constexpr u32 Resolution = 2048;
+
+	void Initialize();
+
+	// Fits the cascades to the camera, the ones whose map went stale are flagged dirty
+	void Update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDirection, const glm::vec3& sceneMin, const glm::vec3& sceneMax);
+	// Every cascade is rendered again on the next frame, to call when the scene changed
+	void Invalidate();
+
+	bool IsDirty(u32 cascade) const
+	{
+		return m_cascades[cascade].dirty;
+	}
+
+	const glm::mat4& GetViewProj(u32 cascade) const
+	{
+		return m_cascades[cascade].viewProj;
+	}
+
+	const Frustum& GetFrustum(u32 cascade) const
+	{
+		return m_cascades[cascade].frustum;
+	}
+
+	// Binds and clears the layer of the cascade, which is then considered up to date
+	void BeginCascade(u32 cascade);
+
+	void WriteFrameData(FrameData* frameData) const;
+
+	GLuint GetTexture() const
+	{
+		return m_texture;
+	}
+
+private:
+	struct Cascade
+	{
+		glm::mat4 viewProj;
+		Frustum   frustum;
+		glm::vec2 center     = glm::vec2(0.0f); // Light space, snapped to the texels
+		f32       radius     = 0.0f;            // Half the side of the covered square
+		f32       splitDepth = 0.0f;            // View depth where the next cascade starts
+		bool      dirty      = true;
+	};
+
+	Cascade m_cascades[ShadowCascadeCount];
+
+	glm::vec3 m_lightDirection = glm::vec3(0.0f);
+	glm::vec2 m_depthRange     = glm::vec2(0.0f); // Light space, from the scene bounds
+
+	GLuint m_texture     = 0;
+	GLuint m_framebuffer = 0;
+};
@@ -65,3 +65,27 @@ u32 LoadTexture(const std::string& filename)
 
 	return texture;
 }
+
+static std::unordered_map<u32, u64> g_textureHandles;
+
+bool IsBindlessTextureSupported()
+{
+	return GLAD_GL_ARB_bindless_texture != 0;
+}
+
+u64 GetTextureHandle(u32 texture)
+{
+	auto it = g_textureHandles.find(texture);
+	if (it != g_textureHandles.end())
+	{
+		return it->second;
+	}
+
+	// Resident for the lifetime of the texture, which is never released anyway
+	const u64 handle = glGetTextureHandleARB(texture);
+	glMakeTextureHandleResidentARB(handle);
+
+	g_textureHandles.insert(std::make_pair(texture, handle));
+
+	return handle;
+}
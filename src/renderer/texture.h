@@ -4,4 +4,8 @@
 
 #include <string>
 
-u32 LoadTexture(const std::string& filename);
\ No newline at end of file
+u32 LoadTexture(const std::string& filename);
+
+bool IsBindlessTextureSupported();
+// Resident bindless handle of the texture, created on first use
+u64 GetTextureHandle(u32 texture);
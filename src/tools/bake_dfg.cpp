@@ -0,0 +1,39 @@
+#include "renderer/dfggen.h"
+
+#include "core/defines.h"
+
+#include <stdio.h>
+
+// Writes the DFG LUT as a C++ source file, so that release builds can upload it without computing anything
+i32 main(i32 argc, char** argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <output.cpp>\n", argv[0]);
+		return 1;
+	}
+
+	const std::vector<u32> lut = PrecomputeDFG(DFGSize, DFGSize, DFGSampleCount);
+
+	FILE* file = fopen(argv[1], "w");
+	if (!file)
+	{
+		fprintf(stderr, "Could not open %s\n", argv[1]);
+		return 1;
+	}
+
+	defer(fclose(file));
+
+	fprintf(file, "// Generated by bake_dfg, do not edit\n");
+	fprintf(file, "#include \"renderer/dfggen.h\"\n\n");
+	fprintf(file, "extern const u32 g_bakedDFG[DFGSize * DFGSize] = {\n");
+
+	for (size_t i = 0; i < lut.size(); ++i)
+	{
+		fprintf(file, "%s0x%08x,%s", (i % 8 == 0) ? "\t" : "", lut[i], (i % 8 == 7) ? "\n" : " ");
+	}
+
+	fprintf(file, "};\n");
+
+	return 0;
+}